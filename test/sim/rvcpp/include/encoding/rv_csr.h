@@ -290,6 +290,8 @@
 #define CSR_TDATA1 0x7a1
 #define CSR_TDATA2 0x7a2
 #define CSR_TDATA3 0x7a3
+#define CSR_TINFO 0x7a4
+#define CSR_TCONTROL 0x7a5
 #define CSR_DCSR 0x7b0
 #define CSR_DPC 0x7b1
 #define CSR_DSCRATCH 0x7b2
@@ -432,5 +434,6 @@
 #define CSR_HAZARD3_MEINEXT    0xbe4
 #define CSR_HAZARD3_MEICONTEXT 0xbe5
 #define CSR_HAZARD3_MSLEEP     0xbf0
+#define CSR_HAZARD3_DMDATA0    0xbff
 
 #endif
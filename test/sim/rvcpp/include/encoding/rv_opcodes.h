@@ -245,6 +245,12 @@
 #define RVOPC_H3_BEXTMI_BITS   0b00000000000000000100000000001011 // custom-0 funct3=4
 #define RVOPC_H3_BEXTMI_MASK   0b11100010000000000111000001111111
 
+// Xh3power (Hazard3 power management hints): sleep until unblocked, and unblock
+#define RVOPC_H3_BLOCK_BITS    0b00000000000000000010000000110011 // slt x0, x0, x0
+#define RVOPC_H3_BLOCK_MASK    0b11111111111111111111111111111111
+#define RVOPC_H3_UNBLOCK_BITS  0b00000000000100000010000000110011 // slt x0, x0, x1
+#define RVOPC_H3_UNBLOCK_MASK  0b11111111111111111111111111111111
+
 // C Extension
 #define RVOPC_ILLEGAL16_BITS   0b0000000000000000
 #define RVOPC_ILLEGAL16_MASK   0b1111111111111111
@@ -339,7 +345,7 @@
 #define _RVOPC_MATCH(x, instr_mask, instr_bits) (((x) & (instr_mask)) == (instr_bits))
 #define RVOPC_MATCH(x, instr) _RVOPC_MATCH(x, RVOPC_ ## instr ## _MASK, RVOPC_ ## instr ## _BITS)
 
-static const char *friendly_reg_names[32] = {
+static const char *const friendly_reg_names[32] = {
 	"x0", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0", "a1", "a2",
 	"a3", "a4", "a5", "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9",
 	"s10", "s11", "t3", "t4", "t5", "t6"
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "rv_types.h"
+#include "rv_elf.h"
+
+// Shadow call stack, used to attribute instruction and cycle counts to call
+// paths rather than to flat PCs.
+//
+// - Calls are jal/jalr/c.jal/c.jalr which link to ra or t0 (the two link
+//   registers recognised by the RISC-V return address stack hints).
+// - Returns are jalr x0/c.jr through ra or t0, and cm.popret/cm.popretz. A
+//   return pops back to the frame whose return address matches the target,
+//   so frames which are skipped (e.g. longjmp) are unwound too. Returns which
+//   don't match any frame leave the stack unchanged.
+// - Plain jumps to the first instruction of a function symbol (STT_FUNC, or
+//   any global symbol) are treated as tail calls, and replace the current
+//   frame. This also covers vector table entries which jump to handlers.
+// - Traps push a pseudo-frame named after the trap cause, with the handler
+//   entry point as its child. mret pops everything down to and including the
+//   most recent trap pseudo-frame.
+//
+// Each distinct call path is a node in a tree. Counts are exclusive (self)
+// counts; inclusive counts are summed over subtrees when reporting.
+
+struct RVCallGraph {
+	// Node keys are function entry addresses, or TRAP_KEY | mcause for trap
+	// pseudo-frames
+	static const uint64_t TRAP_KEY = 1ull << 32;
+
+	struct Node {
+		uint32_t parent;
+		uint64_t key;
+		uint64_t instrs;
+		uint64_t cycles;
+		std::map<uint64_t, uint32_t> children;
+	};
+
+	struct Frame {
+		uint32_t node;
+		ux_t ret_addr;
+		bool is_trap;
+	};
+
+	const RVSymbolTable &symbols;
+	bool count_cycles;
+	std::vector<Node> nodes;
+	std::vector<Frame> stack;
+	uint64_t unmatched_returns;
+
+	RVCallGraph(const RVSymbolTable &symbols_, bool count_cycles_) : symbols(symbols_) {
+		count_cycles = count_cycles_;
+		unmatched_returns = 0;
+	}
+
+	// Call after each step of the core. `next_pc` is the core's PC after the
+	// step.
+	void step(ux_t pc, uint32_t instr, ux_t next_pc, uint cycles, bool sleeping,
+		std::optional<ux_t> trap_cause, bool mret);
+
+	// One line per call path, "outer;inner;innermost count", as consumed by
+	// flamegraph.pl, inferno and speedscope. Counts are cycles with the
+	// timing model enabled, otherwise instructions.
+	void write_folded(FILE *f) const;
+
+	void print_summary(FILE *f, uint top_n=20) const;
+
+private:
+	uint32_t get_child(uint32_t parent, uint64_t key);
+	std::string node_name(uint32_t node) const;
+	std::string node_path(uint32_t node) const;
+	uint64_t weight(const Node &n) const {
+		return count_cycles ? n.cycles : n.instrs;
+	}
+};
@@ -6,6 +6,38 @@
 #include "rv_csr.h"
 #include "rv_types.h"
 #include "rv_mem.h"
+#include "rv_timing.h"
+#include "rv_hpm.h"
+#include "rv_memstats.h"
+#include "rv_trace.h"
+#include "rv_flight_recorder.h"
+#include "rv_reverse.h"
+#include "rv_watch.h"
+
+// Summary of the most recent call to RVCore::step(), for the benefit of
+// instrumentation which lives outside of the core.
+struct RVStepInfo {
+	ux_t pc;
+	uint32_t instr;
+	uint cycles;
+	// Bitmap of HPM_EVENT_* raised by this step
+	uint32_t events;
+	// No instruction was executed, because the core is asleep in a WFI or
+	// h3.block, or halted in Debug Mode
+	bool sleeping;
+	// An exception or interrupt was entered (value is the new mcause)
+	std::optional<ux_t> trap_cause;
+	bool mret;
+	// Nonzero GPRs written by this step, in the order the core's uops write
+	// them. Only Zcmp instructions write more than one, and the last write is
+	// always from the final uop.
+	static const uint MAX_GPR_WRITES = 16;
+	uint n_gpr_writes;
+	struct {
+		uint reg;
+		ux_t data;
+	} gpr_writes[MAX_GPR_WRITES];
+};
 
 struct RVCore {
 	std::array<ux_t, 32> regs;
@@ -14,6 +46,10 @@ struct RVCore {
 	bool load_reserved;
 	MemBase32 &mem;
 	bool stalled_on_wfi;
+	bool stalled_on_block;
+	// Set by h3.unblock, cleared when an h3.block falls through or is woken.
+	// There is only one hart, so unblock is looped back to the same hart.
+	bool unblock_latch;
 
 	// A single flat RAM is handled as a special case, in addition to whatever
 	// is in `mem`, because this avoids virtual calls for the majority of
@@ -24,11 +60,45 @@ struct RVCore {
 	ux_t ram_base;
 	ux_t ram_top;
 
+	// Optional cycle timing model. When absent, every step is one cycle.
+	RVTiming *timing;
+
+	// Optional: count loads and stores per cache line
+	RVHeatmap *heatmap;
+
+	// Append disassembly to each instruction in the text trace
+	bool trace_disasm;
+
+	// Optional: binary trace of every step, alongside or instead of the
+	// text trace
+	RVTraceWriter *trace_writer;
+
+	// Optional: keep trace records for recent steps in memory
+	RVFlightRecorder *flight_recorder;
+
+	// Optional: undo log of RAM writes, for reverse execution
+	RVReverse *reverse;
+
+	// Optional: data watchpoints, checked on every load and store
+	RVWatchpoints *watch;
+
+	RVStepInfo step_info;
+
 	RVCore(MemBase32 &_mem, ux_t reset_vector, ux_t ram_base_, ux_t ram_size_) : mem(_mem) {
 		std::fill(std::begin(regs), std::end(regs), 0);
 		pc = reset_vector;
 		load_reserved = false;
 		stalled_on_wfi = false;
+		stalled_on_block = false;
+		unblock_latch = false;
+		timing = nullptr;
+		heatmap = nullptr;
+		trace_disasm = false;
+		trace_writer = nullptr;
+		flight_recorder = nullptr;
+		reverse = nullptr;
+		watch = nullptr;
+		step_info = {};
 		ram_base = ram_base_;
 		ram_top = ram_base_ + ram_size_;
 		ram = new ux_t[ram_size_ / sizeof(ux_t)];
@@ -62,19 +132,31 @@ struct RVCore {
 
 	// Functions to read/write memory from this hart's point of view
 	std::optional<uint8_t> r8(ux_t addr, uint permissions=0x1u) {
-		if (!(csr.get_pmp_xwr(addr) & permissions)) {
+		if (!(csr.get_pmp_xwr(addr) & permissions))
 			return {};
-		} else if (addr >= ram_base && addr < ram_top) {
-			return ram[(addr - ram_base) >> 2] >> 8 * (addr & 0x3) & 0xffu;
+		if (heatmap && !(permissions & 0x4u))
+			heatmap->read(addr);
+		std::optional<uint8_t> rdata;
+		if (addr >= ram_base && addr < ram_top) {
+			rdata = ram[(addr - ram_base) >> 2] >> 8 * (addr & 0x3) & 0xffu;
 		} else {
-			return mem.r8(addr);
+			rdata = mem.r8(addr);
 		}
+		if (watch && rdata && !(permissions & 0x4u))
+			watch->read(addr, 1, *rdata);
+		return rdata;
 	}
 
 	bool w8(ux_t addr, uint8_t data) {
-		if (!(csr.get_pmp_xwr(addr) & 0x2u)) {
+		if (!(csr.get_pmp_xwr(addr) & 0x2u))
 			return false;
-		} else if (addr >= ram_base && addr < ram_top) {
+		if (heatmap)
+			heatmap->write(addr);
+		if (watch)
+			watch->write(addr, 1, data);
+		if (addr >= ram_base && addr < ram_top) {
+			if (reverse)
+				reverse->ram_write(addr, 1);
 			ram[(addr - ram_base) >> 2] &= ~(0xffu << 8 * (addr & 0x3));
 			ram[(addr - ram_base) >> 2] |= (uint32_t)data << 8 * (addr & 0x3);
 			return true;
@@ -84,19 +166,31 @@ struct RVCore {
 	}
 
 	std::optional<uint16_t> r16(ux_t addr, uint permissions=0x1u) {
-		if (!(csr.get_pmp_xwr(addr) & permissions)) {
+		if (!(csr.get_pmp_xwr(addr) & permissions))
 			return {};
-		} else if (addr >= ram_base && addr < ram_top) {
-			return ram[(addr - ram_base) >> 2] >> 8 * (addr & 0x2) & 0xffffu;
+		if (heatmap && !(permissions & 0x4u))
+			heatmap->read(addr);
+		std::optional<uint16_t> rdata;
+		if (addr >= ram_base && addr < ram_top) {
+			rdata = ram[(addr - ram_base) >> 2] >> 8 * (addr & 0x2) & 0xffffu;
 		} else {
-			return mem.r16(addr);
+			rdata = mem.r16(addr);
 		}
+		if (watch && rdata && !(permissions & 0x4u))
+			watch->read(addr, 2, *rdata);
+		return rdata;
 	}
 
 	bool w16(ux_t addr, uint16_t data) {
-		if (!(csr.get_pmp_xwr(addr) & 0x2u)) {
+		if (!(csr.get_pmp_xwr(addr) & 0x2u))
 			return false;
-		} else if (addr >= ram_base && addr < ram_top) {
+		if (heatmap)
+			heatmap->write(addr);
+		if (watch)
+			watch->write(addr, 2, data);
+		if (addr >= ram_base && addr < ram_top) {
+			if (reverse)
+				reverse->ram_write(addr, 2);
 			ram[(addr - ram_base) >> 2] &= ~(0xffffu << 8 * (addr & 0x2));
 			ram[(addr - ram_base) >> 2] |= (uint32_t)data << 8 * (addr & 0x2);
 			return true;
@@ -106,19 +200,31 @@ struct RVCore {
 	}
 
 	std::optional<uint32_t> r32(ux_t addr, uint permissions=0x1u) {
-		if (!(csr.get_pmp_xwr(addr) & permissions)) {
+		if (!(csr.get_pmp_xwr(addr) & permissions))
 			return {};
-		} else if (addr >= ram_base && addr < ram_top) {
-			return ram[(addr - ram_base) >> 2];
+		if (heatmap && !(permissions & 0x4u))
+			heatmap->read(addr);
+		std::optional<uint32_t> rdata;
+		if (addr >= ram_base && addr < ram_top) {
+			rdata = ram[(addr - ram_base) >> 2];
 		} else {
-			return mem.r32(addr);
+			rdata = mem.r32(addr);
 		}
+		if (watch && rdata && !(permissions & 0x4u))
+			watch->read(addr, 4, *rdata);
+		return rdata;
 	}
 
 	bool w32(ux_t addr, uint32_t data) {
-		if (!(csr.get_pmp_xwr(addr) & 0x2u)) {
+		if (!(csr.get_pmp_xwr(addr) & 0x2u))
 			return false;
-		} else if (addr >= ram_base && addr < ram_top) {
+		if (heatmap)
+			heatmap->write(addr);
+		if (watch)
+			watch->write(addr, 4, data);
+		if (addr >= ram_base && addr < ram_top) {
+			if (reverse)
+				reverse->ram_write(addr, 4);
 			ram[(addr - ram_base) >> 2] = data;
 			return true;
 		} else {
@@ -126,6 +232,35 @@ struct RVCore {
 		}
 	}
 
-	// Fetch and execute one instruction from memory.
-	void step(bool trace=false);
+	void record_gpr_write(uint reg, ux_t data) {
+		if (reg != 0 && step_info.n_gpr_writes < RVStepInfo::MAX_GPR_WRITES)
+			step_info.gpr_writes[step_info.n_gpr_writes++] = {reg, data};
+	}
+
+	// Save or restore architectural state, including RAM but not the
+	// devices in `mem`
+	void serialise(RVSnapshotIO &io);
+
+	// Fetch and execute one instruction from memory. Returns the number of
+	// cycles taken.
+	uint step(bool trace=false);
+
+	// Leave Debug Mode, as on a resume request from the Debug Module, and
+	// continue from dpc
+	void debug_resume() {
+		pc = csr.exit_debug_mode();
+	}
 };
+
+// Step the core together with the testbench IO: the same sequence as the
+// main loop in main.cpp, without any of the optional models. Used when
+// re-running or forking a simulation. Returns the number of cycles taken.
+static inline uint rv_step_with_io(RVCore &core, TBMemIO &io) {
+	uint cycles = core.step(false);
+	io.step(cycles);
+	core.csr.set_irq_t(io.timer_irq_pending());
+	core.csr.set_irq_s(io.soft_irq_pending());
+	for (uint i = 0; i < TBMemIO::IRQ_WORDS; ++i)
+		core.csr.set_irq_e(i, io.irq[i]);
+	return cycles;
+}
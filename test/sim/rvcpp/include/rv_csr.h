@@ -1,16 +1,27 @@
 #pragma once
 #include <optional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 #include "rv_types.h"
+#include "rv_irq_ctrl.h"
+#include "rv_hpm.h"
+
+struct RVSnapshotIO;
 
 class RVCSR {
 
 	static const int PMP_REGIONS = 16;
 	static const int IMPLEMENTED_PMP_REGIONS = 4;
+	// tselect is 2 bits wide, so always selects an implemented trigger
+	static const int BREAKPOINT_TRIGGERS = 4;
 
 	// Latched IRQ signals into core
 	bool irq_t;
 	bool irq_s;
-	bool irq_e;
+
+	// External IRQs go through the Xh3irq controller to generate mip.meip
+	RVIRQCtrl irq_ctrl;
 
 	// Current core privilege level (M/S/U)
 	uint priv;
@@ -20,6 +31,13 @@ class RVCSR {
 	ux_t minstret;
 	ux_t minstreth;
 	ux_t mcountinhibit;
+	uint64_t mhpmcounter[N_HPM_COUNTERS];
+	ux_t mhpmevent[N_HPM_COUNTERS];
+	// Derived from mhpmevent and mcountinhibit by update_hpm_counting(): for
+	// each event, a bitmap of the counters which count it (bit i for
+	// mhpmcounter(i + 3)), and the set of events with any counter at all
+	uint32_t hpm_event_counters[N_HPM_EVENTS];
+	uint32_t hpm_counted_events;
 	ux_t mstatus;
 	ux_t mie;
 	ux_t mip;
@@ -32,10 +50,48 @@ class RVCSR {
 	ux_t pmpaddr[PMP_REGIONS];
 	ux_t pmpcfg[PMP_REGIONS / 4];
 
+	// Debug mode: the core is halted, and only an external debugger can
+	// access it. dcsr.prv is not stored, as it is the current `priv`.
+	bool debug_mode;
+	bool dcsr_ebreakm;
+	bool dcsr_ebreaku;
+	bool dcsr_step;
+	uint dcsr_cause;
+	ux_t dpc;
+	ux_t dmdata0;
+
+	// Trigger module: instruction address match (type=2, execute=1) only,
+	// exact match, before execution
+	struct Trigger {
+		bool dmode;
+		bool action;
+		bool m;
+		bool u;
+		bool execute;
+		ux_t tdata2;
+	};
+	Trigger triggers[BREAKPOINT_TRIGGERS];
+	uint tselect;
+	bool tcontrol_mte;
+	bool tcontrol_mpte;
+
+	// Address of every trigger which can currently fire, so that the check
+	// on each instruction is a single lookup. Rebuilt when the triggers are
+	// written.
+	std::unordered_set<ux_t> trigger_addrs;
+
+	void update_trigger_addrs();
+	uint check_triggers_slow(ux_t pc);
+	ux_t get_tdata1(uint i);
+
 	std::optional<ux_t> pending_write_addr;
 	ux_t pending_write_data;
+	// Some Hazard3 custom CSRs also use the raw (pre-set/clear) write data
+	ux_t pending_write_raw;
+	bool pending_write_clearts;
 
-	ux_t get_effective_xip();
+	void apply_pending_write();
+	void update_hpm_counting();
 
 	// Internal interface for updating trap state. Returns trap target pc.
 	ux_t trap_enter(uint xcause, ux_t xepc);
@@ -66,13 +122,19 @@ public:
 	RVCSR() {
 		irq_t = false;
 		irq_s = false;
-		irq_e = false;
 		priv = 3;
 		mcycle = 0;
 		mcycleh = 0;
 		minstret = 0;
 		minstreth = 0;
 		mcountinhibit = 0x5;
+		for (uint i = 0; i < N_HPM_COUNTERS; ++i) {
+			mhpmcounter[i] = 0;
+			mhpmevent[i] = 0;
+		}
+		for (uint i = 0; i < N_HPM_EVENTS; ++i)
+			hpm_event_counters[i] = 0;
+		hpm_counted_events = 0;
 		mstatus = 0;
 		mie = 0;
 		mip = 0;
@@ -82,22 +144,60 @@ public:
 		mcause = 0;
 		hazard3_msleep = 0;
 		pending_write_addr = {};
+		pending_write_raw = 0;
+		pending_write_clearts = false;
 		for (int i = 0; i < PMP_REGIONS; ++i) {
 			pmpaddr[i] = 0;
 		}
 		for (int i = 0; i < PMP_REGIONS / 4; ++i) {
 			pmpcfg[i] = 0;
 		}
+		debug_mode = false;
+		dcsr_ebreakm = false;
+		dcsr_ebreaku = false;
+		dcsr_step = false;
+		dcsr_cause = 0;
+		dpc = 0;
+		dmdata0 = 0;
+		for (int i = 0; i < BREAKPOINT_TRIGGERS; ++i) {
+			triggers[i] = {};
+		}
+		tselect = 0;
+		tcontrol_mte = false;
+		tcontrol_mpte = false;
 	}
 
-	void step();
+	// Save or restore all CSR state, including pending writes
+	void serialise(RVSnapshotIO &io);
 
-	// Returns None on permission/decode fail
-	std::optional<ux_t> read(uint16_t addr, bool side_effect=true);
+	// Advance counters by one instruction, which took `cycles` cycles and
+	// raised `events` (bitmap of HPM_EVENT_*), and apply any pending CSR
+	// write.
+	void step(uint cycles=1, uint32_t events=0);
+
+	// Returns None on permission/decode fail. `wdata_raw` and `op` describe the
+	// write performed by the same CSR instruction, if any, as some Hazard3
+	// custom CSRs use this to select which data is read.
+	std::optional<ux_t> read(uint16_t addr, bool side_effect=true, ux_t wdata_raw=0, uint op=WRITE);
 
 	// Returns false on permission/decode fail
 	bool write(uint16_t addr, ux_t data, uint op=WRITE);
 
+	// Access a CSR from outside of instruction execution (e.g. fault
+	// injection, or a debugger), with M-mode and Debug Mode permissions and
+	// without side effects. Writes take effect immediately. Returns
+	// None/false if there is no such CSR.
+	std::optional<ux_t> peek(uint16_t addr);
+	bool poke(uint16_t addr, ux_t data);
+
+	// A sequence of CSR writes (address, data) made from Debug Mode, which
+	// takes a core fresh out of reset to the current architectural CSR
+	// state, e.g. to hand off to the RTL via the Debug Module. Privilege
+	// level and the debug CSRs are not included. The Xh3irq
+	// windowed CSRs appear once per window, with the window index in the
+	// write data.
+	std::vector<std::pair<uint16_t, ux_t>> get_restore_writes();
+
 	// Determine target privilege level of an exception, update trap state
 	// (including change of privilege level), return trap target PC
 	ux_t trap_enter_exception(uint xcause, ux_t xepc);
@@ -110,12 +210,72 @@ public:
 	// Update trap state, return mepc:
 	ux_t trap_mret();
 
+	enum {
+		TRIGGER_NONE = 0,
+		TRIGGER_BREAK_M = 1,
+		TRIGGER_BREAK_D = 2
+	};
+
+	// Check the breakpoint triggers against the address of the instruction
+	// about to execute. Returns TRIGGER_BREAK_M for an ebreak exception,
+	// TRIGGER_BREAK_D to enter Debug Mode instead of executing.
+	uint check_triggers(ux_t pc) {
+		if (trigger_addrs.empty() || !trigger_addrs.count(pc))
+			return TRIGGER_NONE;
+		return check_triggers_slow(pc);
+	}
+
+	// Halt, with dpc set to the instruction to resume at, and dcsr.cause
+	// set to `cause` (DCSR_CAUSE_*)
+	void enter_debug_mode(uint cause, ux_t resume_pc);
+
+	// Resume from a halt, as on a Debug Module resume request. Returns dpc.
+	ux_t exit_debug_mode();
+
+	bool get_debug_mode() {
+		return debug_mode;
+	}
+
+	uint get_dcsr_cause() {
+		return dcsr_cause;
+	}
+
+	// Halt after every instruction or trap entry, with IRQs disabled
+	bool get_dcsr_step() {
+		return dcsr_step;
+	}
+
+	// ebreak enters Debug Mode, instead of taking an exception
+	bool get_ebreak_to_debug();
+
 	uint get_true_priv() {
 		return priv;
 	}
 
 	uint get_effective_priv();
 
+	// mip, including the current state of the IRQ inputs
+	ux_t get_effective_xip();
+
+	// Wakeup condition for WFI: any IRQ which is individually enabled in mie
+	// is pending, regardless of mstatus.mie. Single-stepping also wakes.
+	bool get_wfi_wakeup_req() {
+		return (get_effective_xip() & mie) || dcsr_step;
+	}
+
+	ux_t get_msleep() {
+		return hazard3_msleep;
+	}
+
+	// Counter i is mhpmcounter(i + 3)
+	uint64_t get_hpm_counter(uint i) {
+		return mhpmcounter[i];
+	}
+
+	ux_t get_hpm_event(uint i) {
+		return mhpmevent[i];
+	}
+
 	bool get_mstatus_tw() {
 		return mstatus & 0x00200000u;
 	}
@@ -128,8 +288,13 @@ public:
 		irq_s = irq;
 	}
 
-	void set_irq_e(bool irq) {
-		irq_e = irq;
+	// Set external IRQ inputs 32 * word through 32 * word + 31
+	void set_irq_e(uint word, uint32_t irqs) {
+		irq_ctrl.set_irq_inputs(word, irqs);
+	}
+
+	void set_num_irqs(uint num_irqs) {
+		irq_ctrl.reset(num_irqs);
 	}
 
 	ux_t get_xcause() {
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "rv_types.h"
+
+// Minimal reader for the symbol table of a little-endian ELF32 file, used to
+// attribute PCs to functions in profiles and traces. Only code-like symbols
+// are kept (functions, and untyped labels such as those from assembly
+// files), sorted by address.
+
+struct RVSymbolTable {
+	struct Symbol {
+		ux_t addr;
+		ux_t size;
+		std::string name;
+		// STT_FUNC, or a global label: likely the entry point of a function,
+		// rather than a local label within one
+		bool is_entry;
+	};
+
+	std::vector<Symbol> symbols;
+
+	// Returns false, with an error message on stderr, if the file could not
+	// be read or has no symbol table.
+	bool load(const std::string &path);
+
+	bool empty() const {
+		return symbols.empty();
+	}
+
+	// Symbol with the highest address <= addr, or nullptr if there is no such
+	// symbol, or if addr is past the end of a symbol with a nonzero size.
+	const Symbol *lookup(ux_t addr) const;
+
+	// "name+0x1c" or "0000101c" if there is no matching symbol
+	std::string format_addr(ux_t addr) const;
+
+	// Symbol with this exact name, or nullptr
+	const Symbol *find(const std::string &name) const;
+
+	// Parse a command-line address, which is either a number or a symbol
+	// name. Returns false if it is neither.
+	bool resolve(const std::string &s, ux_t &addr) const;
+};
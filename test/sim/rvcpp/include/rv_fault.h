@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rv_types.h"
+
+struct RVCore;
+struct TBMemIO;
+
+// Fault injection campaign. The simulation runs to the injection point, then
+// a golden run from there records the expected exit code, console output and
+// sequence of exceptions. Each injection is a fork() of the simulation at the
+// injection point (so memory is shared copy-on-write), which runs a random
+// number of steps within the injection window, injects one fault, and runs
+// to completion. Up to `jobs` children run at once.
+//
+// Outcomes, in order of precedence:
+//   detected: an exception was taken which the golden run did not take (the
+//             child stops there)
+//   hang:     no exit within twice the golden run's steps, plus 10000
+//   masked:   exit code and output match the golden run
+//   sdc:      silent data corruption, i.e. the run exited normally but with a
+//             different exit code or output
+//   error:    the child died without reporting (e.g. a simulator assertion)
+
+struct RVFault {
+	enum Type {
+		GPR,
+		RAM,
+		SKIP,
+		CSR,
+		N_TYPES
+	};
+
+	Type type;
+	// Steps to run past the injection point before injecting
+	uint64_t delay;
+	uint reg;
+	ux_t addr;
+	uint bit;
+	uint16_t csr;
+
+	std::string describe() const;
+};
+
+struct RVFaultCampaign {
+	enum Outcome {
+		MASKED,
+		DETECTED,
+		HANG,
+		SDC,
+		ERROR,
+		N_OUTCOMES
+	};
+
+	// Reported by each child through a pipe
+	struct Result {
+		uint32_t outcome;
+		// Exception cause (detected) or exit code (masked/sdc)
+		uint32_t detail;
+		uint64_t steps;
+	};
+
+	RVCore &core;
+	TBMemIO &io;
+
+	uint64_t count;
+	uint64_t window;
+	uint jobs;
+	uint32_t types;
+	std::mt19937_64 rng;
+	// RAM faults are confined to these ranges. Default is every 4 KiB page of
+	// RAM which is nonzero at the injection point.
+	std::vector<std::pair<ux_t, ux_t>> ram_ranges;
+	FILE *log;
+
+	// Golden run, from the injection point
+	uint64_t golden_steps;
+	uint32_t golden_exit_code;
+	std::string golden_output;
+	std::vector<ux_t> golden_exceptions;
+
+	uint64_t outcomes[RVFault::N_TYPES][N_OUTCOMES];
+
+	RVFaultCampaign(RVCore &core_, TBMemIO &io_);
+
+	// Parse a comma-separated list of gpr, ram, skip, csr. Returns false if
+	// invalid.
+	bool set_types(const std::string &list);
+
+	// Run `at` steps to reach the injection point, then the golden run, then
+	// all of the injections. The golden run must exit within max_steps.
+	// Prints a summary to stderr. Returns 0 on success.
+	int run(uint64_t at, uint64_t max_steps);
+
+	void print_summary(FILE *f);
+
+private:
+	RVFault random_fault();
+	void inject(const RVFault &fault);
+	Result simulate(const RVFault *fault, uint64_t max_steps, std::string &output,
+		std::vector<ux_t> *exceptions);
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "rv_types.h"
+#include "rv_elf.h"
+#include "rv_trace.h"
+
+// Flight recorder: keeps the trace records for the most recent steps in a
+// ring buffer, and prints them (in the --trace format) when one of the
+// chosen trigger conditions occurs. Consecutive identical jump-to-self steps
+// (sleeping in WFI, or spinning on "j .") are collapsed into one entry, so a
+// long idle period doesn't flush out the interesting part of the history.
+//
+// The buffer is emptied by each dump, so a later dump only shows the steps
+// since the previous one.
+
+struct RVFlightRecorder {
+	static const uint MAX_DUMPS = 16;
+
+	struct Entry {
+		RVTraceRecord rec;
+		uint64_t repeats;
+	};
+
+	std::vector<Entry> ring;
+	size_t head;
+	size_t count;
+
+	// Triggers
+	bool on_any_exception;
+	std::vector<uint> on_exception_causes;
+	bool on_irq;
+	bool on_exit;
+	bool on_timeout;
+	bool on_watch;
+	std::vector<ux_t> on_pcs;
+
+	FILE *out;
+	const RVSymbolTable &symbols;
+	uint dumps;
+
+	RVFlightRecorder(size_t depth, FILE *out_, const RVSymbolTable &symbols_): symbols(symbols_) {
+		ring.resize(depth);
+		head = 0;
+		count = 0;
+		on_any_exception = false;
+		on_irq = false;
+		on_exit = false;
+		on_timeout = false;
+		on_watch = false;
+		out = out_;
+		dumps = 0;
+	}
+
+	// Parse a --flight-trigger argument: exception, exception=<cause>, irq,
+	// exit, timeout, watch, or pc=<address or symbol>. Returns false if
+	// invalid.
+	bool add_trigger(const std::string &spec);
+
+	bool has_triggers() const {
+		return on_any_exception || !on_exception_causes.empty() || on_irq || on_exit ||
+			on_timeout || on_watch || !on_pcs.empty();
+	}
+
+	// Called by the core for each traced step
+	inline void push(const RVTraceRecord &r) {
+		if (count) {
+			Entry &last = ring[(head + ring.size() - 1) % ring.size()];
+			if (is_self_loop(r) && is_self_loop(last.rec) && last.rec.pc == r.pc &&
+					last.rec.instr == r.instr) {
+				++last.repeats;
+				return;
+			}
+		}
+		ring[head] = {r, 0};
+		head = (head + 1) % ring.size();
+		if (count < ring.size())
+			++count;
+	}
+
+	// Check the trap and PC triggers after each step, with the RVStepInfo
+	// fields
+	void step(ux_t pc, bool sleeping, std::optional<ux_t> trap_cause);
+
+	// Exit, timeout and watchpoint triggers
+	void exited(ux_t exit_code, ux_t pc);
+	void timed_out(int64_t cycles);
+	void watch_hit(const std::string &what);
+
+	void dump(const std::string &reason);
+
+private:
+	static bool is_self_loop(const RVTraceRecord &r) {
+		return r.pc_wdata && *r.pc_wdata == r.pc && !r.rd && !r.csr_addr && !r.trap_cause;
+	}
+};
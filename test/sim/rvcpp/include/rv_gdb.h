@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <unordered_set>
+
+#include "rv_types.h"
+#include "rv_watch.h"
+
+struct RVCore;
+struct TBMemIO;
+
+// GDB remote serial protocol stub, so firmware can be debugged at
+// interpreter speed. Listens on a TCP port on localhost, or a Unix domain
+// socket, and runs the simulation under the debugger's control until the
+// CPU exits or the debugger kills it.
+//
+// Supported: general and CSR register read/write (CSRs are GDB registers
+// 65 + CSR address), memory read/write, step, continue, interrupt (Ctrl-C),
+// software and hardware breakpoints, and write/read/access watchpoints.
+//
+// Breakpoints are a set of addresses checked before each instruction, so
+// memory is never patched with ebreak. Watchpoints are checked by RVCore
+// on each load and store (rv_watch.h), and stop the run after the
+// accessing instruction completes.
+//
+// All stop points are at step boundaries. The first step of a continue or
+// step does not check breakpoints, so that it can move off a breakpoint.
+//
+// The core entering Debug Mode (ebreak with dcsr.ebreakm/u set, a trigger
+// with action=1, or dcsr.step) also stops, and the next continue or step
+// resumes it from dpc.
+//
+// The cycle limit applies to the whole session, including any run to
+// completion after GDB detaches. Reaching it ends the session, reported to
+// GDB as the program terminating with SIGALRM.
+
+struct RVGDBServer {
+	static const uint GDB_REG_PC = 32;
+	static const uint GDB_REG_CSR0 = 65;
+
+	RVCore &core;
+	TBMemIO &io;
+	RVWatchpoints watch;
+	// Z0 and Z1 breakpoints, which are otherwise the same, but are reported
+	// differently
+	std::unordered_set<ux_t> sw_breakpoints;
+	std::unordered_set<ux_t> hw_breakpoints;
+
+	// Steps the core and everything attached to it, returning the cycle count
+	std::function<uint()> step;
+	uint64_t max_cycles;
+	uint64_t cycles;
+
+	int listen_fd;
+	int fd;
+	bool no_ack;
+	std::string unix_path;
+	// Set when the CPU exits
+	std::optional<int> exit_code;
+	// Set when the cycle limit is reached
+	bool timed_out;
+
+	RVGDBServer(RVCore &core_, TBMemIO &io_, std::function<uint()> step_, uint64_t max_cycles_);
+	~RVGDBServer();
+
+	// `spec` is a TCP port number, or otherwise a Unix socket path. Returns
+	// false, with a message on stderr, on failure.
+	bool listen(const std::string &spec);
+
+	// Wait for GDB to connect, then serve it until the CPU exits or reaches
+	// the cycle limit, GDB kills the target or disconnects, or GDB detaches
+	// and the CPU then exits or reaches the cycle limit.
+	// Returns false if GDB could not connect.
+	bool run();
+
+private:
+	enum Stop {
+		STOP_STEP,
+		STOP_BREAKPOINT,
+		STOP_WATCHPOINT,
+		STOP_INTERRUPT,
+		STOP_DEBUG_HALT,
+		STOP_EXIT,
+		STOP_TIMEOUT
+	};
+
+	bool get_packet(std::string &packet);
+	bool put_packet(const std::string &data);
+	bool interrupt_pending();
+
+	// Run until a stop. Sets exit_code if the CPU exits, and timed_out if it
+	// reaches the cycle limit.
+	Stop resume(bool single_step);
+	// Set by resume() on STOP_BREAKPOINT
+	bool hit_hw_breakpoint;
+	std::string stop_reply(Stop stop);
+
+	std::optional<uint8_t> read_mem(ux_t addr);
+	bool write_mem(ux_t addr, uint8_t data);
+	std::optional<ux_t> read_reg(uint regnum);
+	bool write_reg(uint regnum, ux_t data);
+
+	// Returns the reply, or std::nullopt if there is nothing (more) to send.
+	// Sets `finished` when the session ends.
+	std::optional<std::string> handle(const std::string &packet, bool &finished);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "rv_types.h"
+
+class RVCSR;
+
+// Performance monitor events, selected by writing the event number to one of
+// mhpmevent3..31. The numbering is specific to rvcpp (the Hazard3 RTL
+// hardwires these counters to zero). Each step of the core raises a bitmap of
+// the events which occurred, with at most one occurrence of each event per
+// instruction.
+
+// mhpmcounter3..31
+static const uint N_HPM_COUNTERS = 29;
+
+enum {
+	HPM_EVENT_NONE         = 0,
+	HPM_EVENT_LOAD         = 1,  // Load instructions retired (incl. lr, cm.pop*)
+	HPM_EVENT_STORE        = 2,  // Store instructions retired (incl. sc, cm.push)
+	HPM_EVENT_BRANCH       = 3,  // Conditional branches retired
+	HPM_EVENT_BRANCH_TAKEN = 4,  // Conditional branches retired, taken
+	HPM_EVENT_MISPREDICT   = 5,  // Branch mispredicts (requires timing model)
+	HPM_EVENT_LOAD_USE     = 6,  // Load-use stall cycles (requires timing model)
+	HPM_EVENT_DIV          = 7,  // div/divu/rem/remu retired
+	HPM_EVENT_COMPRESSED   = 8,  // 16-bit instructions retired
+	HPM_EVENT_TRAP         = 9,  // Exceptions and interrupts taken
+	N_HPM_EVENTS
+};
+
+extern const char *const hpm_event_names[N_HPM_EVENTS];
+
+// Events raised by retiring `instr`, other than those which depend on the
+// timing model. `taken` is true if the instruction redirected the PC.
+uint32_t hpm_instr_events(uint32_t instr, bool taken);
+
+// Host-side totals of every event, independent of how firmware has programmed
+// the counters. Used for the --counters summary, which also lists the
+// counters firmware has programmed.
+struct RVHPMTotals {
+	uint64_t count[N_HPM_EVENTS];
+
+	RVHPMTotals() {
+		for (uint i = 0; i < N_HPM_EVENTS; ++i)
+			count[i] = 0;
+	}
+
+	void add(uint32_t events) {
+		for (uint i = 1; events >> i; ++i)
+			count[i] += (events >> i) & 1u;
+	}
+
+	void print_summary(FILE *f, bool timing_enabled, RVCSR &csr) const;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+#include "rv_types.h"
+#include "rv_elf.h"
+
+// Dynamic instruction mix and code density statistics. Retired instructions
+// are counted per encoding (a dense table for 16-bit encodings, a hash map
+// for 32-bit ones) and classified by mnemonic and extension only at exit.
+// Fetched bytes are also counted per PC in the loaded image, and folded by
+// function to show where fetch bandwidth goes.
+//
+// Zcmp savings are estimated against the shortest RV32C sequence with the
+// same effect: one c.swsp/c.lwsp per register, plus c.addi16sp for the stack
+// adjustment, plus c.jr for cm.popret, plus c.li and c.jr for cm.popretz,
+// and two c.mv for cm.mvsa01/cm.mva01s.
+
+struct RVInstrMix {
+	std::vector<uint64_t> count16;
+	std::unordered_map<uint32_t, uint64_t> count32;
+
+	ux_t base;
+	uint32_t n_halfwords;
+	std::vector<uint64_t> fetch_bytes;
+	uint64_t other_fetch_bytes;
+
+	// Count fetches in the address range [base_, base_ + size)
+	RVInstrMix(ux_t base_, uint32_t size) {
+		count16.resize(1u << 16);
+		base = base_;
+		n_halfwords = (size + 1) / 2;
+		fetch_bytes.resize(n_halfwords);
+		other_fetch_bytes = 0;
+	}
+
+	// Call after each step of the core, with the RVStepInfo fields
+	inline void step(ux_t pc, uint32_t instr, bool sleeping, bool trap) {
+		if (sleeping || trap)
+			return;
+		uint size;
+		if ((instr & 0x3) == 0x3) {
+			++count32[instr];
+			size = 4;
+		} else {
+			++count16[instr & 0xffffu];
+			size = 2;
+		}
+		uint32_t i = (pc - base) >> 1;
+		if (i < n_halfwords)
+			fetch_bytes[i] += size;
+		else
+			other_fetch_bytes += size;
+	}
+
+	void print_summary(FILE *f, const RVSymbolTable &symbols, uint top_n=30) const;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include "rv_types.h"
+
+struct RVSnapshotIO;
+
+// Model of the Xh3irq external interrupt controller (hazard3_irq_ctrl.v),
+// which sits behind the meiea/meipa/meifa/meipra/meinext/meicontext CSRs and
+// generates mip.meip.
+//
+// The pending/enabled state is kept as bitsets, with one bitset per priority
+// level ("bucket") containing the IRQs which are pending, enabled and at that
+// priority, plus a summary of which words of each bucket are nonempty, and
+// which buckets are nonempty. These are updated incrementally whenever an
+// input, enable, force or priority changes, so that finding the
+// highest-priority lowest-numbered active IRQ (meinext, and mip.meip) is a
+// couple of bit scans, independent of the number of IRQs.
+
+struct RVIRQCtrl {
+	static const uint MAX_IRQS = 512;
+	static const uint N_WORDS = MAX_IRQS / 32;
+	// Matches IRQ_PRIORITY_BITS in the tb_cxxrtl configuration
+	static const uint PRIORITY_BITS = 4;
+	static const uint N_PRIORITIES = 16;
+	static const uint PRIORITY_MASK = (0xfu << (4 - PRIORITY_BITS)) & 0xfu;
+
+	uint num_irqs;
+	uint32_t impl_mask[N_WORDS];
+
+	// IRQ inputs are registered before use (IRQ_INPUT_BYPASS = 0), so a new
+	// input value is visible one step after it is set.
+	uint32_t irq_in_next[N_WORDS];
+	bool irq_in_changed;
+	uint32_t irq_in[N_WORDS];
+	uint32_t meiea[N_WORDS];
+	uint32_t meifa[N_WORDS];
+	uint8_t meipra[MAX_IRQS];
+
+	// Bit set for each implemented IRQ at priority p
+	uint32_t pri_bucket[N_PRIORITIES][N_WORDS];
+	// Bit set for each IRQ at priority p which is pending and enabled
+	uint32_t active[N_PRIORITIES][N_WORDS];
+	// Bit w set when active[p][w] is nonzero
+	uint32_t active_words[N_PRIORITIES];
+	// Bit p set when active_words[p] is nonzero
+	uint32_t active_pri;
+
+	uint meicontext_pppreempt;
+	uint meicontext_ppreempt;
+	uint meicontext_preempt;
+	bool meicontext_noirq;
+	uint meicontext_irq;
+	bool meicontext_mreteirq;
+
+	// meifa bit cleared by an meinext read, applied at the end of the step
+	std::optional<uint> pending_meifa_clear;
+
+	struct NextIRQ {
+		bool noirq;
+		uint irq;
+		uint priority;
+	};
+
+	RVIRQCtrl(uint num_irqs_=32) {
+		reset(num_irqs_);
+	}
+
+	void reset(uint num_irqs_);
+
+	void serialise(RVSnapshotIO &io);
+
+	// Update one word of the external IRQ inputs
+	void set_irq_inputs(uint word, uint32_t irqs) {
+		irqs &= impl_mask[word];
+		if (irqs != irq_in_next[word]) {
+			irq_in_next[word] = irqs;
+			irq_in_changed = true;
+		}
+	}
+
+	// mip.meip
+	bool pending() const {
+		return meicontext_preempt < N_PRIORITIES && (active_pri >> meicontext_preempt) != 0;
+	}
+
+	// Highest-priority active IRQ at or above meicontext.ppreempt. Ties go to
+	// the lowest-numbered IRQ.
+	NextIRQ get_next() const;
+
+	// Returns None for addresses which are not part of the controller. Array
+	// CSRs are indexed using the raw write data of the same CSR instruction.
+	std::optional<ux_t> read(uint16_t addr, ux_t wdata_raw, bool side_effect);
+
+	// Apply a CSR write (called from RVCSR::step())
+	void write(uint16_t addr, ux_t wdata, ux_t wdata_raw);
+
+	// Apply side effects of reads in the step which just finished, and
+	// clock in the IRQ inputs
+	void step();
+
+	// Priority save on entering the external IRQ vector, and priority
+	// restore on mret if meicontext.mreteirq is set.
+	void trap_enter(bool is_eirq);
+	void trap_mret();
+
+private:
+	void update_word(uint word);
+	void set_priority(uint irq, uint priority);
+	uint preempt_level_next(const NextIRQ &next) const;
+};
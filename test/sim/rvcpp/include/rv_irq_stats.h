@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "rv_types.h"
+
+// Interrupt latency instrumentation. For each M-mode interrupt cause (soft,
+// timer, external) this records:
+//
+// - Latency: from the cycle the IRQ source was asserted, to the cycle at
+//   which the core has entered the trap handler
+// - Handler duration: from trap entry to completion of the matching mret
+//
+// Times are in modelled cycles when the timing model is enabled, otherwise
+// each step of the core counts as one cycle.
+//
+// An IRQ which is still asserted when it is taken (e.g. a level-sensitive
+// source the handler has not yet cleared) is re-armed, so that taking it
+// again without a new rising edge is still counted. Its assertion time is
+// the trap entry, and then the mret which makes it takeable again.
+
+struct RVIRQStats {
+	// Covers the standard IRQs in mip. Cause is mcause without the IRQ bit.
+	static const uint N_CAUSES = 16;
+	static const uint N_BUCKETS = 32;
+	// Frames beyond this depth are assumed abandoned (a handler which left
+	// without mret, e.g. a context switch), and the oldest is discarded.
+	static const uint MAX_TRAP_DEPTH = 64;
+
+	// Power-of-two histogram. Bucket 0 counts zeroes, bucket i > 0 counts
+	// values in the range [2^(i - 1), 2^i).
+	struct Histogram {
+		uint64_t count;
+		uint64_t sum;
+		uint64_t min;
+		uint64_t max;
+		uint64_t buckets[N_BUCKETS];
+
+		void add(uint64_t x);
+		void print(FILE *f, const char *name) const;
+	};
+
+	struct TrapFrame {
+		bool is_irq;
+		uint cause;
+		uint64_t entry_time;
+	};
+
+	ux_t prev_xip;
+	uint64_t prev_time;
+	bool assert_pending[N_CAUSES];
+	uint64_t assert_time[N_CAUSES];
+	// Still asserted when last taken, with no edge since
+	bool rearmed[N_CAUSES];
+
+	// Traps which have been entered but not yet returned from (including
+	// exceptions, so that mret can be paired correctly)
+	std::vector<TrapFrame> trap_stack;
+
+	Histogram latency[N_CAUSES];
+	Histogram duration[N_CAUSES];
+
+	RVIRQStats() {
+		prev_xip = 0;
+		prev_time = 0;
+		for (uint i = 0; i < N_CAUSES; ++i) {
+			assert_pending[i] = false;
+			assert_time[i] = 0;
+			rearmed[i] = false;
+			latency[i] = {};
+			duration[i] = {};
+		}
+	}
+
+	// Call after the IRQ inputs have been updated for the next step. `now` is
+	// the current cycle count, and `timer_age` is the number of cycles since
+	// mtime passed mtimecmp (only used if the timer IRQ is asserted). This
+	// allows the timer assertion time to be resolved more finely than one
+	// step of the core.
+	void sample(uint64_t now, ux_t xip, uint64_t timer_age);
+
+	// Call after a step in which the core entered a trap, with the new mcause
+	void trap_enter(uint64_t now, ux_t cause);
+
+	// Call after a step in which the core executed an mret
+	void mret(uint64_t now);
+
+	void print_summary(FILE *f=stdout) const;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "rv_types.h"
+
+struct RVSymbolTable;
+
+// Table of every instruction encoding in encoding/rv_opcodes.h, with its
+// mnemonic, the extension it belongs to, and its operand format. Used to
+// classify instructions by mnemonic for statistics, and to disassemble them.
+
+enum rv_ext_t {
+	EXT_I = 0,
+	EXT_ZICSR,
+	EXT_ZIFENCEI,
+	EXT_M,
+	EXT_A,
+	EXT_ZBA,
+	EXT_ZBB,
+	EXT_ZBC,
+	EXT_ZBS,
+	EXT_ZBKB,
+	EXT_ZBKX,
+	EXT_C,
+	EXT_ZCB,
+	EXT_ZCMP,
+	EXT_XH3B,
+	EXT_XH3POWER,
+	N_EXTS
+};
+
+extern const char *const rv_ext_names[N_EXTS];
+
+// Operand formats for disassembly. C_*_S formats use the 3-bit register
+// fields of the compressed encodings (x8..x15).
+enum rv_fmt_t {
+	FMT_NONE = 0,    // no operands
+	FMT_R,           // rd, rs1, rs2
+	FMT_R2,          // rd, rs1
+	FMT_I,           // rd, rs1, imm
+	FMT_SHAMT,       // rd, rs1, shamt
+	FMT_LOAD,        // rd, imm(rs1)
+	FMT_STORE,       // rs2, imm(rs1)
+	FMT_B,           // rs1, rs2, target
+	FMT_U,           // rd, imm[31:12]
+	FMT_J,           // rd, target
+	FMT_JALR,        // rd, imm(rs1)
+	FMT_FENCE,       // pred, succ
+	FMT_CSR,         // rd, csr, rs1
+	FMT_CSRI,        // rd, csr, uimm
+	FMT_LR,          // rd, (rs1)
+	FMT_AMO,         // rd, rs2, (rs1)
+	FMT_BEXTM,       // rd, rs1, rs2, size
+	FMT_BEXTMI,      // rd, rs1, shamt, size
+	FMT_C_ADDI4SPN,  // rd', sp, uimm
+	FMT_C_LW,        // rd', uimm(rs1')
+	FMT_C_SW,        // rs2', uimm(rs1')
+	FMT_C_LI,        // rd, imm
+	FMT_C_J,         // target
+	FMT_C_LUI,       // rd, imm[17:12]
+	FMT_C_ADDI16SP,  // sp, imm
+	FMT_C_SHIFT_S,   // rd', shamt
+	FMT_C_ANDI,      // rd', imm
+	FMT_C_R_S,       // rd', rs2'
+	FMT_C_B,         // rs1', target
+	FMT_C_SLLI,      // rd, shamt
+	FMT_C_R,         // rd, rs2
+	FMT_C_JR,        // rs1
+	FMT_C_LWSP,      // rd, uimm(sp)
+	FMT_C_SWSP,      // rs2, uimm(sp)
+	FMT_C_LB,        // rd', uimm(rs1'), byte offset
+	FMT_C_LH,        // rd', uimm(rs1'), halfword offset
+	FMT_C_SB,        // rs2', uimm(rs1'), byte offset
+	FMT_C_SH,        // rs2', uimm(rs1'), halfword offset
+	FMT_C_UNARY,     // rd'
+	FMT_CM_RLIST,    // {reg list}, stack adjustment
+	FMT_CM_MV,       // r1s', r2s'
+};
+
+struct RVInstrDesc {
+	const char *name;
+	uint32_t bits;
+	uint32_t mask;
+	rv_ext_t ext;
+	rv_fmt_t fmt;
+};
+
+extern const RVInstrDesc rv_instr_table[];
+extern const uint rv_instr_table_size;
+
+// Index into rv_instr_table of the first matching entry, or -1 if the
+// instruction is not recognised. Entries are ordered so that special cases
+// (e.g. c.jr within c.mv, h3.block within slt) match first. This is a
+// linear search, so callers on a hot path should cache the result.
+int rv_instr_lookup(uint32_t instr);
+
+// Disassemble one instruction (the upper half is ignored for 16-bit
+// instructions), e.g. "addi a0, a0, 1" or "beq a0, a1, 0x1234 <main+0x8>".
+// Branch and jump targets are labelled if symbols are available.
+std::string rv_disasm(uint32_t instr, ux_t pc, const RVSymbolTable *symbols = nullptr);
+
+// Name of a CSR, or its address in hex if it has no name
+std::string rv_csr_name(uint16_t addr);
@@ -1,11 +1,13 @@
 #pragma once
 
 #include "rv_types.h"
+#include "rv_snapshot.h"
 #include <optional>
 #include <tuple>
 #include <cassert>
 #include <vector>
 #include <cstdio>
+#include <string>
 
 struct MemBase32 {
 	virtual std::optional<uint8_t> r8(__attribute__((unused)) ux_t addr) {return std::nullopt;}
@@ -94,31 +96,63 @@ struct TBMemIO: MemBase32 {
 		IO_MTIMECMPH   = 0x10c,
 	};
 
+	// IO_SET_IRQ and IO_CLR_IRQ are each followed by three more registers
+	// for IRQs 32 and up
+	static const uint IRQ_WORDS = 4;
+
 	uint64_t mtime;
 	uint64_t mtimecmp;
 	bool softirq;
+	uint32_t irq[IRQ_WORDS];
 	bool trace;
+	// Suppress printing, e.g. while replaying for reverse execution
+	bool quiet;
+	// If set, printed output is appended here instead of going to stdout
+	std::string *output;
 
 	TBMemIO(bool trace_) {
 		mtime = 0;
 		mtimecmp = 0; // -1 would be better, but match tb and tests
 		softirq = false;
+		for (uint i = 0; i < IRQ_WORDS; ++i)
+			irq[i] = 0;
 		trace = trace_;
+		quiet = false;
+		output = nullptr;
 	}
 
 	virtual bool w32(ux_t addr, uint32_t data) {
+		if (addr >= IO_SET_IRQ && addr < IO_SET_IRQ + 4 * IRQ_WORDS) {
+			irq[(addr - IO_SET_IRQ) / 4] |= data;
+			return true;
+		}
+		if (addr >= IO_CLR_IRQ && addr < IO_CLR_IRQ + 4 * IRQ_WORDS) {
+			irq[(addr - IO_CLR_IRQ) / 4] &= ~data;
+			return true;
+		}
 		switch (addr) {
 		case IO_PRINT_CHAR:
-			if (trace)
+			if (quiet)
+				return true;
+			if (output)
+				*output += (char)data;
+			else if (trace)
 				printf("IO_PRINT_CHAR: %c\n", (char)data);
 			else
 				printf("%c", (char)data);
 			return true;
 		case IO_PRINT_U32:
-			if (trace)
+			if (quiet)
+				return true;
+			if (output) {
+				char buf[16];
+				snprintf(buf, sizeof(buf), "%08x\n", data);
+				*output += buf;
+			} else if (trace) {
 				printf("IO_PRINT_U32: %08x\n", data);
-			else
+			} else {
 				printf("%08x\n", data);
+			}
 			return true;
 		case IO_EXIT:
 			throw TBExitException(data);
@@ -147,6 +181,10 @@ struct TBMemIO: MemBase32 {
 	}
 
 	virtual std::optional<uint32_t> r32(ux_t addr) {
+		if (addr >= IO_SET_IRQ && addr < IO_SET_IRQ + 4 * IRQ_WORDS)
+			return irq[(addr - IO_SET_IRQ) / 4];
+		if (addr >= IO_CLR_IRQ && addr < IO_CLR_IRQ + 4 * IRQ_WORDS)
+			return irq[(addr - IO_CLR_IRQ) / 4];
 		switch(addr) {
 		case IO_MTIME:
 			return mtime & 0xffffffffull;
@@ -164,8 +202,8 @@ struct TBMemIO: MemBase32 {
 		}
 	}
 
-	void step() {
-		mtime++;
+	void step(uint cycles=1) {
+		mtime += cycles;
 	}
 
 	bool timer_irq_pending() {
@@ -176,6 +214,13 @@ struct TBMemIO: MemBase32 {
 		return softirq;
 	}
 
+	void serialise(RVSnapshotIO &io) {
+		io.field(mtime);
+		io.field(mtimecmp);
+		io.field(softirq);
+		io.field(irq);
+	}
+
 };
 
 struct MemMap32: MemBase32 {
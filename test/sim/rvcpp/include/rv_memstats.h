@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rv_types.h"
+
+// Memory access heatmap. Reads, writes and instruction fetches are counted
+// per cache-line-sized block of address space. The core's RAM is counted in
+// a dense array; everything else (MemMap32 devices, stray accesses) in a
+// sparse map keyed on line address.
+//
+// Loads and stores are recorded by the core's memory access functions, so
+// each beat of a Zcmp push/pop or AMO is counted. Fetches are recorded once
+// per executed instruction (twice if a 32-bit instruction straddles a line),
+// regardless of how many bus accesses the core actually made.
+
+struct RVHeatmap {
+	struct Counts {
+		uint64_t reads;
+		uint64_t writes;
+		uint64_t execs;
+	};
+
+	struct Region {
+		std::string name;
+		ux_t base;
+		uint32_t size;
+	};
+
+	uint line_shift;
+	ux_t ram_base;
+	uint32_t ram_size;
+	std::vector<Counts> ram_lines;
+	std::unordered_map<ux_t, Counts> other_lines;
+	// Regions listed separately in the summary
+	std::vector<Region> regions;
+
+	// line_size must be a power of two
+	RVHeatmap(ux_t ram_base_, uint32_t ram_size_, uint line_size) {
+		line_shift = __builtin_ctz(line_size);
+		ram_base = ram_base_;
+		ram_size = ram_size_;
+		ram_lines.resize((ram_size + line_size - 1) >> line_shift);
+		regions.push_back({"RAM", ram_base_, ram_size_});
+	}
+
+	void add_region(const std::string &name, ux_t base, uint32_t size) {
+		regions.push_back({name, base, size});
+	}
+
+	inline Counts &line(ux_t addr) {
+		ux_t offset = addr - ram_base;
+		if (offset < ram_size)
+			return ram_lines[offset >> line_shift];
+		else
+			return other_lines[addr >> line_shift << line_shift];
+	}
+
+	inline void read(ux_t addr) {
+		++line(addr).reads;
+	}
+
+	inline void write(ux_t addr) {
+		++line(addr).writes;
+	}
+
+	// Call after each step of the core
+	inline void step(ux_t pc, uint32_t instr, bool sleeping, bool trap) {
+		if (sleeping || trap)
+			return;
+		++line(pc).execs;
+		if ((instr & 0x3) == 0x3 && ((pc + 2) >> line_shift) != (pc >> line_shift))
+			++line(pc + 2).execs;
+	}
+
+	// One line per touched cache line: "address reads writes execs"
+	void write_file(FILE *f) const;
+
+	void print_summary(FILE *f, uint top_n=10) const;
+};
+
+// Stack low-water mark, tracked separately for each interrupt nesting level.
+// rvcpp models a single hart, hart 0.
+//
+// Level 0 is thread mode; its usage is measured from the highest sp seen at
+// level 0. Each trap entry goes up one level and measures usage from the sp
+// at the point of entry. mret goes back down one level. Nesting deeper than
+// MAX_LEVELS - 1 is accounted to the deepest level.
+
+struct RVStackStats {
+	static const uint MAX_LEVELS = 32;
+
+	uint nesting;
+	// sp at entry to the current trap at each level
+	ux_t entry_sp[MAX_LEVELS];
+	ux_t min_sp[MAX_LEVELS];
+	ux_t max_depth[MAX_LEVELS];
+	uint64_t entries[MAX_LEVELS];
+	ux_t level0_max_sp;
+	bool started;
+
+	RVStackStats() {
+		nesting = 0;
+		for (uint i = 0; i < MAX_LEVELS; ++i) {
+			entry_sp[i] = 0;
+			min_sp[i] = ~0u;
+			max_depth[i] = 0;
+			entries[i] = 0;
+		}
+		level0_max_sp = 0;
+		started = false;
+	}
+
+	// Call after each step of the core, with the value of sp after the step
+	void step(bool trap, bool mret, ux_t sp);
+
+	void print_summary(FILE *f) const;
+};
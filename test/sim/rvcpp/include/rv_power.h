@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+
+#include "rv_types.h"
+
+struct RVSnapshotIO;
+
+// Model of the sleep states in hazard3_power_ctrl.v, driven by the core's WFI
+// and h3.block stalls and the msleep CSR:
+//
+// - run:       executing instructions
+// - sleep:     pipeline stalled on WFI or h3.block, clock still running
+//              (msleep.deepsleep and msleep.powerdown both clear, or an
+//              h3.block with msleep.sleeponblock clear)
+// - deepsleep: clock gated (msleep.deepsleep)
+// - powerdown: power-up request deasserted (msleep.powerdown)
+//
+// Sleeps are accounted per sleep site (the PC of the WFI/h3.block), so that
+// sites which spend a long time in shallow sleep, or which usually fall
+// straight through, are easy to find.
+
+struct RVPower {
+	enum state_t {
+		S_RUN = 0,
+		S_SLEEP,
+		S_DEEPSLEEP,
+		S_POWERDOWN,
+		N_STATES
+	};
+
+	static const char *const state_names[N_STATES];
+
+	// Extra cycles to return to S_RUN, going through S_ENTER_AWAKE. For
+	// power-down this assumes pwrup_ack follows pwrup_req after one cycle, as
+	// in the tb_cxxrtl testbench.
+	static const uint WAKE_CYCLES_DEEPSLEEP = 1;
+	static const uint WAKE_CYCLES_POWERDOWN = 2;
+
+	struct Site {
+		bool is_block;
+		uint64_t entries;
+		// Sleeps which woke without spending any cycles asleep, because a
+		// wakeup was already pending
+		uint64_t fall_through;
+		uint64_t cycles[N_STATES];
+	};
+
+	state_t state;
+	uint64_t state_cycles[N_STATES];
+	uint64_t state_entries[N_STATES];
+	uint64_t wake_cycles;
+
+	// Sleep which was entered by the previous step, if any
+	bool in_sleep;
+	ux_t sleep_pc;
+	uint64_t sleep_len;
+	std::map<ux_t, Site> sites;
+
+	// Optional: one line per state transition
+	FILE *timeline;
+
+	RVPower() {
+		state = S_RUN;
+		for (uint i = 0; i < N_STATES; ++i) {
+			state_cycles[i] = 0;
+			state_entries[i] = 0;
+		}
+		wake_cycles = 0;
+		in_sleep = false;
+		sleep_pc = 0;
+		sleep_len = 0;
+		timeline = nullptr;
+	}
+
+	// Call after each step of the core. `now` is the cycle count at the start
+	// of the step. `stalled_on_wfi`/`stalled_on_block` are the core's stall
+	// state after the step. Returns the number of extra cycles spent waking
+	// up, which should be added to the step's cycle count.
+	uint step(uint64_t now, ux_t pc, uint cycles, bool sleeping,
+		bool stalled_on_wfi, bool stalled_on_block, uint msleep);
+
+	// Save or restore the current power state and any sleep in progress. As
+	// with RVTiming, the statistics are not included.
+	void serialise(RVSnapshotIO &io);
+
+	void print_summary(FILE *f=stdout) const;
+};
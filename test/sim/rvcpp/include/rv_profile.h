@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "rv_types.h"
+#include "rv_elf.h"
+
+// Flat PC profiler. Retired instructions (and cycles, if the timing model is
+// enabled) are counted in dense arrays with one entry per halfword of the
+// loaded image, so the per-step cost is a couple of array increments.
+//
+// Counts are also accumulated per basic block, keyed on the block's leader
+// (first instruction). A block starts at any non-sequential PC, after any
+// control transfer instruction whether taken or not, and after a trap.
+//
+// At exit, per-PC counts are folded by ELF symbol if a symbol table was
+// loaded, and the hottest functions and blocks are printed.
+
+struct RVProfile {
+	ux_t base;
+	uint32_t n_halfwords;
+	bool count_cycles;
+
+	std::vector<uint64_t> instrs;
+	std::vector<uint64_t> cycles;
+
+	std::vector<uint64_t> block_entries;
+	std::vector<uint64_t> block_instrs;
+	std::vector<uint64_t> block_cycles;
+	// Address of the last instruction seen in the block
+	std::vector<ux_t> block_last;
+
+	// Instructions executed outside of the profiled range
+	uint64_t other_instrs;
+	uint64_t other_cycles;
+	uint64_t sleep_cycles;
+	uint64_t trap_cycles;
+	uint64_t trap_count;
+
+	uint32_t cur_block;
+	ux_t next_seq_pc;
+	bool block_break;
+
+	// Profile the address range [base_, base_ + size)
+	RVProfile(ux_t base_, uint32_t size, bool count_cycles_) {
+		base = base_;
+		n_halfwords = (size + 1) / 2;
+		count_cycles = count_cycles_;
+		instrs.resize(n_halfwords);
+		block_entries.resize(n_halfwords);
+		block_instrs.resize(n_halfwords);
+		block_last.resize(n_halfwords);
+		if (count_cycles) {
+			cycles.resize(n_halfwords);
+			block_cycles.resize(n_halfwords);
+		}
+		other_instrs = 0;
+		other_cycles = 0;
+		sleep_cycles = 0;
+		trap_cycles = 0;
+		trap_count = 0;
+		cur_block = 0;
+		next_seq_pc = 0;
+		block_break = true;
+	}
+
+	// Call after each step of the core, with the RVStepInfo fields.
+	inline void step(ux_t pc, uint32_t instr, uint step_cycles, bool sleeping, bool trap) {
+		if (sleeping || trap) {
+			// No instruction retired. A trap step is the trap entry sequence,
+			// not the execution of the instruction at pc.
+			if (trap) {
+				trap_cycles += step_cycles;
+				++trap_count;
+			} else {
+				sleep_cycles += step_cycles;
+			}
+			block_break = true;
+			return;
+		}
+		uint32_t i = (pc - base) >> 1;
+		if (i >= n_halfwords) {
+			++other_instrs;
+			other_cycles += step_cycles;
+			block_break = true;
+			return;
+		}
+		++instrs[i];
+		if (block_break || pc != next_seq_pc) {
+			cur_block = i;
+			++block_entries[i];
+		}
+		++block_instrs[cur_block];
+		if (pc > block_last[cur_block])
+			block_last[cur_block] = pc;
+		if (count_cycles) {
+			cycles[i] += step_cycles;
+			block_cycles[cur_block] += step_cycles;
+		}
+		next_seq_pc = pc + ((instr & 0x3) == 0x3 ? 4 : 2);
+		block_break = is_control_transfer(instr);
+	}
+
+	static bool is_control_transfer(uint32_t instr);
+
+	void print_summary(FILE *f, const RVSymbolTable &symbols, uint top_n=20) const;
+};
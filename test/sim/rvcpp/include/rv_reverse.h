@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rv_types.h"
+#include "rv_elf.h"
+
+struct RVCore;
+struct TBMemIO;
+
+// Reverse execution by checkpoint and replay. The core and IO state (without
+// RAM) are saved every `interval` steps. Between checkpoints, the first write
+// to each RAM page saves the page's old contents to an undo log, so going
+// back to a checkpoint means applying the undo logs of that checkpoint and
+// every later one, newest first, then loading the saved state. Any point in
+// between is reached by replaying forward from the checkpoint before it.
+//
+// Time is counted in steps (calls to RVCore::step(), so including sleeping
+// steps and IRQ entries) since the first checkpoint. Replay relies on the
+// simulation being deterministic given the checkpointed state, which is true
+// of the core and TBMemIO, but not of the --timing and --power models.
+//
+// Checkpoints later than the current position are discarded when going back,
+// and recreated as the replay passes them.
+
+struct RVReverse {
+	static const uint32_t PAGE_SIZE = 1024;
+
+	struct Checkpoint {
+		uint64_t step;
+		// Identifies this checkpoint's undo log in page_epoch. Changed when
+		// the log is emptied, so stale page_epoch entries don't match.
+		uint32_t epoch;
+		std::vector<uint8_t> state;
+		// Old contents of pages first written after this checkpoint
+		std::vector<std::pair<uint32_t, std::vector<uint8_t>>> undo;
+	};
+
+	RVCore &core;
+	TBMemIO &io;
+	uint8_t *ram;
+	ux_t ram_base;
+	size_t ram_size;
+
+	uint64_t interval;
+	uint64_t position;
+	// The furthest point reached by the original run
+	uint64_t present;
+	std::vector<Checkpoint> checkpoints;
+	std::vector<uint32_t> page_epoch;
+	uint32_t next_epoch;
+
+	// RAM writes overlapping this range set watch_hit (used by queries)
+	ux_t watch_start;
+	ux_t watch_end;
+	bool watch_hit;
+
+	// Takes the first checkpoint, so construct after loading the initial
+	// RAM contents
+	RVReverse(RVCore &core_, TBMemIO &io_, uint64_t interval_);
+
+	// Called by the core before writing to RAM. Writes never cross a page.
+	inline void ram_write(ux_t addr, uint size) {
+		uint32_t page = (addr - ram_base) / PAGE_SIZE;
+		if (page_epoch[page] != checkpoints.back().epoch)
+			save_page(page);
+		if (addr < watch_end && addr + size > watch_start)
+			watch_hit = true;
+	}
+
+	// Call after each step of the main simulation loop
+	void after_step() {
+		++position;
+		present = position;
+		if (position % interval == 0)
+			take_checkpoint();
+	}
+
+	// Move to just before the given step, which must not be after the
+	// present. Returns false if out of range.
+	bool seek(uint64_t step);
+
+	// Search backward from the current position for the most recent step
+	// after which `after` returns true (`before` is called before each step,
+	// to sample whatever `after` compares against). If found, move to just
+	// before that step and return true, else stay put and return false.
+	bool find_last(const std::function<void()> &before, const std::function<bool()> &after);
+
+	// Run a --reverse-query command, and print the new position and any
+	// result. Returns false if the query is not understood.
+	bool query(const std::string &q, const RVSymbolTable &symbols, FILE *out);
+
+private:
+	void save_page(uint32_t page);
+	void take_checkpoint();
+	void restore(size_t index);
+	void replay_step();
+	void print_position(const RVSymbolTable &symbols, FILE *out);
+};
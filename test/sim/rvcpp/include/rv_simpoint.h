@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "rv_types.h"
+#include "rv_profile.h"
+
+// SimPoint-style phase analysis. Execution is divided into intervals of a
+// fixed number of retired instructions, and for each interval a basic block
+// vector (BBV) records how many instructions were executed in each basic
+// block. Intervals are then clustered by their BBVs, and the interval
+// closest to the centre of each cluster is chosen to represent it, weighted
+// by the size of the cluster.
+//
+// Clustering follows SimPoint 3: BBVs are normalised, randomly projected
+// down to a few dimensions, and clustered with k-means for each k up to a
+// limit. The chosen k is the smallest whose BIC score is within 90% of the
+// best score seen.
+//
+// Output files use SimPoint's formats, so they can be fed to other tools:
+//
+// - prefix.bb:        "T:id:count :id:count ..." per interval
+// - prefix.simpoints: "interval cluster" per chosen interval
+// - prefix.weights:   "weight cluster" per chosen interval
+//
+// Basic blocks are delimited the same way as for RVProfile.
+
+struct RVSimPoint {
+	static const uint PROJECTED_DIMS = 15;
+	static const uint KMEANS_RESTARTS = 5;
+	static const uint KMEANS_MAX_ITERATIONS = 100;
+
+	uint64_t interval;
+	uint64_t instret;
+
+	// Current basic block
+	ux_t next_seq_pc;
+	bool block_break;
+	uint32_t cur_block;
+	std::unordered_map<ux_t, uint32_t> block_ids;
+
+	// Counts for the current interval, indexed by block ID, and the list of
+	// nonzero entries
+	std::vector<uint64_t> counts;
+	std::vector<uint32_t> touched;
+
+	typedef std::vector<std::pair<uint32_t, uint64_t>> BBV;
+	std::vector<BBV> bbvs;
+
+	struct SimPoint {
+		uint cluster;
+		uint64_t interval;
+		double weight;
+	};
+	std::vector<SimPoint> simpoints;
+
+	RVSimPoint(uint64_t interval_) {
+		interval = interval_;
+		instret = 0;
+		next_seq_pc = 0;
+		block_break = true;
+		cur_block = 0;
+	}
+
+	// Call after each step of the core, with the RVStepInfo fields
+	inline void step(ux_t pc, uint32_t instr, bool sleeping, bool trap) {
+		if (sleeping || trap) {
+			block_break = true;
+			return;
+		}
+		if (block_break || pc != next_seq_pc)
+			enter_block(pc);
+		if (!counts[cur_block]++)
+			touched.push_back(cur_block);
+		next_seq_pc = pc + ((instr & 0x3) == 0x3 ? 4 : 2);
+		block_break = RVProfile::is_control_transfer(instr);
+		if (++instret % interval == 0)
+			end_interval();
+	}
+
+	// Record the final partial interval (if any), cluster, and write out
+	// prefix.bb, prefix.simpoints and prefix.weights. Returns false if the
+	// files could not be written.
+	bool finish(const std::string &prefix, uint max_k);
+
+	void print_summary(FILE *f) const;
+
+	// Parse a .simpoints file, returning the chosen interval numbers
+	static bool read_simpoints(const std::string &path, std::vector<uint64_t> &intervals);
+
+private:
+	void enter_block(ux_t pc);
+	void end_interval();
+	void cluster(uint max_k);
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "rv_types.h"
+
+// Reader/writer for rvcpp architectural snapshots. Each class which owns
+// state has a serialise(RVSnapshotIO&) method which passes every field,
+// in a fixed order, through field(). The same method is used for saving and
+// loading, so the two can't get out of step.
+//
+// Fields are written individually, little-endian as on the host, so the
+// file contents depend only on the simulated state (no struct padding).
+// Large, mostly-empty arrays such as RAM go through sparse(), which only
+// stores pages containing a nonzero byte.
+//
+// The same format can be written to an in-memory buffer instead of a file,
+// optionally without RAM, for the checkpoints in rv_reverse.h.
+
+struct RVSnapshotIO {
+	static const uint32_t VERSION = 4;
+	static const uint32_t PAGE_SIZE = 4096;
+
+	FILE *f;
+	std::vector<uint8_t> *buf;
+	size_t buf_pos;
+	bool loading;
+	// Cleared on any I/O error or format mismatch
+	bool ok;
+	// If false, RVCore::serialise() skips RAM
+	bool include_ram;
+
+	RVSnapshotIO(FILE *f_, bool loading_) {
+		f = f_;
+		buf = nullptr;
+		buf_pos = 0;
+		loading = loading_;
+		ok = f != nullptr;
+		include_ram = true;
+	}
+
+	RVSnapshotIO(std::vector<uint8_t> &buf_, bool loading_) {
+		f = nullptr;
+		buf = &buf_;
+		buf_pos = 0;
+		loading = loading_;
+		ok = true;
+		include_ram = true;
+	}
+
+	void raw(void *data, size_t size);
+
+	template <typename T>
+	void field(T &x) {
+		static_assert(std::is_trivially_copyable_v<T>, "snapshot fields must be plain data");
+		raw(&x, sizeof(x));
+	}
+
+	template <typename T, size_t N>
+	void field(T (&x)[N]) {
+		for (size_t i = 0; i < N; ++i)
+			field(x[i]);
+	}
+
+	template <typename T>
+	void field(std::optional<T> &x) {
+		bool present = x.has_value();
+		field(present);
+		T value = present ? *x : T{};
+		field(value);
+		if (loading)
+			x = present ? std::optional<T>(value) : std::nullopt;
+	}
+
+	// Check (when loading) or write (when saving) a value which must match
+	void expect(uint32_t value);
+
+	// Only pages with nonzero contents are stored. When loading, all other
+	// pages are zeroed.
+	void sparse(void *data, size_t size);
+
+	// Magic number and version
+	void header();
+};
+
+struct RVCore;
+struct TBMemIO;
+struct RVPower;
+
+// Save/restore the state of a core and the testbench IO device (timer and
+// IRQ registers) to/from a file. Returns false, with an error message on
+// stderr, on failure.
+//
+// The state of the core's timing model and of `power`, where present, is
+// saved too. On load, saved state for a model the run doesn't use is
+// skipped, and a model with no saved state starts from reset.
+bool rv_save_snapshot(const std::string &path, RVCore &core, TBMemIO &io, RVPower *power=nullptr);
+bool rv_load_snapshot(const std::string &path, RVCore &core, TBMemIO &io, RVPower *power=nullptr);
+
+// Save the architectural state in a form which tb_cxxrtl --load-handoff can
+// apply to the RTL, to continue a run cycle-accurately from this point:
+// prefix.bin is a flat image of RAM (trailing zeroes trimmed), and
+// prefix.txt lists the PC, privilege level, GPRs, CSR writes (in order, see
+// RVCSR::get_restore_writes()) and the testbench IO state, one per line:
+//
+//   pc <hex>
+//   priv <n>
+//   x <n> <hex>
+//   csr <hex addr> <hex data>
+//   mtime <hex>
+//   mtimecmp <hex>
+//   softirq <n>
+//   irq <word> <hex>
+//
+// Lines starting with # are comments.
+bool rv_save_handoff(const std::string &prefix, RVCore &core, TBMemIO &io);
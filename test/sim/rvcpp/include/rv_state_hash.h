@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+
+#include "rv_types.h"
+
+struct RVStepInfo;
+
+// Rolling hash of architectural state, for finding where two simulators
+// diverge without comparing full traces. tb_cxxrtl computes the same hash
+// from the core's retirement and register writeback signals, and
+// scripts/state_hash_bisect.py compares the two.
+//
+// The hash covers the stream of retired instructions: the PC of each, then
+// the GPR it wrote (if any) and the value. CSR state is covered whenever it
+// is read into a GPR. Exceptions don't retire, except for ecall and ebreak,
+// matching the core's minstret.
+//
+// Zcmp instructions write several GPRs, one per uop. The core counts the
+// retirement with the final uop, by which time the earlier uops' writes
+// have already reached the register file, so those are hashed before the
+// PC and only the final uop's write after it.
+//
+// Every interval retired instructions, a line of
+//
+//   <instructions retired> <pc of last instruction> <hash>
+//
+// is written, covering everything up to that instruction's PC but not its
+// writeback (because tb_cxxrtl sees the writeback one cycle later).
+
+struct RVStateHash {
+	static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+	static const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+	uint64_t hash;
+	uint64_t instret;
+	uint64_t interval;
+	// Only print checkpoints in this range (inclusive)
+	uint64_t print_start;
+	uint64_t print_end;
+	FILE *out;
+
+	RVStateHash(uint64_t interval_, FILE *out_) {
+		hash = FNV_OFFSET;
+		instret = 0;
+		interval = interval_;
+		print_start = 0;
+		print_end = UINT64_MAX;
+		out = out_;
+	}
+
+	inline void mix(uint32_t x) {
+		hash = (hash ^ x) * FNV_PRIME;
+	}
+
+	// Call after each step of the core
+	void step(const RVStepInfo &info);
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+
+#include "rv_types.h"
+#include "rv_mem.h"
+
+// Record/replay of the simulation's external inputs: IRQ line levels, and
+// the results of loads from memory-mapped devices (anything outside of the
+// core's flat RAM). Sits between the core and its memory map, and between the
+// devices' IRQ outputs and the core's IRQ inputs.
+//
+// When recording, each change of an IRQ line and every device read is logged.
+// When replaying, device reads return the logged values without reaching the
+// device (writes still go through, so output and exit still work), and IRQ
+// lines follow the log. A replayed run therefore follows the recorded run
+// exactly, even if the devices which produced the stimulus were randomised.
+//
+// Events are keyed by step count (calls to RVCore::step()), rather than
+// retired instructions, so that the exact wakeup from WFI is reproduced.
+//
+// File format: an 8-byte header ("RVSTIM" plus a version byte and a zero),
+// then one record per event:
+//
+//   varint  steps since the previous event
+//   uint8_t type (STIM_*)
+//   payload:
+//     STIM_IRQ_T, STIM_IRQ_S: none (the line toggles)
+//     STIM_IRQ_E:             uint8_t word index, varint new value
+//     STIM_READ8/16/32:       varint address, varint data
+//     STIM_READ_ERR:          varint address, uint8_t size
+//
+// Varints are unsigned LEB128.
+
+enum {
+	STIM_IRQ_T    = 0,
+	STIM_IRQ_S    = 1,
+	STIM_IRQ_E    = 2,
+	STIM_READ8    = 3,
+	STIM_READ16   = 4,
+	STIM_READ32   = 5,
+	STIM_READ_ERR = 6,
+};
+
+struct RVStimulus: MemBase32 {
+	static const uint IRQ_WORDS = TBMemIO::IRQ_WORDS;
+
+	enum Mode {
+		OFF,
+		RECORD,
+		REPLAY
+	};
+
+	MemBase32 &mem;
+	Mode mode;
+	FILE *f;
+	uint64_t step;
+	uint64_t last_event_step;
+	uint64_t events;
+
+	bool irq_t;
+	bool irq_s;
+	uint32_t irq_e[IRQ_WORDS];
+
+	// Replay: the next event from the log, if any
+	bool have_next;
+	uint64_t next_step;
+	uint8_t next_type;
+	uint8_t next_index;
+	ux_t next_addr;
+	uint32_t next_data;
+	// Set (with a message on stderr) if the run stops following the log.
+	// Replay then stops, and the run continues with the live devices.
+	bool diverged;
+
+	RVStimulus(MemBase32 &mem_): mem(mem_) {
+		mode = OFF;
+		f = nullptr;
+		step = 0;
+		last_event_step = 0;
+		events = 0;
+		irq_t = false;
+		irq_s = false;
+		for (uint i = 0; i < IRQ_WORDS; ++i)
+			irq_e[i] = 0;
+		have_next = false;
+		next_step = 0;
+		next_type = 0;
+		next_index = 0;
+		next_addr = 0;
+		next_data = 0;
+		diverged = false;
+	}
+
+	// Open a log for recording or replay. Returns false, with a message on
+	// stderr, on failure.
+	bool open(const std::string &path, Mode mode_);
+
+	// Close the log and print a summary. When replaying, also report if the
+	// log was not used up. Reads pass straight through afterward.
+	void finish(FILE *out);
+
+	// Call after each step of the core
+	void end_step() {
+		++step;
+	}
+
+	// Call with the devices' IRQ outputs after each step. When recording,
+	// changes are logged. When replaying, the values are replaced with the
+	// logged ones.
+	void irqs(bool &t, bool &s, uint32_t *e);
+
+	virtual std::optional<uint8_t> r8(ux_t addr) {
+		return read<uint8_t>(addr, 1, [&]() {return mem.r8(addr);});
+	}
+
+	virtual std::optional<uint16_t> r16(ux_t addr) {
+		return read<uint16_t>(addr, 2, [&]() {return mem.r16(addr);});
+	}
+
+	virtual std::optional<uint32_t> r32(ux_t addr) {
+		return read<uint32_t>(addr, 4, [&]() {return mem.r32(addr);});
+	}
+
+	virtual bool w8(ux_t addr, uint8_t data) {
+		return mem.w8(addr, data);
+	}
+
+	virtual bool w16(ux_t addr, uint16_t data) {
+		return mem.w16(addr, data);
+	}
+
+	virtual bool w32(ux_t addr, uint32_t data) {
+		return mem.w32(addr, data);
+	}
+
+private:
+	// `live` reads the device, which is not done when replaying
+	template <typename T, typename F>
+	std::optional<T> read(ux_t addr, uint size, F live);
+
+	void record_read(ux_t addr, uint size, std::optional<uint32_t> data);
+	// Returns false (and stops replay) if the read is not the next event
+	bool replay_read(ux_t addr, uint size, std::optional<uint32_t> &data);
+
+	void put_varint(uint64_t x);
+	bool get_varint(uint64_t &x);
+	void put_event(uint8_t type);
+	void fetch_next();
+	void diverge(const char *what);
+};
+
+template <typename T, typename F>
+std::optional<T> RVStimulus::read(ux_t addr, uint size, F live) {
+	if (mode == REPLAY) {
+		std::optional<uint32_t> data;
+		if (replay_read(addr, size, data)) {
+			if (!data)
+				return std::nullopt;
+			return (T)*data;
+		}
+	}
+	std::optional<T> result = live();
+	if (mode == RECORD) {
+		std::optional<uint32_t> data;
+		if (result)
+			data = *result;
+		record_read(addr, size, data);
+	}
+	return result;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "rv_types.h"
+
+struct RVSnapshotIO;
+
+// Approximate cycle timing model for Hazard3, based on the cycle counts in
+// doc/sections/instruction_timings.adoc. This assumes the configuration used
+// there (MULDIV_UNROLL = 2, MUL_FAST = 1, everything else set for maximum
+// performance) and zero-wait-state memory.
+//
+// The frontend prefetch buffer is also modelled, because it matters for the
+// single-ported configuration (hazard3_cpu_1port.v) where instruction fetch
+// and load/store share one bus. Load/store has priority at the arbiter, so
+// fetch only makes progress on cycles where there is no data access, unless
+// the frontend has run completely dry. The difference shows up as bus
+// arbitration stalls.
+
+struct RVTiming {
+	// Matches FIFO_DEPTH in hazard3_frontend.v. The instruction currently
+	// being decoded (CIR) holds one more word on top of this.
+	static const uint FIFO_DEPTH = 2;
+	static const uint BUFFER_HWORDS = 2 * (FIFO_DEPTH + 1);
+
+	// Trap entry time documented for ecall/ebreak. Interrupts are the same.
+	static const uint TRAP_ENTRY_CYCLES = 3;
+
+	enum {
+		PORTS_2 = 0,
+		PORTS_1 = 1
+	};
+
+	uint bus_ports;
+
+	// Pipeline state carried between instructions
+	uint load_rd;
+	bool prev_excl;
+	bool prev_redirect;
+	bool bp_valid;
+	ux_t bp_pc;
+	uint fetch_hwords;
+
+	// Cycle breakdown. `cycles` is the total; everything else is a subset.
+	uint64_t instrs;
+	uint64_t cycles;
+	uint64_t stall_load_use;
+	uint64_t stall_excl;
+	uint64_t stall_mispredict;
+	uint64_t stall_jump;
+	uint64_t stall_muldiv;
+	uint64_t stall_amo;
+	uint64_t stall_zcmp;
+	uint64_t stall_trap;
+	uint64_t stall_wfi;
+	uint64_t stall_fetch_align;
+	uint64_t stall_bus_arb;
+	uint64_t data_bus_cycles;
+	uint64_t branches;
+	uint64_t mispredicts;
+
+	// Timing-dependent HPM events (see rv_hpm.h) raised by the most recent
+	// call to retire()
+	uint32_t events;
+
+	RVTiming(uint ports=PORTS_2) {
+		bus_ports = ports;
+		load_rd = 0;
+		prev_excl = false;
+		prev_redirect = true;
+		bp_valid = false;
+		bp_pc = 0;
+		fetch_hwords = 0;
+		instrs = 0;
+		cycles = 0;
+		stall_load_use = 0;
+		stall_excl = 0;
+		stall_mispredict = 0;
+		stall_jump = 0;
+		stall_muldiv = 0;
+		stall_amo = 0;
+		stall_zcmp = 0;
+		stall_trap = 0;
+		stall_wfi = 0;
+		stall_fetch_align = 0;
+		stall_bus_arb = 0;
+		data_bus_cycles = 0;
+		branches = 0;
+		mispredicts = 0;
+		events = 0;
+	}
+
+	// Account for one instruction which executed at `pc`, and was followed by
+	// `next_pc`. `regs` is the register file *before* the instruction's
+	// writeback. Returns the number of cycles the instruction took.
+	uint retire(ux_t pc, uint32_t instr, ux_t next_pc, const ux_t *regs);
+
+	// Account for an exception or interrupt entry in place of an instruction.
+	uint trap();
+
+	// Account for one step of the core sitting in a WFI or h3.block sleep.
+	uint wfi();
+
+	// Save or restore the pipeline and prefetch state carried between
+	// instructions. The cycle breakdown is not included, so a run from a
+	// snapshot only reports its own cycles.
+	void serialise(RVSnapshotIO &io);
+
+	void print_summary(FILE *f=stdout);
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "rv_types.h"
+#include "rv_elf.h"
+
+// Execution trace. The core fills in one RVTraceRecord per step when tracing
+// is enabled. The record can be printed straight away (--trace), or written
+// to a compact binary file (--trace-bin) to be rendered later with
+// --decode-trace, which produces the same text.
+//
+// Binary format: an 8-byte file header ("RVTRACE" plus a version byte), then
+// one record per step. Each record starts with a fixed 8-byte part:
+//
+//   uint32_t instr
+//   uint16_t flags     (TRACE_F_*)
+//   int16_t  pc_delta  pc minus the PC expected to follow the previous record
+//
+// followed by an optional field for each flag which is set, in flag order.
+// The expected PC is the previous record's trap target, else its PC
+// writeback, else its sequential PC, so pc_delta is nearly always zero and
+// a straight-line instruction takes 8 bytes. Multi-byte fields are
+// little-endian.
+
+struct RVTraceRecord {
+	ux_t pc;
+	uint32_t instr;
+	// The step was replaced by IRQ entry, so no instruction executed
+	bool irq;
+	// Nonzero GPR writeback
+	std::optional<uint> rd;
+	ux_t rd_wdata;
+	// Explicit PC writeback (jumps, taken branches, mret, sleeping)
+	std::optional<ux_t> pc_wdata;
+	// CSR written, and its value after the write
+	std::optional<uint16_t> csr_addr;
+	ux_t csr_value;
+	// Exception cause, or IRQ cause with mcause.interrupt stripped
+	std::optional<uint> trap_cause;
+	ux_t trap_target;
+	// New privilege level, after a trap or mret
+	std::optional<uint> priv;
+
+	ux_t next_pc() const {
+		if (trap_cause)
+			return trap_target;
+		if (pc_wdata)
+			return *pc_wdata;
+		return pc + ((instr & 0x3) == 0x3 ? 4 : 2);
+	}
+};
+
+enum {
+	TRACE_F_PC_ABS   = 1u << 0,  // uint32_t pc (pc_delta is ignored)
+	TRACE_F_GPR      = 1u << 1,  // uint8_t rd, uint32_t value
+	TRACE_F_PC_WB16  = 1u << 2,  // int16_t target - pc
+	TRACE_F_PC_WB32  = 1u << 3,  // uint32_t target
+	TRACE_F_CSR      = 1u << 4,  // uint16_t addr, uint32_t value
+	TRACE_F_EXCEPT   = 1u << 5,  // uint8_t cause, uint32_t target
+	TRACE_F_IRQ      = 1u << 6,  // uint16_t cause, uint32_t target
+	TRACE_F_PRIV     = 1u << 7,  // uint8_t priv
+};
+
+// Print a record in rvcpp's text trace format. The annotation, if any, is
+// appended to the instruction's line (like scripts/annotate_trace.py).
+void rv_trace_print(FILE *f, const RVTraceRecord &r, const char *annotation = nullptr);
+
+// Prints a sequence of records, adding a label line whenever execution moves
+// to a different function (if there are any symbols), and optionally
+// annotating each instruction with its disassembly
+struct RVTracePrinter {
+	const RVSymbolTable &symbols;
+	const RVSymbolTable::Symbol *prev_sym;
+	bool first;
+	bool disasm;
+
+	RVTracePrinter(const RVSymbolTable &symbols_, bool disasm_=false): symbols(symbols_) {
+		prev_sym = nullptr;
+		first = true;
+		disasm = disasm_;
+	}
+
+	void print(FILE *f, const RVTraceRecord &r);
+};
+
+// Decides which steps are traced, when --trace or --trace-bin output is
+// restricted by any of the --trace-* conditions. Steps which are not traced
+// cost nothing beyond the checks here.
+//
+// Tracing is on while the window is open and all of the per-step conditions
+// hold. The window opens when any start condition is met (immediately if
+// there are none), and closes when any stop condition is met. After closing,
+// a start PC reopens it, but instruction and cycle counts do not.
+struct RVTraceFilter {
+	// Window conditions
+	std::optional<uint64_t> start_instret;
+	std::optional<uint64_t> stop_instret;
+	std::optional<uint64_t> start_cycle;
+	std::optional<ux_t> start_pc;
+	std::optional<ux_t> stop_pc;
+
+	// Per-step conditions
+	std::vector<std::pair<ux_t, ux_t>> pc_ranges;
+	std::optional<uint> priv;
+	// Trace calls to this function, including callees, from entry until it
+	// returns to its caller
+	std::optional<ux_t> func;
+
+	uint64_t instret;
+	bool open;
+	bool counts_fired;
+	bool in_func;
+	ux_t func_ret;
+	ux_t func_sp;
+	bool traced_stop_pc;
+
+	RVTraceFilter() {
+		instret = 0;
+		open = false;
+		counts_fired = false;
+		in_func = false;
+		func_ret = 0;
+		func_sp = 0;
+		traced_stop_pc = false;
+	}
+
+	bool enabled() const {
+		return start_instret || stop_instret || start_cycle || start_pc || stop_pc ||
+			!pc_ranges.empty() || priv || func;
+	}
+
+	// Call before each step, with the PC about to execute and the registers
+	// as they are now. Returns true if this step should be traced.
+	bool before_step(ux_t pc, uint cur_priv, uint64_t cycle, ux_t ra, ux_t sp) {
+		if (!open) {
+			bool counts_start = !counts_fired && (
+				(start_instret && instret >= *start_instret) ||
+				(start_cycle && cycle >= *start_cycle));
+			bool no_start = !start_instret && !start_cycle && !start_pc;
+			if (counts_start || (start_pc && pc == *start_pc) || (no_start && !counts_fired)) {
+				open = true;
+				counts_fired = true;
+			}
+		}
+		if (func) {
+			if (in_func && pc == func_ret && sp >= func_sp) {
+				in_func = false;
+			} else if (!in_func && pc == *func) {
+				in_func = true;
+				func_ret = ra;
+				func_sp = sp;
+			}
+		}
+		traced_stop_pc = stop_pc && pc == *stop_pc;
+		if (!open || (func && !in_func) || (priv && cur_priv != *priv))
+			return false;
+		if (pc_ranges.empty())
+			return true;
+		for (auto [lo, hi] : pc_ranges) {
+			if (pc >= lo && pc < hi)
+				return true;
+		}
+		return false;
+	}
+
+	// Call after each step
+	void after_step(bool retired) {
+		if (retired)
+			++instret;
+		if (traced_stop_pc || (stop_instret && instret >= *stop_instret))
+			open = false;
+	}
+};
+
+struct RVTraceWriter {
+	static const size_t BUF_SIZE = 1u << 20;
+
+	FILE *f;
+	std::vector<uint8_t> buf;
+	size_t used;
+	ux_t expected_pc;
+	bool first;
+	uint64_t records;
+
+	RVTraceWriter(FILE *f_);
+	~RVTraceWriter();
+
+	void write(const RVTraceRecord &r);
+	void flush();
+
+private:
+	template <typename T>
+	void put(T x) {
+		for (size_t i = 0; i < sizeof(T); ++i)
+			buf[used++] = (uint64_t)x >> (8 * i);
+	}
+};
+
+struct RVTraceReader {
+	static const size_t BUF_SIZE = 1u << 20;
+
+	FILE *f;
+	std::vector<uint8_t> buf;
+	size_t pos;
+	size_t fill;
+	ux_t expected_pc;
+	bool first;
+
+	RVTraceReader(FILE *f_) {
+		f = f_;
+		buf.resize(BUF_SIZE);
+		pos = 0;
+		fill = 0;
+		expected_pc = 0;
+		first = true;
+	}
+
+	// Check the file header. Returns false if this isn't an rvcpp trace.
+	bool read_header();
+
+	// Returns false at the end of the file (or on a truncated record)
+	bool read(RVTraceRecord &r);
+
+private:
+	bool get(void *data, size_t size);
+
+	template <typename T>
+	bool get(T &x) {
+		uint8_t bytes[sizeof(T)];
+		if (!get(bytes, sizeof(T)))
+			return false;
+		uint64_t v = 0;
+		for (size_t i = 0; i < sizeof(T); ++i)
+			v |= (uint64_t)bytes[i] << (8 * i);
+		x = (T)v;
+		return true;
+	}
+};
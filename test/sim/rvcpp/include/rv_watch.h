@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rv_types.h"
+
+// Data watchpoints. When attached to RVCore, every load and store (but not
+// instruction fetch) is checked against the watched address ranges, and the
+// first hit in each step is recorded for the caller to collect afterward.
+// Hits are reported after the accessing instruction has completed.
+//
+// There can be any number of watchpoints. Each access first tests one bit
+// in a bitmap of 4 KiB pages which hold a watchpoint of that access type
+// (read or write), so accesses outside of watched pages cost a shift and a
+// load. Only accesses to watched pages look at the watchpoints, and then
+// only those which overlap that page. Accesses are assumed to be naturally
+// aligned (misaligned accesses trap before reaching memory), so never
+// straddle a page.
+//
+// A watchpoint can also match on value: it then only hits if the data read
+// or written, zero-extended from the access size, equals the given value.
+
+struct RVWatchpoints {
+	static const uint PAGE_SHIFT = 12;
+	static const uint N_PAGES = 1u << (32 - PAGE_SHIFT);
+
+	enum Type {
+		WRITE  = 1,
+		READ   = 2,
+		ACCESS = 3
+	};
+
+	struct Watchpoint {
+		ux_t lo;
+		// Exclusive, and 64-bit so that a range can end at the top of memory
+		uint64_t hi;
+		uint type;
+		std::optional<ux_t> value;
+	};
+
+	struct Hit {
+		ux_t addr;
+		uint size;
+		// READ or WRITE: the type of the access
+		uint access;
+		ux_t data;
+		// The watchpoint which was hit
+		uint type;
+	};
+
+	std::vector<Watchpoint> list;
+
+	// Set by the first access to hit a watchpoint, cleared by the caller
+	std::optional<Hit> hit;
+
+	RVWatchpoints() {
+		read_pages.resize(N_PAGES / 64);
+		write_pages.resize(N_PAGES / 64);
+	}
+
+	void add(ux_t addr, uint64_t size, uint type, std::optional<ux_t> value = std::nullopt);
+
+	// Returns false if there is no such watchpoint
+	bool remove(ux_t addr, uint64_t size, uint type, std::optional<ux_t> value = std::nullopt);
+
+	void clear();
+
+	bool empty() const {
+		return list.empty();
+	}
+
+	// Parse a --watch argument, type:lo[:hi][=value], where type is r, w or
+	// rw. Returns false if invalid. `resolve` turns an address or symbol
+	// into an address. With no hi, a single 4-byte word is watched.
+	template <typename F>
+	bool add_spec(const std::string &spec, F resolve);
+
+	// One-line description of the current hit, e.g. for a stop message
+	std::string format_hit() const;
+
+	inline void read(ux_t addr, uint size, ux_t data) {
+		if (page_watched(read_pages, addr))
+			check(addr, size, READ, data);
+	}
+
+	inline void write(ux_t addr, uint size, ux_t data) {
+		if (page_watched(write_pages, addr))
+			check(addr, size, WRITE, data);
+	}
+
+private:
+	// One bit per page, for watchpoints which include reads/writes
+	std::vector<uint64_t> read_pages;
+	std::vector<uint64_t> write_pages;
+	// Indices into `list` of the watchpoints overlapping each watched page
+	std::unordered_map<ux_t, std::vector<uint>> page_index;
+
+	static inline bool page_watched(const std::vector<uint64_t> &pages, ux_t addr) {
+		ux_t page = addr >> PAGE_SHIFT;
+		return pages[page / 64] >> (page % 64) & 1u;
+	}
+
+	void index(uint i);
+	void check(ux_t addr, uint size, uint access, ux_t data);
+};
+
+template <typename F>
+bool RVWatchpoints::add_spec(const std::string &spec, F resolve) {
+	size_t colon = spec.find(':');
+	if (colon == std::string::npos)
+		return false;
+	std::string type_str = spec.substr(0, colon);
+	uint type = type_str == "r" ? READ : type_str == "w" ? WRITE : type_str == "rw" ? ACCESS : 0;
+	if (!type)
+		return false;
+	std::string range = spec.substr(colon + 1);
+	std::optional<ux_t> value;
+	size_t eq = range.find('=');
+	if (eq != std::string::npos) {
+		ux_t v;
+		if (!resolve(range.substr(eq + 1), v))
+			return false;
+		value = v;
+		range = range.substr(0, eq);
+	}
+	ux_t lo;
+	uint64_t hi;
+	colon = range.find(':');
+	if (!resolve(range.substr(0, colon), lo))
+		return false;
+	if (colon == std::string::npos) {
+		hi = (uint64_t)lo + 4;
+	} else {
+		ux_t h;
+		if (!resolve(range.substr(colon + 1), h) || h <= lo)
+			return false;
+		hi = h;
+	}
+	add(lo, hi - lo, type, value);
+	return true;
+}
@@ -1,5 +1,8 @@
+#include <algorithm>
 #include <cassert>
+#include <cinttypes>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <tuple>
@@ -7,8 +10,26 @@
 
 #include "rv_types.h"
 #include "rv_csr.h"
+#include "encoding/rv_csr.h"
 #include "rv_core.h"
 #include "rv_mem.h"
+#include "rv_timing.h"
+#include "rv_irq_stats.h"
+#include "rv_power.h"
+#include "rv_hpm.h"
+#include "rv_elf.h"
+#include "rv_profile.h"
+#include "rv_callgraph.h"
+#include "rv_memstats.h"
+#include "rv_instr_mix.h"
+#include "rv_simpoint.h"
+#include "rv_snapshot.h"
+#include "rv_trace.h"
+#include "rv_state_hash.h"
+#include "rv_reverse.h"
+#include "rv_fault.h"
+#include "rv_stimulus.h"
+#include "rv_gdb.h"
 
 // Minimal RISC-V interpreter, supporting:
 // - RV32I
@@ -22,6 +43,7 @@
 // - Zbkb
 // - Zcmp
 // - M-mode traps
+// - Xh3irq external interrupt controller
 
 #define RAM_SIZE_DEFAULT (16u * (1u << 20))
 #define RAM_BASE         0u
@@ -38,7 +60,183 @@ const char *help_str =
 "    --cpuret         : Testbench's return code is the return code written to\n"
 "                       IO_EXIT by the CPU, or -1 if timed out.\n"
 "    --memsize n      : Memory size in units of 1024 bytes, default is 16 MiB\n"
+"    --irqs n         : Number of external IRQs implemented by the Xh3irq\n"
+"                       controller, default 32, max 512. The first 128 can be\n"
+"                       driven by the testbench IO registers.\n"
 "    --trace          : Print out execution tracing info\n"
+"    --disasm         : Add disassembly to each instruction in --trace and\n"
+"                       --decode-trace output.\n"
+"    --trace-bin x.rvt: Write execution tracing info to x.rvt in a compact binary\n"
+"                       format. Much faster than --trace for long runs.\n"
+"    --decode-trace x.rvt\n"
+"                     : Print a binary trace from --trace-bin in the same format\n"
+"                       as --trace, then exit. With --symbols, a label is\n"
+"                       printed whenever execution moves to another function.\n"
+"    --trace-window a:b\n"
+"                     : Only trace from instruction a (counting retired\n"
+"                       instructions from 0) up to but not including\n"
+"                       instruction b. Either may be omitted.\n"
+"    --trace-after-cycle n\n"
+"                     : Start tracing at cycle n.\n"
+"    --trace-from x   : Start tracing when the instruction at address or symbol\n"
+"                       x is executed.\n"
+"    --trace-until x  : Stop tracing after the instruction at x is executed.\n"
+"                       Tracing restarts the next time --trace-from is hit.\n"
+"    --trace-range x  : Only trace instructions within an address range, given\n"
+"                       as lo:hi or the name of a sized symbol. Can be passed\n"
+"                       multiple times.\n"
+"    --trace-func x   : Only trace calls to function x, including its callees,\n"
+"                       from entry until it returns to its caller.\n"
+"    --trace-priv p   : Only trace while in privilege mode p (m or u).\n"
+"                       All --trace-* conditions apply to --trace and --trace-bin\n"
+"                       output, and untraced steps run at full speed.\n"
+"    --flight-recorder n\n"
+"                     : Keep trace records for the last n steps in memory, and\n"
+"                       print them to stderr when a --flight-trigger condition\n"
+"                       occurs.\n"
+"    --flight-trigger t\n"
+"                     : Dump condition for --flight-recorder. Can be passed\n"
+"                       multiple times. One of: exception, exception=<cause>,\n"
+"                       irq, exit (nonzero exit code), timeout (--cycles limit\n"
+"                       reached), watch (--watch hit), pc=<address or symbol>.\n"
+"                       Default is exception, exit, timeout and watch.\n"
+"    --state-hash n   : Keep a rolling hash of retired instruction PCs and GPR\n"
+"                       writes, and print it every n retired instructions. Same\n"
+"                       format as tb_cxxrtl --state-hash: compare the two with\n"
+"                       scripts/state_hash_bisect.py.\n"
+"    --state-hash-range a:b\n"
+"                     : Only print --state-hash checkpoints from instruction a\n"
+"                       to instruction b inclusive. Either may be omitted.\n"
+"    --state-hash-out x\n"
+"                     : Write --state-hash checkpoints to x instead of stderr.\n"
+"    --timing         : Enable the cycle timing model. mcycle, mtime and --cycles\n"
+"                       then count modelled cycles rather than instructions, and\n"
+"                       a cycle breakdown is printed to stderr on exit.\n"
+"    --1port          : Model a single-ported core (hazard3_cpu_1port), where\n"
+"                       fetch and load/store share one bus. Implies --timing.\n"
+"    --irqstats       : Record IRQ latency (source assertion to handler entry)\n"
+"                       and handler duration (entry to mret) for each IRQ cause,\n"
+"                       and print histograms to stderr on exit.\n"
+"    --counters       : Print totals of each performance counter event, and the\n"
+"                       final value of each mhpmcounter programmed by firmware,\n"
+"                       to stderr on exit. Event numbers for mhpmevent3..31 are\n"
+"                       listed in rv_hpm.h.\n"
+"    --power          : Model WFI/h3.block sleep states as controlled by msleep,\n"
+"                       including wakeup latency, and print time spent in each\n"
+"                       power state and at each sleep site to stderr on exit.\n"
+"    --power-timeline x.txt\n"
+"                     : Write a timeline of power state transitions to x.txt.\n"
+"                       Implies --power.\n"
+"    --profile        : Count instructions (and cycles, with --timing) executed\n"
+"                       at each PC in the loaded binary, and print the hottest\n"
+"                       functions and basic blocks to stderr on exit.\n"
+"    --symbols x.elf  : Read function names from the symbol table of x.elf, for\n"
+"                       --profile, --flamegraph and --decode-trace. Usually the\n"
+"                       ELF the binary was built from.\n"
+"    --flamegraph x.folded\n"
+"                     : Track calls, returns and traps on a shadow call stack,\n"
+"                       write instruction counts (cycles, with --timing) per call\n"
+"                       path to x.folded in folded-stack format, and print the\n"
+"                       hottest call paths to stderr on exit.\n"
+"    --heatmap x.txt  : Count reads, writes and instruction fetches per cache\n"
+"                       line, and track the minimum sp at each interrupt nesting\n"
+"                       level. Per-line counts are written to x.txt, and a\n"
+"                       summary is printed to stderr on exit.\n"
+"    --heatmap-line n : Line size in bytes for --heatmap, default 32. Must be a\n"
+"                       power of two.\n"
+"    --imix           : Print the dynamic instruction mix by mnemonic and\n"
+"                       extension, 16-bit vs 32-bit fetch bytes, fetch bytes\n"
+"                       saved by Zcmp, and fetch bytes per function, to stderr\n"
+"                       on exit.\n"
+"    --bbv prefix     : Record a basic block vector for every interval of\n"
+"                       retired instructions, and choose representative\n"
+"                       intervals by clustering (SimPoint). Writes prefix.bb,\n"
+"                       prefix.simpoints and prefix.weights.\n"
+"    --bbv-interval n : Interval length in instructions, default 10000000.\n"
+"    --simpoint-k n   : Maximum number of clusters for --bbv, default 10.\n"
+"    --save-snapshot x.snap\n"
+"                     : Save the core, RAM and IO state to x.snap when the run\n"
+"                       stops, either by reaching --save-snapshot-at or the\n"
+"                       --cycles limit. Not saved if the CPU exits. Includes\n"
+"                       the --timing and --power model state, if enabled.\n"
+"    --save-snapshot-at x\n"
+"                     : Stop the run and save the --save-snapshot and/or\n"
+"                       --save-handoff files just before first executing\n"
+"                       address or symbol x.\n"
+"    --save-handoff prefix\n"
+"                     : Like --save-snapshot, but save the architectural state\n"
+"                       as prefix.txt and prefix.bin, for tb_cxxrtl\n"
+"                       --load-handoff to continue the run on the RTL.\n"
+"    --load-snapshot x.snap\n"
+"                     : Start from the state saved in x.snap instead of reset.\n"
+"                       Must be run with the same --memsize as the save. Can't\n"
+"                       be combined with --bin.\n"
+"    --reverse n      : Checkpoint the simulation every n steps, with an undo log\n"
+"                       of RAM writes between checkpoints, so that any earlier\n"
+"                       step can be revisited by --reverse-query. Not\n"
+"                       compatible with --timing or --power.\n"
+"    --reverse-query q\n"
+"                     : When the run stops, move through the execution history\n"
+"                       and print the resulting step to stderr. Can be passed\n"
+"                       multiple times, each starting where the last finished.\n"
+"                       Implies --reverse 100000 if not given. One of:\n"
+"                         back[=n]     : step back n steps, default 1\n"
+"                         forward[=n]  : step forward n steps, default 1\n"
+"                         write=x      : go back to the last write to x, where\n"
+"                                        x is lo:hi, an address (one byte) or\n"
+"                                        a sized symbol, e.g. a variable\n"
+"                         reg=r        : go back to the last change of GPR r\n"
+"                         present      : return to the end of the run\n"
+"    --fault-campaign n\n"
+"                     : Run a fault injection campaign of n faults instead of a\n"
+"                       normal run. The simulation runs to the injection point,\n"
+"                       then a golden run from there must exit within --cycles\n"
+"                       steps. Each fault runs in a fork()ed copy of the\n"
+"                       simulation at the injection point, and is classified as\n"
+"                       masked, detected (unexpected exception), hang, sdc\n"
+"                       (wrong exit code or output) or error. Results are\n"
+"                       summarised on stderr. Not compatible with --power,\n"
+"                       --trace-bin, --flamegraph, --heatmap or --bbv.\n"
+"    --fault-at n     : Injection point, in steps from the start (or from\n"
+"                       --load-snapshot). Default 0.\n"
+"    --fault-window n : Inject each fault at a random step up to n steps after\n"
+"                       the injection point. Default 1.\n"
+"    --fault-types t  : Comma-separated fault types to inject, from: gpr (flip a\n"
+"                       GPR bit), ram (flip a RAM bit), skip (skip an\n"
+"                       instruction), csr (flip a bit in a trap/PMP CSR).\n"
+"                       Default is all of them.\n"
+"    --fault-ram lo:hi: Only flip RAM bits in this range. Can be passed\n"
+"                       multiple times. Default is all nonzero 4 KiB pages.\n"
+"    --fault-seed n   : Random seed for choosing faults. Default 0.\n"
+"    --fault-jobs n   : Number of faults to run in parallel. Default is the\n"
+"                       number of host CPUs.\n"
+"    --fault-log x.csv: Write the fault and outcome of each injection to x.csv.\n"
+"    --record-stimulus x.rvs\n"
+"                     : Log every change of the IRQ lines, and the result of\n"
+"                       every load from a device (not RAM), to x.rvs.\n"
+"    --replay-stimulus x.rvs\n"
+"                     : Take IRQ lines and device load results from a log made\n"
+"                       by --record-stimulus instead of the devices. Must start\n"
+"                       from the same binary (or --load-snapshot) as the\n"
+"                       recording. Not compatible with --reverse or\n"
+"                       --fault-campaign.\n"
+"    --watch type:lo[:hi][=value]\n"
+"                     : Stop the run when a load (type r), store (w) or either\n"
+"                       (rw) touches addresses lo to hi - 1 (a word at lo if\n"
+"                       hi is omitted), and report the access and its PC.\n"
+"                       With =value, only when that value is read/written.\n"
+"                       Addresses can be symbols. Can be passed multiple times.\n"
+"                       Under --gdb, hits stop into the debugger instead.\n"
+"    --gdb port|path  : Wait for a GDB connection on a localhost TCP port, or a\n"
+"                       Unix socket path, and run under its control. The\n"
+"                       --cycles limit still applies, and ends the session.\n"
+"                       Not compatible with --reverse, --fault-campaign,\n"
+"                       --save-snapshot-at or stimulus record/replay.\n"
+"    --simpoint-snapshots prefix\n"
+"                     : Read prefix.simpoints from an earlier --bbv run with the\n"
+"                       same binary and options, and save a snapshot of the\n"
+"                       core at the start of each chosen interval, to\n"
+"                       prefix.<interval>.snap.\n"
 ;
 
 void exit_help(std::string errtext = "") {
@@ -46,6 +244,26 @@ void exit_help(std::string errtext = "") {
 	exit(-1);
 }
 
+int decode_trace(const std::string &path, const RVSymbolTable &symbols, bool disasm) {
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f) {
+		std::cerr << "Failed to open " << path << "\n";
+		return -1;
+	}
+	RVTraceReader reader(f);
+	if (!reader.read_header()) {
+		std::cerr << path << " is not an rvcpp binary trace\n";
+		fclose(f);
+		return -1;
+	}
+	RVTracePrinter printer(symbols, disasm);
+	RVTraceRecord rec;
+	while (reader.read(rec))
+		printer.print(stdout, rec);
+	fclose(f);
+	return 0;
+}
+
 int main(int argc, char **argv) {
 	if (argc < 2)
 		exit_help();
@@ -53,10 +271,60 @@ int main(int argc, char **argv) {
 	std::vector<std::tuple<uint32_t, uint32_t>> dump_ranges;
 	int64_t max_cycles = 100000;
 	uint32_t ram_size = RAM_SIZE_DEFAULT;
+	uint num_irqs = 32;
 	bool load_bin = false;
 	std::string bin_path;
 	bool trace_execution = false;
+	std::string trace_bin_path;
+	std::string decode_trace_path;
+	bool trace_disasm = false;
+	std::string trace_window;
+	std::string trace_from;
+	std::string trace_until;
+	std::vector<std::string> trace_ranges;
+	std::string trace_func;
+	std::string trace_priv;
+	int64_t trace_after_cycle = -1;
+	size_t flight_recorder_depth = 0;
+	std::vector<std::string> flight_triggers;
+	uint64_t state_hash_interval = 0;
+	std::string state_hash_range;
+	std::string state_hash_path;
+	std::string save_snapshot_path;
+	std::string save_snapshot_at;
+	std::string save_handoff_prefix;
+	std::string load_snapshot_path;
+	uint64_t reverse_interval = 0;
+	uint64_t fault_count = 0;
+	uint64_t fault_at = 0;
+	uint64_t fault_window = 1;
+	std::string fault_types;
+	std::vector<std::string> fault_ram_ranges;
+	uint64_t fault_seed = 0;
+	uint fault_jobs = 0;
+	std::string fault_log_path;
+	std::string record_stimulus_path;
+	std::string gdb_spec;
+	std::vector<std::string> watch_specs;
+	std::string replay_stimulus_path;
+	std::vector<std::string> reverse_queries;
 	bool propagate_return_code = false;
+	bool enable_timing = false;
+	uint timing_bus_ports = RVTiming::PORTS_2;
+	bool enable_irq_stats = false;
+	bool enable_counters = false;
+	bool enable_power = false;
+	std::string power_timeline_path;
+	bool enable_profile = false;
+	std::string symbols_path;
+	std::string flamegraph_path;
+	std::string heatmap_path;
+	uint heatmap_line_size = 32;
+	bool enable_imix = false;
+	std::string bbv_prefix;
+	uint64_t bbv_interval = 10000000;
+	uint simpoint_max_k = 10;
+	std::string simpoint_snapshot_prefix;
 
 	for (int i = 1; i < argc; ++i) {
 		std::string s(argv[i]);
@@ -94,27 +362,489 @@ int main(int argc, char **argv) {
 			ram_size = 1024 * std::stol(argv[i + 1], 0, 0);
 			i += 1;
 		}
+		else if (s == "--irqs") {
+			if (argc - i < 2)
+				exit_help("Option --irqs requires an argument\n");
+			num_irqs = std::stoul(argv[i + 1], 0, 0);
+			if (num_irqs < 1 || num_irqs > RVIRQCtrl::MAX_IRQS)
+				exit_help("Option --irqs must be between 1 and 512\n");
+			i += 1;
+		}
 		else if (s == "--trace") {
 			trace_execution = true;
 		}
+		else if (s == "--disasm") {
+			trace_disasm = true;
+		}
+		else if (s == "--trace-window") {
+			if (argc - i < 2)
+				exit_help("Option --trace-window requires an argument\n");
+			trace_window = argv[i + 1];
+			if (trace_window.find(':') == std::string::npos)
+				exit_help("Option --trace-window must be of the form a:b\n");
+			i += 1;
+		}
+		else if (s == "--trace-after-cycle") {
+			if (argc - i < 2)
+				exit_help("Option --trace-after-cycle requires an argument\n");
+			trace_after_cycle = std::stoll(argv[i + 1], 0, 0);
+			i += 1;
+		}
+		else if (s == "--trace-from") {
+			if (argc - i < 2)
+				exit_help("Option --trace-from requires an argument\n");
+			trace_from = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--trace-until") {
+			if (argc - i < 2)
+				exit_help("Option --trace-until requires an argument\n");
+			trace_until = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--trace-range") {
+			if (argc - i < 2)
+				exit_help("Option --trace-range requires an argument\n");
+			trace_ranges.push_back(argv[i + 1]);
+			i += 1;
+		}
+		else if (s == "--trace-func") {
+			if (argc - i < 2)
+				exit_help("Option --trace-func requires an argument\n");
+			trace_func = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--trace-priv") {
+			if (argc - i < 2)
+				exit_help("Option --trace-priv requires an argument\n");
+			trace_priv = argv[i + 1];
+			if (trace_priv != "m" && trace_priv != "u")
+				exit_help("Option --trace-priv must be m or u\n");
+			i += 1;
+		}
+		else if (s == "--trace-bin") {
+			if (argc - i < 2)
+				exit_help("Option --trace-bin requires an argument\n");
+			trace_bin_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--decode-trace") {
+			if (argc - i < 2)
+				exit_help("Option --decode-trace requires an argument\n");
+			decode_trace_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--flight-recorder") {
+			if (argc - i < 2)
+				exit_help("Option --flight-recorder requires an argument\n");
+			flight_recorder_depth = std::stoul(argv[i + 1], 0, 0);
+			if (flight_recorder_depth == 0)
+				exit_help("Option --flight-recorder must be nonzero\n");
+			i += 1;
+		}
+		else if (s == "--flight-trigger") {
+			if (argc - i < 2)
+				exit_help("Option --flight-trigger requires an argument\n");
+			flight_triggers.push_back(argv[i + 1]);
+			i += 1;
+		}
+		else if (s == "--state-hash") {
+			if (argc - i < 2)
+				exit_help("Option --state-hash requires an argument\n");
+			state_hash_interval = std::stoull(argv[i + 1], 0, 0);
+			if (state_hash_interval == 0)
+				exit_help("Option --state-hash must be nonzero\n");
+			i += 1;
+		}
+		else if (s == "--state-hash-range") {
+			if (argc - i < 2)
+				exit_help("Option --state-hash-range requires an argument\n");
+			state_hash_range = argv[i + 1];
+			if (state_hash_range.find(':') == std::string::npos)
+				exit_help("Option --state-hash-range must be of the form a:b\n");
+			i += 1;
+		}
+		else if (s == "--state-hash-out") {
+			if (argc - i < 2)
+				exit_help("Option --state-hash-out requires an argument\n");
+			state_hash_path = argv[i + 1];
+			i += 1;
+		}
 		else if (s == "--cpuret") {
 			propagate_return_code = true;
 		}
+		else if (s == "--timing") {
+			enable_timing = true;
+		}
+		else if (s == "--1port") {
+			enable_timing = true;
+			timing_bus_ports = RVTiming::PORTS_1;
+		}
+		else if (s == "--irqstats") {
+			enable_irq_stats = true;
+		}
+		else if (s == "--counters") {
+			enable_counters = true;
+		}
+		else if (s == "--power") {
+			enable_power = true;
+		}
+		else if (s == "--power-timeline") {
+			if (argc - i < 2)
+				exit_help("Option --power-timeline requires an argument\n");
+			enable_power = true;
+			power_timeline_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--profile") {
+			enable_profile = true;
+		}
+		else if (s == "--symbols") {
+			if (argc - i < 2)
+				exit_help("Option --symbols requires an argument\n");
+			symbols_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--flamegraph") {
+			if (argc - i < 2)
+				exit_help("Option --flamegraph requires an argument\n");
+			flamegraph_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--heatmap") {
+			if (argc - i < 2)
+				exit_help("Option --heatmap requires an argument\n");
+			heatmap_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--imix") {
+			enable_imix = true;
+		}
+		else if (s == "--bbv") {
+			if (argc - i < 2)
+				exit_help("Option --bbv requires an argument\n");
+			bbv_prefix = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--bbv-interval") {
+			if (argc - i < 2)
+				exit_help("Option --bbv-interval requires an argument\n");
+			bbv_interval = std::stoull(argv[i + 1], 0, 0);
+			if (bbv_interval == 0)
+				exit_help("Option --bbv-interval must be nonzero\n");
+			i += 1;
+		}
+		else if (s == "--simpoint-k") {
+			if (argc - i < 2)
+				exit_help("Option --simpoint-k requires an argument\n");
+			simpoint_max_k = std::stoul(argv[i + 1], 0, 0);
+			if (simpoint_max_k == 0)
+				exit_help("Option --simpoint-k must be nonzero\n");
+			i += 1;
+		}
+		else if (s == "--save-snapshot") {
+			if (argc - i < 2)
+				exit_help("Option --save-snapshot requires an argument\n");
+			save_snapshot_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--save-snapshot-at") {
+			if (argc - i < 2)
+				exit_help("Option --save-snapshot-at requires an argument\n");
+			save_snapshot_at = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--save-handoff") {
+			if (argc - i < 2)
+				exit_help("Option --save-handoff requires an argument\n");
+			save_handoff_prefix = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--load-snapshot") {
+			if (argc - i < 2)
+				exit_help("Option --load-snapshot requires an argument\n");
+			load_snapshot_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--reverse") {
+			if (argc - i < 2)
+				exit_help("Option --reverse requires an argument\n");
+			reverse_interval = std::stoull(argv[i + 1], 0, 0);
+			if (reverse_interval == 0)
+				exit_help("Option --reverse must be nonzero\n");
+			i += 1;
+		}
+		else if (s == "--reverse-query") {
+			if (argc - i < 2)
+				exit_help("Option --reverse-query requires an argument\n");
+			reverse_queries.push_back(argv[i + 1]);
+			i += 1;
+		}
+		else if (s == "--fault-campaign") {
+			if (argc - i < 2)
+				exit_help("Option --fault-campaign requires an argument\n");
+			fault_count = std::stoull(argv[i + 1], 0, 0);
+			i += 1;
+		}
+		else if (s == "--fault-at") {
+			if (argc - i < 2)
+				exit_help("Option --fault-at requires an argument\n");
+			fault_at = std::stoull(argv[i + 1], 0, 0);
+			i += 1;
+		}
+		else if (s == "--fault-window") {
+			if (argc - i < 2)
+				exit_help("Option --fault-window requires an argument\n");
+			fault_window = std::stoull(argv[i + 1], 0, 0);
+			if (fault_window == 0)
+				exit_help("Option --fault-window must be nonzero\n");
+			i += 1;
+		}
+		else if (s == "--fault-types") {
+			if (argc - i < 2)
+				exit_help("Option --fault-types requires an argument\n");
+			fault_types = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--fault-ram") {
+			if (argc - i < 2)
+				exit_help("Option --fault-ram requires an argument\n");
+			fault_ram_ranges.push_back(argv[i + 1]);
+			i += 1;
+		}
+		else if (s == "--fault-seed") {
+			if (argc - i < 2)
+				exit_help("Option --fault-seed requires an argument\n");
+			fault_seed = std::stoull(argv[i + 1], 0, 0);
+			i += 1;
+		}
+		else if (s == "--fault-jobs") {
+			if (argc - i < 2)
+				exit_help("Option --fault-jobs requires an argument\n");
+			fault_jobs = std::stoul(argv[i + 1], 0, 0);
+			if (fault_jobs == 0)
+				exit_help("Option --fault-jobs must be nonzero\n");
+			i += 1;
+		}
+		else if (s == "--fault-log") {
+			if (argc - i < 2)
+				exit_help("Option --fault-log requires an argument\n");
+			fault_log_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--record-stimulus") {
+			if (argc - i < 2)
+				exit_help("Option --record-stimulus requires an argument\n");
+			record_stimulus_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--replay-stimulus") {
+			if (argc - i < 2)
+				exit_help("Option --replay-stimulus requires an argument\n");
+			replay_stimulus_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--watch") {
+			if (argc - i < 2)
+				exit_help("Option --watch requires an argument\n");
+			watch_specs.push_back(argv[i + 1]);
+			i += 1;
+		}
+		else if (s == "--gdb") {
+			if (argc - i < 2)
+				exit_help("Option --gdb requires an argument\n");
+			gdb_spec = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--simpoint-snapshots") {
+			if (argc - i < 2)
+				exit_help("Option --simpoint-snapshots requires an argument\n");
+			simpoint_snapshot_prefix = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--heatmap-line") {
+			if (argc - i < 2)
+				exit_help("Option --heatmap-line requires an argument\n");
+			heatmap_line_size = std::stoul(argv[i + 1], 0, 0);
+			if (heatmap_line_size < 4 || (heatmap_line_size & (heatmap_line_size - 1)))
+				exit_help("Option --heatmap-line must be a power of two, at least 4\n");
+			i += 1;
+		}
 		else {
 			std::cerr << "Unrecognised argument " << s << "\n";
 			exit_help("");
 		}
 	}
+	if (load_bin && !load_snapshot_path.empty())
+		exit_help("Can't specify both --bin and --load-snapshot\n");
+	if (!save_snapshot_at.empty() && save_snapshot_path.empty() && save_handoff_prefix.empty())
+		exit_help("Option --save-snapshot-at requires --save-snapshot or --save-handoff\n");
+	if (!reverse_queries.empty() && !reverse_interval)
+		reverse_interval = 100000;
+	if (reverse_interval && (enable_timing || enable_power))
+		exit_help("Option --reverse can't be used with --timing or --power\n");
+	if (fault_count && (enable_power || reverse_interval))
+		exit_help("Option --fault-campaign can't be used with --power or --reverse\n");
+	if (fault_count && (!trace_bin_path.empty() || !flamegraph_path.empty() || !heatmap_path.empty() ||
+			!bbv_prefix.empty()))
+		exit_help("Option --fault-campaign can't be used with --trace-bin, --flamegraph, --heatmap or --bbv\n");
+	if (!record_stimulus_path.empty() && !replay_stimulus_path.empty())
+		exit_help("Can't specify both --record-stimulus and --replay-stimulus\n");
+	bool enable_stimulus = !record_stimulus_path.empty() || !replay_stimulus_path.empty();
+	if (enable_stimulus && (reverse_interval || fault_count))
+		exit_help("Stimulus record/replay can't be used with --reverse or --fault-campaign\n");
+	if (!watch_specs.empty() && fault_count)
+		exit_help("Option --watch can't be used with --fault-campaign\n");
+	if (!gdb_spec.empty() && (reverse_interval || fault_count || enable_stimulus || !save_snapshot_at.empty()))
+		exit_help("Option --gdb can't be used with --reverse, --fault-campaign, --save-snapshot-at or stimulus record/replay\n");
 
 	TBMemIO io(trace_execution);
 	MemMap32 mem;
 	mem.add(0x80000000u, 0x1000, &io);
+	RVStimulus stimulus(mem);
+
+	RVCore core(enable_stimulus ? (MemBase32&)stimulus : mem, RAM_BASE + 0x40, RAM_BASE, ram_size);
+	core.trace_disasm = trace_disasm;
+	core.csr.set_num_irqs(num_irqs);
+
+	RVTiming timing(timing_bus_ports);
+	if (enable_timing)
+		core.timing = &timing;
+
+	RVIRQStats irq_stats;
 
-	RVCore core(mem, RAM_BASE + 0x40, RAM_BASE, ram_size);
+	RVHeatmap heatmap(RAM_BASE, heatmap_path.empty() ? 0 : ram_size, heatmap_line_size);
+	heatmap.add_region("TBIO", TBIO_BASE, 0x1000);
+	RVStackStats stack_stats;
+	if (!heatmap_path.empty())
+		core.heatmap = &heatmap;
+
+	RVHPMTotals hpm_totals;
+
+	RVPower power;
+	if (!power_timeline_path.empty()) {
+		power.timeline = fopen(power_timeline_path.c_str(), "w");
+		if (!power.timeline) {
+			std::cerr << "Failed to open " << power_timeline_path << " for writing\n";
+			return -1;
+		}
+	}
+
+	RVSymbolTable symbols;
+	if (!symbols_path.empty() && !symbols.load(symbols_path))
+		return -1;
+
+	if (!decode_trace_path.empty())
+		return decode_trace(decode_trace_path, symbols, trace_disasm);
+
+	FILE *trace_bin_file = nullptr;
+	if (!trace_bin_path.empty()) {
+		trace_bin_file = fopen(trace_bin_path.c_str(), "wb");
+		if (!trace_bin_file) {
+			std::cerr << "Failed to open " << trace_bin_path << " for writing\n";
+			return -1;
+		}
+	}
+	RVTraceWriter trace_writer(trace_bin_file);
+	if (trace_bin_file)
+		core.trace_writer = &trace_writer;
+
+	RVTraceFilter trace_filter;
+	if (!trace_window.empty()) {
+		size_t colon = trace_window.find(':');
+		std::string start = trace_window.substr(0, colon);
+		std::string stop = trace_window.substr(colon + 1);
+		if (!start.empty())
+			trace_filter.start_instret = std::stoull(start, 0, 0);
+		if (!stop.empty())
+			trace_filter.stop_instret = std::stoull(stop, 0, 0);
+	}
+	if (trace_after_cycle >= 0)
+		trace_filter.start_cycle = trace_after_cycle;
+	ux_t trace_addr;
+	if (!trace_from.empty()) {
+		if (!symbols.resolve(trace_from, trace_addr)) {
+			std::cerr << "Unknown address or symbol " << trace_from << "\n";
+			return -1;
+		}
+		trace_filter.start_pc = trace_addr;
+	}
+	if (!trace_until.empty()) {
+		if (!symbols.resolve(trace_until, trace_addr)) {
+			std::cerr << "Unknown address or symbol " << trace_until << "\n";
+			return -1;
+		}
+		trace_filter.stop_pc = trace_addr;
+	}
+	for (const std::string &r : trace_ranges) {
+		size_t colon = r.find(':');
+		ux_t lo, hi;
+		if (colon != std::string::npos) {
+			if (!symbols.resolve(r.substr(0, colon), lo) || !symbols.resolve(r.substr(colon + 1), hi)) {
+				std::cerr << "Invalid --trace-range " << r << "\n";
+				return -1;
+			}
+		} else {
+			const RVSymbolTable::Symbol *sym = symbols.find(r);
+			if (!sym || !sym->size) {
+				std::cerr << "--trace-range " << r << " is not a symbol with a size\n";
+				return -1;
+			}
+			lo = sym->addr;
+			hi = sym->addr + sym->size;
+		}
+		trace_filter.pc_ranges.push_back({lo, hi});
+	}
+	if (!trace_func.empty()) {
+		if (!symbols.resolve(trace_func, trace_addr)) {
+			std::cerr << "Unknown address or symbol " << trace_func << "\n";
+			return -1;
+		}
+		trace_filter.func = trace_addr;
+	}
+	if (!trace_priv.empty())
+		trace_filter.priv = trace_priv == "m" ? PRV_M : PRV_U;
+	bool filter_trace = trace_filter.enabled() && (trace_execution || trace_bin_file);
+
+	RVFlightRecorder flight_recorder(std::max<size_t>(flight_recorder_depth, 1), stderr, symbols);
+	for (const std::string &t : flight_triggers) {
+		if (!flight_recorder.add_trigger(t)) {
+			std::cerr << "Invalid --flight-trigger " << t << "\n";
+			return -1;
+		}
+	}
+	if (!flight_recorder.has_triggers()) {
+		flight_recorder.add_trigger("exception");
+		flight_recorder.add_trigger("exit");
+		flight_recorder.add_trigger("timeout");
+		flight_recorder.add_trigger("watch");
+	}
+	if (flight_recorder_depth)
+		core.flight_recorder = &flight_recorder;
+
+	FILE *state_hash_file = stderr;
+	if (!state_hash_path.empty()) {
+		state_hash_file = fopen(state_hash_path.c_str(), "w");
+		if (!state_hash_file) {
+			std::cerr << "Failed to open " << state_hash_path << " for writing\n";
+			return -1;
+		}
+	}
+	RVStateHash state_hash(std::max<uint64_t>(state_hash_interval, 1), state_hash_file);
+	if (!state_hash_range.empty()) {
+		size_t colon = state_hash_range.find(':');
+		std::string start = state_hash_range.substr(0, colon);
+		std::string stop = state_hash_range.substr(colon + 1);
+		if (!start.empty())
+			state_hash.print_start = std::stoull(start, 0, 0);
+		if (!stop.empty())
+			state_hash.print_end = std::stoull(stop, 0, 0);
+	}
 
+	std::streamsize bin_size = 0;
 	if (load_bin) {
 		std::ifstream fd(bin_path, std::ios::binary | std::ios::ate);
-		std::streamsize bin_size = fd.tellg();
+		bin_size = fd.tellg();
 		if (bin_size > ram_size) {
 			std::cerr << "Binary file (" << bin_size << " bytes) is larger than memory (" << ram_size << " bytes)\n";
 			return -1;
@@ -122,24 +852,317 @@ int main(int argc, char **argv) {
 		fd.seekg(0, std::ios::beg);
 		fd.read((char*)core.ram, bin_size);
 	}
+	if (!load_snapshot_path.empty() && !rv_load_snapshot(load_snapshot_path, core, io, enable_power ? &power : nullptr))
+		return -1;
 
-	int64_t cyc;
-	int rc = 0;
-	try {
-		for (cyc = 0; cyc < max_cycles; ++cyc) {
-			core.step(trace_execution);
-			io.step();
+	if (!record_stimulus_path.empty() && !stimulus.open(record_stimulus_path, RVStimulus::RECORD))
+		return -1;
+	if (!replay_stimulus_path.empty() && !stimulus.open(replay_stimulus_path, RVStimulus::REPLAY))
+		return -1;
+
+	RVReverse reverse(core, io, std::max<uint64_t>(reverse_interval, 1));
+	if (reverse_interval)
+		core.reverse = &reverse;
+
+	std::optional<ux_t> save_snapshot_pc;
+	if (!save_snapshot_at.empty()) {
+		ux_t addr;
+		if (!symbols.resolve(save_snapshot_at, addr)) {
+			std::cerr << "Unknown address or symbol " << save_snapshot_at << "\n";
+			return -1;
+		}
+		save_snapshot_pc = addr;
+	}
+
+	// Only the loaded image is profiled: anything else is lumped together
+	RVProfile profile(RAM_BASE, enable_profile ? bin_size : 0, enable_timing);
+
+	RVInstrMix imix(RAM_BASE, enable_imix ? bin_size : 0);
+
+	RVSimPoint simpoint(bbv_interval);
+
+	// Snapshots are taken after the last instruction of the previous interval
+	std::vector<uint64_t> snapshot_intervals;
+	if (!simpoint_snapshot_prefix.empty()) {
+		if (!RVSimPoint::read_simpoints(simpoint_snapshot_prefix + ".simpoints", snapshot_intervals))
+			return -1;
+		std::sort(snapshot_intervals.begin(), snapshot_intervals.end());
+	}
+	auto next_snapshot = snapshot_intervals.begin();
+	uint64_t instret = 0;
+	auto save_simpoint_snapshot = [&]() {
+		for (; next_snapshot != snapshot_intervals.end() && *next_snapshot * bbv_interval == instret; ++next_snapshot) {
+			rv_save_snapshot(simpoint_snapshot_prefix + "." + std::to_string(*next_snapshot) + ".snap", core, io,
+				enable_power ? &power : nullptr);
+		}
+	};
+	save_simpoint_snapshot();
+
+	RVCallGraph callgraph(symbols, enable_timing);
+	FILE *flamegraph_file = nullptr;
+	if (!flamegraph_path.empty()) {
+		flamegraph_file = fopen(flamegraph_path.c_str(), "w");
+		if (!flamegraph_file) {
+			std::cerr << "Failed to open " << flamegraph_path << " for writing\n";
+			return -1;
+		}
+	}
+
+	if (fault_count) {
+		RVFaultCampaign campaign(core, io);
+		campaign.count = fault_count;
+		campaign.window = fault_window;
+		campaign.rng.seed(fault_seed);
+		if (fault_jobs)
+			campaign.jobs = fault_jobs;
+		if (!fault_types.empty() && !campaign.set_types(fault_types)) {
+			std::cerr << "Invalid --fault-types " << fault_types << "\n";
+			return -1;
+		}
+		for (const std::string &r : fault_ram_ranges) {
+			size_t colon = r.find(':');
+			ux_t lo, hi;
+			if (colon == std::string::npos || !symbols.resolve(r.substr(0, colon), lo) ||
+					!symbols.resolve(r.substr(colon + 1), hi) || hi <= lo ||
+					lo < core.ram_base || hi > core.ram_top) {
+				std::cerr << "Invalid --fault-ram " << r << " (must be lo:hi within RAM)\n";
+				return -1;
+			}
+			campaign.ram_ranges.push_back({lo, hi});
+		}
+		if (!fault_log_path.empty()) {
+			campaign.log = fopen(fault_log_path.c_str(), "w");
+			if (!campaign.log) {
+				std::cerr << "Failed to open " << fault_log_path << " for writing\n";
+				return -1;
+			}
+		}
+		int campaign_rc = campaign.run(fault_at, max_cycles);
+		if (campaign.log)
+			fclose(campaign.log);
+		return campaign_rc;
+	}
+
+	RVWatchpoints watch;
+	for (const std::string &w : watch_specs) {
+		if (!watch.add_spec(w, [&](const std::string &a, ux_t &addr) {return symbols.resolve(a, addr);})) {
+			std::cerr << "Invalid --watch " << w << "\n";
+			return -1;
+		}
+	}
+	if (!watch.empty())
+		core.watch = &watch;
+
+	int64_t cyc = 0;
+	// One step of the core, updating every enabled model and the IRQ lines.
+	// Shared by the run loop and --gdb.
+	auto step = [&]() -> uint {
+		bool trace_step = trace_execution;
+		if (filter_trace) {
+			bool enable = trace_filter.before_step(core.pc, core.csr.get_true_priv(), cyc,
+				core.regs[1], core.regs[2]);
+			trace_step = trace_execution && enable;
+			io.trace = trace_step;
+			core.trace_writer = enable && trace_bin_file ? &trace_writer : nullptr;
+		}
+		uint step_cycles = core.step(trace_step);
+		if (filter_trace)
+			trace_filter.after_step(!core.step_info.sleeping && !core.step_info.trap_cause);
+		if (enable_power) {
+			step_cycles += power.step(cyc, core.step_info.pc, step_cycles, core.step_info.sleeping,
+				core.stalled_on_wfi, core.stalled_on_block, core.csr.get_msleep());
+		}
+		io.step(step_cycles);
+		cyc += step_cycles;
+		if (core.flight_recorder)
+			flight_recorder.step(core.step_info.pc, core.step_info.sleeping, core.step_info.trap_cause);
+		if (state_hash_interval) {
+			state_hash.step(core.step_info);
+		}
+		if (enable_counters)
+			hpm_totals.add(core.step_info.events);
+		if (enable_profile) {
+			profile.step(core.step_info.pc, core.step_info.instr, step_cycles,
+				core.step_info.sleeping, core.step_info.trap_cause.has_value());
+		}
+		if (!bbv_prefix.empty()) {
+			simpoint.step(core.step_info.pc, core.step_info.instr, core.step_info.sleeping,
+				core.step_info.trap_cause.has_value());
+		}
+		if (next_snapshot != snapshot_intervals.end() && !core.step_info.sleeping && !core.step_info.trap_cause) {
+			++instret;
+			save_simpoint_snapshot();
+		}
+		if (enable_imix) {
+			imix.step(core.step_info.pc, core.step_info.instr, core.step_info.sleeping,
+				core.step_info.trap_cause.has_value());
+		}
+		if (flamegraph_file) {
+			callgraph.step(core.step_info.pc, core.step_info.instr, core.pc, step_cycles,
+				core.step_info.sleeping, core.step_info.trap_cause, core.step_info.mret);
+		}
+		if (core.heatmap) {
+			heatmap.step(core.step_info.pc, core.step_info.instr, core.step_info.sleeping,
+				core.step_info.trap_cause.has_value());
+			stack_stats.step(core.step_info.trap_cause.has_value(), core.step_info.mret, core.regs[2]);
+		}
+		if (enable_stimulus) {
+			stimulus.end_step();
+			bool irq_t = io.timer_irq_pending();
+			bool irq_s = io.soft_irq_pending();
+			uint32_t irq_e[TBMemIO::IRQ_WORDS];
+			memcpy(irq_e, io.irq, sizeof(irq_e));
+			stimulus.irqs(irq_t, irq_s, irq_e);
+			core.csr.set_irq_t(irq_t);
+			core.csr.set_irq_s(irq_s);
+			for (uint i = 0; i < TBMemIO::IRQ_WORDS; ++i)
+				core.csr.set_irq_e(i, irq_e[i]);
+		} else {
 			core.csr.set_irq_t(io.timer_irq_pending());
 			core.csr.set_irq_s(io.soft_irq_pending());
+			for (uint i = 0; i < TBMemIO::IRQ_WORDS; ++i)
+				core.csr.set_irq_e(i, io.irq[i]);
 		}
-		if (propagate_return_code)
-			rc = -1;
+		if (enable_irq_stats) {
+			if (core.step_info.trap_cause)
+				irq_stats.trap_enter(cyc, *core.step_info.trap_cause);
+			if (core.step_info.mret)
+				irq_stats.mret(cyc);
+			irq_stats.sample(cyc, core.csr.get_effective_xip(), io.mtime - io.mtimecmp);
+		}
+		if (core.reverse)
+			reverse.after_step();
+		return step_cycles;
+	};
+
+	int rc = 0;
+	bool reached_snapshot_pc = false;
+	// Stopped by a --watch hit, or halted in Debug Mode
+	bool stopped = false;
+	if (!gdb_spec.empty()) {
+		RVGDBServer gdb(core, io, step, max_cycles);
+		for (const std::string &w : watch_specs)
+			gdb.watch.add_spec(w, [&](const std::string &a, ux_t &addr) {return symbols.resolve(a, addr);});
+		core.watch = gdb.watch.empty() ? nullptr : &gdb.watch;
+		if (!gdb.listen(gdb_spec) || !gdb.run())
+			return -1;
+		if (gdb.exit_code) {
+			printf("CPU requested halt. Exit code %d\n", *gdb.exit_code);
+			printf("Ran for %ld cycles\n", cyc + 1);
+			if (core.flight_recorder)
+				flight_recorder.exited(*gdb.exit_code, core.pc);
+			if (propagate_return_code)
+				rc = *gdb.exit_code;
+		} else {
+			if (gdb.timed_out) {
+				if (propagate_return_code)
+					rc = -1;
+				if (core.flight_recorder)
+					flight_recorder.timed_out(cyc);
+			}
+			if (!save_snapshot_path.empty() && !rv_save_snapshot(save_snapshot_path, core, io, enable_power ? &power : nullptr))
+				rc = -1;
+			if (!save_handoff_prefix.empty() && !rv_save_handoff(save_handoff_prefix, core, io))
+				rc = -1;
+		}
+	} else {
+		try {
+			for (cyc = 0; cyc < max_cycles;) {
+				if (save_snapshot_pc && core.pc == *save_snapshot_pc) {
+					reached_snapshot_pc = true;
+					break;
+				}
+				if (core.csr.get_debug_mode()) {
+					// Nothing can resume the core without a debugger (--gdb)
+					fprintf(stderr, "CPU halted in Debug Mode (dcsr.cause=%u) at %s after %" PRId64 " cycles\n",
+						core.csr.get_dcsr_cause(), symbols.format_addr(core.pc).c_str(), cyc);
+					stopped = true;
+					break;
+				}
+				step();
+				if (watch.hit) {
+					std::string what = "watchpoint: " + watch.format_hit() + ", by pc " +
+						symbols.format_addr(core.step_info.pc);
+					// Keep the message after the trace of the offending instruction
+					fflush(stdout);
+					fprintf(stderr, "Stopped at %s after %" PRId64 " cycles\n", what.c_str(), cyc);
+					if (core.flight_recorder)
+						flight_recorder.watch_hit(what);
+					stopped = true;
+					break;
+				}
+			}
+			if (reached_snapshot_pc) {
+				fprintf(stderr, "Reached %s after %" PRId64 " cycles\n",
+					symbols.format_addr(*save_snapshot_pc).c_str(), cyc);
+			} else if (stopped) {
+				if (propagate_return_code)
+					rc = -1;
+			} else {
+				if (propagate_return_code)
+					rc = -1;
+				if (core.flight_recorder)
+					flight_recorder.timed_out(cyc);
+			}
+			if (!save_snapshot_path.empty() && !rv_save_snapshot(save_snapshot_path, core, io, enable_power ? &power : nullptr))
+				rc = -1;
+			if (!save_handoff_prefix.empty() && !rv_save_handoff(save_handoff_prefix, core, io))
+				rc = -1;
+		}
+		catch (TBExitException e) {
+			printf("CPU requested halt. Exit code %d\n", e.exitcode);
+			printf("Ran for %ld cycles\n", cyc + 1);
+			if (core.flight_recorder)
+				flight_recorder.exited(e.exitcode, core.pc);
+			if (propagate_return_code)
+				rc = e.exitcode;
+		}
+	}
+
+	if (enable_stimulus)
+		stimulus.finish(stderr);
+	if (enable_timing)
+		timing.print_summary(stderr);
+	if (enable_irq_stats)
+		irq_stats.print_summary(stderr);
+	if (enable_counters)
+		hpm_totals.print_summary(stderr, enable_timing, core.csr);
+	if (enable_power)
+		power.print_summary(stderr);
+	if (power.timeline)
+		fclose(power.timeline);
+	if (enable_profile)
+		profile.print_summary(stderr, symbols);
+	if (enable_imix)
+		imix.print_summary(stderr, symbols);
+	if (!bbv_prefix.empty()) {
+		simpoint.finish(bbv_prefix, simpoint_max_k);
+		simpoint.print_summary(stderr);
 	}
-	catch (TBExitException e) {
-		printf("CPU requested halt. Exit code %d\n", e.exitcode);
-		printf("Ran for %ld cycles\n", cyc + 1);
-		if (propagate_return_code)
-			rc = e.exitcode;
+	if (flamegraph_file) {
+		callgraph.write_folded(flamegraph_file);
+		fclose(flamegraph_file);
+		callgraph.print_summary(stderr);
+	}
+	if (state_hash_file != stderr)
+		fclose(state_hash_file);
+	if (trace_bin_file) {
+		trace_writer.flush();
+		fclose(trace_bin_file);
+		core.trace_writer = nullptr;
+	}
+	if (core.heatmap) {
+		FILE *heatmap_file = fopen(heatmap_path.c_str(), "w");
+		if (heatmap_file) {
+			heatmap.write_file(heatmap_file);
+			fclose(heatmap_file);
+		} else {
+			std::cerr << "Failed to open " << heatmap_path << " for writing\n";
+		}
+		heatmap.print_summary(stderr);
+		stack_stats.print_summary(stderr);
+		// Don't count accesses made by --dump
+		core.heatmap = nullptr;
 	}
 
 	for (auto [start, end] : dump_ranges) {
@@ -149,5 +1172,13 @@ int main(int argc, char **argv) {
 		printf("\n");
 	}
 
+	for (const std::string &q : reverse_queries) {
+		if (!reverse.query(q, symbols, stderr)) {
+			std::cerr << "Invalid --reverse-query " << q << "\n";
+			rc = -1;
+			break;
+		}
+	}
+
 	return rc;
 }
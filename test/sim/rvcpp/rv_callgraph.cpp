@@ -0,0 +1,173 @@
+#include "rv_callgraph.h"
+#include "encoding/rv_opcodes.h"
+
+#include <algorithm>
+#include <cinttypes>
+
+#define BITS_UPTO(msb) (~((-1u << (msb)) << 1))
+#define BITRANGE(msb, lsb) (BITS_UPTO((msb) - (lsb)) << (lsb))
+#define GETBITS(x, msb, lsb) (((x) & BITRANGE(msb, lsb)) >> (lsb))
+#define GETBIT(x, bit) (((x) >> (bit)) & 1u)
+
+static inline bool is_link_reg(uint reg) {
+	return reg == 1 || reg == 5;
+}
+
+uint32_t RVCallGraph::get_child(uint32_t parent, uint64_t key) {
+	auto it = nodes[parent].children.find(key);
+	if (it != nodes[parent].children.end())
+		return it->second;
+	uint32_t child = nodes.size();
+	nodes.push_back({parent, key, 0, 0, {}});
+	nodes[parent].children[key] = child;
+	return child;
+}
+
+void RVCallGraph::step(ux_t pc, uint32_t instr, ux_t next_pc, uint cycles, bool sleeping,
+		std::optional<ux_t> trap_cause, bool mret) {
+	if (stack.empty()) {
+		nodes.push_back({0, pc, 0, 0, {}});
+		stack.push_back({0, 0, false});
+	}
+
+	if (trap_cause) {
+		uint32_t trap_node = get_child(stack.back().node, TRAP_KEY | *trap_cause);
+		stack.push_back({trap_node, pc, true});
+		stack.push_back({get_child(trap_node, next_pc), 0, false});
+		nodes[trap_node].cycles += cycles;
+		return;
+	}
+
+	Node &cur = nodes[stack.back().node];
+	cur.cycles += cycles;
+	if (sleeping)
+		return;
+	++cur.instrs;
+
+	if (mret) {
+		auto trap_frame = std::find_if(stack.rbegin(), stack.rend(), [](const Frame &f) {
+			return f.is_trap;
+		});
+		if (trap_frame != stack.rend())
+			stack.resize(stack.rend() - trap_frame - 1);
+		return;
+	}
+
+	bool is_call = false;
+	bool is_ret = false;
+	bool is_jump = false;
+	uint instr_size = 4;
+	if (RVOPC_MATCH(instr, JAL)) {
+		uint rd = GETBITS(instr, 11, 7);
+		is_call = is_link_reg(rd);
+		is_jump = rd == 0;
+	} else if (RVOPC_MATCH(instr, JALR)) {
+		uint rd = GETBITS(instr, 11, 7);
+		uint rs1 = GETBITS(instr, 19, 15);
+		is_call = is_link_reg(rd);
+		is_ret = rd == 0 && is_link_reg(rs1);
+		is_jump = rd == 0 && !is_ret;
+	} else if ((instr & 0x3) != 0x3) {
+		instr_size = 2;
+		uint rs1 = GETBITS(instr, 11, 7);
+		// c.jr and c.jalr (rs1 != 0; rs1 == 0 is reserved or c.ebreak)
+		bool is_cr_jump = (instr & 0xe07fu) == 0x8002u && rs1 != 0;
+		if (RVOPC_MATCH(instr, C_JAL)) {
+			is_call = true;
+		} else if (RVOPC_MATCH(instr, C_J)) {
+			is_jump = true;
+		} else if (is_cr_jump && GETBIT(instr, 12)) {
+			is_call = true;
+		} else if (is_cr_jump) {
+			is_ret = is_link_reg(rs1);
+			is_jump = !is_ret;
+		} else if (RVOPC_MATCH(instr, CM_POPRET) || RVOPC_MATCH(instr, CM_POPRETZ)) {
+			is_ret = true;
+		}
+	}
+
+	if (is_call) {
+		stack.push_back({get_child(stack.back().node, next_pc), pc + instr_size, false});
+	} else if (is_ret) {
+		// Search for a matching frame, but don't unwind past a trap
+		for (size_t i = stack.size(); i > 1; --i) {
+			const Frame &f = stack[i - 1];
+			if (f.is_trap)
+				break;
+			if (f.ret_addr == next_pc) {
+				stack.resize(i - 1);
+				return;
+			}
+		}
+		++unmatched_returns;
+	} else if (is_jump && stack.size() > 1) {
+		const RVSymbolTable::Symbol *sym = symbols.lookup(next_pc);
+		Frame &top = stack.back();
+		if (sym && sym->is_entry && sym->addr == next_pc && nodes[top.node].key != next_pc)
+			top.node = get_child(nodes[top.node].parent, next_pc);
+	}
+}
+
+std::string RVCallGraph::node_name(uint32_t node) const {
+	uint64_t key = nodes[node].key;
+	if (key & TRAP_KEY) {
+		ux_t cause = key & 0xffffffffu;
+		char buf[32];
+		if (cause >> 31)
+			snprintf(buf, sizeof(buf), "[irq %u]", cause & 0x7fffffffu);
+		else
+			snprintf(buf, sizeof(buf), "[exception %u]", cause);
+		return buf;
+	}
+	return symbols.format_addr(key);
+}
+
+std::string RVCallGraph::node_path(uint32_t node) const {
+	std::string path = node_name(node);
+	while (node != 0) {
+		node = nodes[node].parent;
+		path = node_name(node) + ";" + path;
+	}
+	return path;
+}
+
+void RVCallGraph::write_folded(FILE *f) const {
+	for (uint32_t i = 0; i < nodes.size(); ++i) {
+		if (weight(nodes[i]))
+			fprintf(f, "%s %" PRIu64 "\n", node_path(i).c_str(), weight(nodes[i]));
+	}
+}
+
+void RVCallGraph::print_summary(FILE *f, uint top_n) const {
+	if (nodes.empty())
+		return;
+	// Children always have higher indices than their parents
+	std::vector<uint64_t> inclusive(nodes.size());
+	for (uint32_t i = 0; i < nodes.size(); ++i)
+		inclusive[i] = weight(nodes[i]);
+	for (uint32_t i = nodes.size() - 1; i > 0; --i)
+		inclusive[nodes[i].parent] += inclusive[i];
+	uint64_t total = inclusive[0];
+
+	std::vector<uint32_t> order(nodes.size());
+	for (uint32_t i = 0; i < nodes.size(); ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return inclusive[a] > inclusive[b] || (inclusive[a] == inclusive[b] && a < b);
+	});
+
+	const char *weight_name = count_cycles ? "cycles" : "instructions";
+	fprintf(f, "Call graph: %zu call paths, %" PRIu64 " %s", nodes.size(), total, weight_name);
+	if (unmatched_returns)
+		fprintf(f, ", %" PRIu64 " unmatched returns", unmatched_returns);
+	fprintf(f, "\nTop call paths by inclusive %s:\n", weight_name);
+	fprintf(f, "  %12s %6s %12s %6s  path\n", "inclusive", "%", "exclusive", "%");
+	for (uint i = 0; i < order.size() && i < top_n; ++i) {
+		uint32_t n = order[i];
+		uint64_t excl = weight(nodes[n]);
+		fprintf(f, "  %12" PRIu64 " %5.1f%% %12" PRIu64 " %5.1f%%  %s\n",
+			inclusive[n], total ? 100.0 * inclusive[n] / total : 0.0,
+			excl, total ? 100.0 * excl / total : 0.0,
+			node_path(n).c_str());
+	}
+}
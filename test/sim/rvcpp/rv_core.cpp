@@ -1,4 +1,6 @@
 #include "rv_core.h"
+#include "rv_snapshot.h"
+#include "rv_isa.h"
 #include "encoding/rv_opcodes.h"
 #include "encoding/rv_csr.h"
 
@@ -138,13 +140,25 @@ static inline uint zcmp_s_mapping(uint s_raw) {
 	return s_raw + 8 + 8 * ((s_raw & 0x6) != 0);
 }
 
-void RVCore::step(bool trace) {
+uint RVCore::step(bool trace) {
+
+	if (csr.get_debug_mode()) {
+		// Halted: nothing happens until a debugger resumes the core
+		step_info = {};
+		step_info.pc = pc;
+		step_info.cycles = 1;
+		step_info.sleeping = true;
+		return 1;
+	}
 
 	std::optional<ux_t> rd_wdata;
 	std::optional<ux_t> pc_wdata;
 	std::optional<uint> exception_cause;
+	// Enter Debug Mode instead of executing this instruction (DCSR_CAUSE_*)
+	std::optional<uint> debug_cause;
 	uint regnum_rd = 0;
 
+	bool tracing = trace || trace_writer || flight_recorder;
 	std::optional<ux_t> trace_csr_addr;
 	std::optional<uint> trace_priv;
 
@@ -161,13 +175,32 @@ void RVCore::step(bool trace) {
 		pmp_straddle = csr.get_pmp_match(pc) != csr.get_pmp_match(pc + 2);
 	}
 
+	// Wake from WFI if any individually-enabled IRQ is pending, regardless of
+	// mstatus.mie. h3.block additionally wakes on an unblock.
+	if (stalled_on_wfi || stalled_on_block) {
+		if (csr.get_wfi_wakeup_req() || (stalled_on_block && unblock_latch)) {
+			if (stalled_on_block)
+				unblock_latch = false;
+			stalled_on_wfi = false;
+			stalled_on_block = false;
+		}
+	}
+
+	bool was_sleeping = stalled_on_wfi || stalled_on_block;
+	step_info.mret = false;
+	step_info.n_gpr_writes = 0;
 	std::optional<ux_t> irq_target_pc = csr.trap_check_enter_irq(pc);
+	uint trigger_break = csr.check_triggers(pc);
 	if (irq_target_pc) {
-		// Replace current instruction with IRQ entry
-		stalled_on_wfi = false;
-	} else if (stalled_on_wfi) {
+		// Replace current instruction with IRQ entry. (Any sleep was already
+		// released above, as an IRQ which can be taken is also a wakeup.)
+	} else if (was_sleeping) {
 		// Replace current instruction with jump-to-self
 		pc_wdata = pc;
+	} else if (trigger_break == RVCSR::TRIGGER_BREAK_D) {
+		debug_cause = DCSR_CAUSE_HWBP;
+	} else if (trigger_break == RVCSR::TRIGGER_BREAK_M) {
+		exception_cause = XCAUSE_EBREAK;
 	} else if (!fetch0 || ((*fetch0 & 0x3) == 0x3 && (!fetch1 || pmp_straddle))) {
 		exception_cause = XCAUSE_INSTR_FAULT;
 	} else if ((instr & 0x3) == 0x3) {
@@ -180,7 +213,14 @@ void RVCore::step(bool trace) {
 		switch (opc) {
 
 		case OPC_OP: {
-			if (funct7 == 0b00'00000) {
+			if (RVOPC_MATCH(instr, H3_BLOCK)) {
+				// Released at the start of the next step if there is already
+				// an unblock or wakeup pending, so this can fall through.
+				// A nop when single-stepping.
+				stalled_on_block = !csr.get_dcsr_step();
+			} else if (RVOPC_MATCH(instr, H3_UNBLOCK)) {
+				unblock_latch = true;
+			} else if (funct7 == 0b00'00000) {
 				if (funct3 == 0b000)
 					rd_wdata = rs1 + rs2;
 				else if (funct3 == 0b001)
@@ -562,7 +602,7 @@ void RVCore::step(bool trace) {
 				// csrrw, csrrs, csrrc
 				uint write_op = funct3 - 0b001;
 				if (write_op != RVCSR::WRITE || regnum_rd != 0) {
-					rd_wdata = csr.read(csr_addr);
+					rd_wdata = csr.read(csr_addr, true, rs1, write_op);
 					if (!rd_wdata) {
 						exception_cause = XCAUSE_INSTR_ILLEGAL;
 					}
@@ -570,7 +610,7 @@ void RVCore::step(bool trace) {
 				if (write_op == RVCSR::WRITE || regnum_rs1 != 0) {
 					if (!csr.write(csr_addr, rs1, write_op)) {
 						exception_cause = XCAUSE_INSTR_ILLEGAL;
-					} else if (trace) {
+					} else if (tracing) {
 						trace_csr_addr = csr_addr;
 					}
 				}
@@ -579,7 +619,7 @@ void RVCore::step(bool trace) {
 				// csrrwi, csrrsi, csrrci
 				uint write_op = funct3 - 0b101;
 				if (write_op != RVCSR::WRITE || regnum_rd != 0) {
-					rd_wdata = csr.read(csr_addr);
+					rd_wdata = csr.read(csr_addr, true, regnum_rs1, write_op);
 					if (!rd_wdata) {
 						exception_cause = XCAUSE_INSTR_ILLEGAL;
 					}
@@ -587,7 +627,7 @@ void RVCore::step(bool trace) {
 				if (write_op == RVCSR::WRITE || regnum_rs1 != 0) {
 					if (!csr.write(csr_addr, regnum_rs1, write_op)) {
 						exception_cause = XCAUSE_INSTR_ILLEGAL;
-					} else if (trace) {
+					} else if (tracing) {
 						trace_csr_addr = csr_addr;
 					}
 				}
@@ -595,18 +635,23 @@ void RVCore::step(bool trace) {
 				if (csr.get_true_priv() == PRV_M) {
 					pc_wdata = csr.trap_mret();
 					trace_priv = csr.get_true_priv();
+					step_info.mret = true;
 				} else {
 					exception_cause = XCAUSE_INSTR_ILLEGAL;
 				}
 			} else if (RVOPC_MATCH(instr, ECALL)) {
 				exception_cause = XCAUSE_ECALL_U + csr.get_true_priv();
 			} else if (RVOPC_MATCH(instr, EBREAK)) {
-				exception_cause = XCAUSE_EBREAK;
+				if (csr.get_ebreak_to_debug())
+					debug_cause = DCSR_CAUSE_SWBP;
+				else
+					exception_cause = XCAUSE_EBREAK;
 			} else if (RVOPC_MATCH(instr, WFI)) {
 				if (csr.get_true_priv() == PRV_U && csr.get_mstatus_tw()) {
 					exception_cause = XCAUSE_INSTR_ILLEGAL;
 				} else {
-					stalled_on_wfi = true;
+					// A nop when single-stepping
+					stalled_on_wfi = !csr.get_dcsr_step();
 				}
 			} else {
 				exception_cause = XCAUSE_INSTR_ILLEGAL;
@@ -807,7 +852,10 @@ void RVCore::step(bool trace) {
 			if (c_rs2_l(instr) == 0) {
 				if (c_rs1_l(instr) == 0) {
 					// c.ebreak
-					exception_cause = XCAUSE_EBREAK;
+					if (csr.get_ebreak_to_debug())
+						debug_cause = DCSR_CAUSE_SWBP;
+					else
+						exception_cause = XCAUSE_EBREAK;
 				} else {
 					// c.jalr
 					pc_wdata = regs[c_rs1_l(instr)] & -2u;
@@ -854,89 +902,158 @@ void RVCore::step(bool trace) {
 		} else if (RVOPC_MATCH(instr, CM_POP) || RVOPC_MATCH(instr, CM_POPRET) || RVOPC_MATCH(instr, CM_POPRETZ)) {
 			bool clear_a0 = RVOPC_MATCH(instr, CM_POPRETZ);
 			bool ret = clear_a0 || RVOPC_MATCH(instr, CM_POPRET);
-			ux_t addr = regs[2] + zcmp_stack_adj(instr);
+			// Loads in ascending register order, from the lowest address, as the
+			// core's uops do, so that the order of GPR writes matches
+			ux_t addr = regs[2] + zcmp_stack_adj(instr) - 4 * zcmp_n_regs(instr);
 			bool fail = false;
-			for (uint i = 31; i > 0 && !fail; --i) {
+			for (uint i = 1; i < 32 && !fail; ++i) {
 				if (zcmp_reg_mask(instr) & (1u << i)) {
-					addr -= 4;
 					std::optional<ux_t> load_result = r32(addr);
+					addr += 4;
 					fail = fail || !load_result;
 					if (load_result) {
 						regs[i] = *load_result;
+						record_gpr_write(i, *load_result);
 					}
 				}
 			}
 			if (fail) {
 				exception_cause = XCAUSE_LOAD_FAULT;
 			} else {
-				if (clear_a0)
+				if (clear_a0) {
 					regs[10] = 0;
+					record_gpr_write(10, 0);
+				}
 				if (ret)
 					pc_wdata = regs[1];
 				regnum_rd = 2;
 				rd_wdata = regs[2] + zcmp_stack_adj(instr);
 			}
 		} else if (RVOPC_MATCH(instr, CM_MVSA01)) {
-			regs[zcmp_s_mapping(GETBITS(instr, 9, 7))] = regs[10];
-			regs[zcmp_s_mapping(GETBITS(instr, 4, 2))] = regs[11];
+			// Two uops: the second move is this instruction's rd write
+			uint r1s = zcmp_s_mapping(GETBITS(instr, 9, 7));
+			regs[r1s] = regs[10];
+			record_gpr_write(r1s, regs[10]);
+			regnum_rd = zcmp_s_mapping(GETBITS(instr, 4, 2));
+			rd_wdata = regs[11];
 		} else if (RVOPC_MATCH(instr, CM_MVA01S)) {
 			regs[10] = regs[zcmp_s_mapping(GETBITS(instr, 9, 7))];
-			regs[11] = regs[zcmp_s_mapping(GETBITS(instr, 4, 2))];
+			record_gpr_write(10, regs[10]);
+			regnum_rd = 11;
+			rd_wdata = regs[zcmp_s_mapping(GETBITS(instr, 4, 2))];
 		} else {
 			exception_cause = XCAUSE_INSTR_ILLEGAL;
 		}
 	}
 
-	// Ensure pending CSR writes are applied before checking IRQ conditions,
-	// and before reading back the CSR value for tracing
-	csr.step();
+	// Debug Mode entry leaves the pc on the breaking instruction
+	if (debug_cause)
+		pc_wdata = pc;
 
-	if (trace && !irq_target_pc) {
-		printf("%08x: ", pc);
-		if ((instr & 0x3) == 0x3) {
-			printf("%08x : ", instr);
+	uint step_cycles = 1;
+	if (timing) {
+		if (irq_target_pc || exception_cause) {
+			step_cycles = timing->trap();
+		} else if (was_sleeping) {
+			step_cycles = timing->wfi();
 		} else {
-			printf("    %04x : ", instr & 0xffffu);
-		}
-		bool gpr_writeback = regnum_rd != 0 && rd_wdata;
-		if (gpr_writeback) {
-			printf("%-3s   <- %08x :\n", friendly_reg_names[regnum_rd], *rd_wdata);
-		} else if (pc_wdata) {
-			printf("pc    <- %08x <\n", *pc_wdata);
-		} else {
-			printf("                  :\n");
-		}
-		if (pc_wdata && gpr_writeback) {
-			printf("                   : pc    <- %08x <\n", *pc_wdata);
-		}
-		if (trace_csr_addr) {
-			printf("                   : #%03x  <- %08x :\n", *trace_csr_addr, *csr.read(*trace_csr_addr, false));
+			ux_t next_pc = pc_wdata ? *pc_wdata : pc + ((instr & 0x3) == 0x3 ? 4 : 2);
+			step_cycles = timing->retire(pc, instr, next_pc, regs.data());
 		}
 	}
 
+	uint32_t hpm_events = 0;
+	if (irq_target_pc || exception_cause) {
+		hpm_events = 1u << HPM_EVENT_TRAP;
+	} else if (!was_sleeping && !debug_cause) {
+		hpm_events = hpm_instr_events(instr, pc_wdata.has_value());
+		if (timing)
+			hpm_events |= timing->events;
+	}
+
+	// Ensure pending CSR writes are applied before checking IRQ conditions,
+	// and before reading back the CSR value for tracing
+	csr.step(step_cycles, hpm_events);
+
+	// Trace shows the instruction's own PC writeback (if any) as well as the
+	// trap target
+	std::optional<ux_t> instr_pc_wdata = pc_wdata;
 	if (exception_cause) {
 		pc_wdata = csr.trap_enter_exception(*exception_cause, pc);
-		if (trace) {
-			printf("^^^ Trap           : cause <- %-2u       :\n", *exception_cause);
-			printf("|||                : pc    <- %08x <\n", *pc_wdata);
-			trace_priv = csr.get_true_priv();
-		}
+		trace_priv = csr.get_true_priv();
 	} else if (irq_target_pc) {
 		pc_wdata = irq_target_pc;
-		if (trace) {
-			printf("^^^ IRQ            : cause <- IRQ + %-2u :\n", csr.get_xcause() & ((1u << 31) - 1));
-			printf("|||                : pc    <- %08x <\n", *pc_wdata);
-			trace_priv = csr.get_true_priv();
+		trace_priv = csr.get_true_priv();
+	}
+
+	if (tracing) {
+		RVTraceRecord rec{};
+		rec.pc = pc;
+		rec.instr = instr;
+		rec.irq = irq_target_pc.has_value();
+		if (regnum_rd != 0 && rd_wdata) {
+			rec.rd = regnum_rd;
+			rec.rd_wdata = *rd_wdata;
+		}
+		if (trace_csr_addr) {
+			rec.csr_addr = *trace_csr_addr;
+			rec.csr_value = *csr.read(*trace_csr_addr, false);
 		}
+		if (exception_cause || irq_target_pc) {
+			rec.trap_cause = csr.get_xcause() & ((1u << 31) - 1);
+			rec.trap_target = *pc_wdata;
+		}
+		rec.pc_wdata = instr_pc_wdata;
+		rec.priv = trace_priv;
+		if (trace && trace_disasm && !irq_target_pc)
+			rv_trace_print(stdout, rec, rv_disasm(instr, pc).c_str());
+		else if (trace)
+			rv_trace_print(stdout, rec);
+		if (trace_writer)
+			trace_writer->write(rec);
+		if (flight_recorder)
+			flight_recorder->push(rec);
 	}
-	if (trace && trace_priv) {
-		printf("|||                : priv  <- %c        :\n", "US.M"[*trace_priv & 0x3]);
+
+	step_info.pc = pc;
+	step_info.instr = instr;
+	step_info.cycles = step_cycles;
+	step_info.events = hpm_events;
+	step_info.sleeping = was_sleeping;
+	if (exception_cause || irq_target_pc) {
+		step_info.trap_cause = csr.get_xcause();
+	} else {
+		step_info.trap_cause = std::nullopt;
 	}
 
 	if (pc_wdata)
 		pc = *pc_wdata;
 	else
 		pc = pc + ((instr & 0x3) == 0x3 ? 4 : 2);
-	if (rd_wdata && regnum_rd != 0)
+	if (rd_wdata && regnum_rd != 0) {
 		regs[regnum_rd] = *rd_wdata;
+		record_gpr_write(regnum_rd, *rd_wdata);
+	}
+
+	if (debug_cause) {
+		csr.enter_debug_mode(*debug_cause, pc);
+	} else if (csr.get_dcsr_step() && !was_sleeping) {
+		// Stepped one instruction, or one trap entry: halt before the next
+		csr.enter_debug_mode(DCSR_CAUSE_STEP, pc);
+	}
+
+	return step_cycles;
+}
+
+void RVCore::serialise(RVSnapshotIO &io) {
+	io.field(regs);
+	io.field(pc);
+	io.field(load_reserved);
+	io.field(stalled_on_wfi);
+	io.field(stalled_on_block);
+	io.field(unblock_latch);
+	csr.serialise(io);
+	io.expect(ram_base);
+	if (io.include_ram)
+		io.sparse(ram, ram_top - ram_base);
 }
@@ -1,4 +1,5 @@
 #include "rv_csr.h"
+#include "rv_snapshot.h"
 #include "encoding/rv_csr.h"
 
 #include <cassert>
@@ -15,14 +16,126 @@ ux_t RVCSR::get_effective_xip() {
 	return mip |
 		(irq_s ? MIP_MSIP : 0) |
 		(irq_t ? MIP_MTIP : 0) |
-		(irq_e ? MIP_MEIP : 0);
+		(irq_ctrl.pending() ? MIP_MEIP : 0);
 }
 
-void RVCSR::step() {
+void RVCSR::apply_pending_write() {
+	if (!pending_write_addr)
+		return;
+	ux_t addr = *pending_write_addr;
+	if (addr >= CSR_MHPMCOUNTER3 && addr <= CSR_MHPMCOUNTER31) {
+		uint64_t &ctr = mhpmcounter[addr - CSR_MHPMCOUNTER3];
+		ctr = (ctr & 0xffffffff00000000ull) | pending_write_data;
+	} else if (addr >= CSR_MHPMCOUNTER3H && addr <= CSR_MHPMCOUNTER31H) {
+		uint64_t &ctr = mhpmcounter[addr - CSR_MHPMCOUNTER3H];
+		ctr = (ctr & 0x00000000ffffffffull) | ((uint64_t)pending_write_data << 32);
+	} else if (addr >= CSR_MHPMEVENT3 && addr <= CSR_MHPMEVENT31) {
+		// WARL: unsupported events read back as 0
+		mhpmevent[addr - CSR_MHPMEVENT3] = pending_write_data < N_HPM_EVENTS ? pending_write_data : 0;
+	}
+	switch (*pending_write_addr) {
+		case CSR_MSTATUS:        mstatus        = pending_write_data;               break;
+		case CSR_MIE:            mie            = pending_write_data;               break;
+		case CSR_MTVEC:          mtvec          = pending_write_data & 0xfffffffdu; break;
+		case CSR_MSCRATCH:       mscratch       = pending_write_data;               break;
+		case CSR_MEPC:           mepc           = pending_write_data & 0xfffffffeu; break;
+		case CSR_MCAUSE:         mcause         = pending_write_data & 0x8000000fu; break;
+
+		case CSR_MCYCLE:         mcycle         = pending_write_data;               break;
+		case CSR_MCYCLEH:        mcycleh        = pending_write_data;               break;
+		case CSR_MINSTRET:       minstret       = pending_write_data;               break;
+		case CSR_MINSTRETH:      minstreth      = pending_write_data;               break;
+		case CSR_MCOUNTINHIBIT:  mcountinhibit  = pending_write_data & 0xfffffffdu; break;
+
+		case CSR_HAZARD3_MSLEEP: hazard3_msleep = pending_write_data & 0x7u;        break;
+
+		case CSR_TSELECT:        tselect        = pending_write_data & 0x3u;        break;
+		case CSR_TCONTROL:
+			tcontrol_mpte = GETBIT(pending_write_data, 7);
+			tcontrol_mte = GETBIT(pending_write_data, 3);
+			break;
+
+		case CSR_DCSR:
+			dcsr_ebreakm = GETBIT(pending_write_data, 15);
+			dcsr_ebreaku = GETBIT(pending_write_data, 12);
+			dcsr_step = GETBIT(pending_write_data, 2);
+			// dcsr.prv changes the core's privilege level directly
+			priv = GETBIT(pending_write_data, 1) ? PRV_M : PRV_U;
+			break;
+		case CSR_DPC:            dpc            = pending_write_data & 0xfffffffeu; break;
+		case CSR_HAZARD3_DMDATA0: dmdata0       = pending_write_data;               break;
+
+		case CSR_HAZARD3_MEIEA:
+		case CSR_HAZARD3_MEIPA:
+		case CSR_HAZARD3_MEIFA:
+		case CSR_HAZARD3_MEIPRA:
+		case CSR_HAZARD3_MEINEXT:
+			irq_ctrl.write(*pending_write_addr, pending_write_data, pending_write_raw);
+			break;
+		case CSR_HAZARD3_MEICONTEXT:
+			irq_ctrl.write(*pending_write_addr, pending_write_data, pending_write_raw);
+			// mtiesave/msiesave are ORed back into mie, but clearts wins
+			mie |= (GETBIT(pending_write_data, 3) ? MIP_MTIP : 0) |
+				(GETBIT(pending_write_data, 2) ? MIP_MSIP : 0);
+			if (pending_write_clearts)
+				mie &= ~(MIP_MTIP | MIP_MSIP);
+			break;
+
+		default:                                                                    break;
+	}
+
+	// Writes to a D-mode trigger from outside of Debug Mode are ignored
+	Trigger &t = triggers[tselect];
+	if ((addr == CSR_TDATA1 || addr == CSR_TDATA2) && (debug_mode || !t.dmode)) {
+		if (addr == CSR_TDATA1) {
+			if (debug_mode)
+				t.dmode = GETBIT(pending_write_data, 27);
+			t.action = GETBIT(pending_write_data, 12);
+			t.m = GETBIT(pending_write_data, 6);
+			t.u = GETBIT(pending_write_data, 3);
+			t.execute = GETBIT(pending_write_data, 2);
+		} else {
+			t.tdata2 = pending_write_data;
+		}
+		update_trigger_addrs();
+	}
+
+	for (uint i = 0; i < IMPLEMENTED_PMP_REGIONS; ++i) {
+		if (pmpcfg_l(i)) {
+			continue;
+		}
+		if (*pending_write_addr == CSR_PMPADDR0 + i) {
+			pmpaddr[i] = pending_write_data & 0x3fffffffu;
+		} else if (*pending_write_addr == CSR_PMPCFG0 + i / 4) {
+			uint field_lsb = 8 * (i % 4);
+			pmpcfg[i / 4] = (pmpcfg[i / 4] & ~(0xffu << field_lsb))
+				| (pending_write_data & (0x9fu << field_lsb));
+		}
+	}
+
+	if ((addr >= CSR_MHPMEVENT3 && addr <= CSR_MHPMEVENT31) || addr == CSR_MCOUNTINHIBIT)
+		update_hpm_counting();
+
+	pending_write_addr = {};
+}
+
+void RVCSR::update_hpm_counting() {
+	hpm_counted_events = 0;
+	for (uint i = 0; i < N_HPM_EVENTS; ++i)
+		hpm_event_counters[i] = 0;
+	for (uint i = 0; i < N_HPM_COUNTERS; ++i) {
+		if (mhpmevent[i] != HPM_EVENT_NONE && !GETBIT(mcountinhibit, i + 3)) {
+			hpm_event_counters[mhpmevent[i]] |= 1u << i;
+			hpm_counted_events |= 1u << mhpmevent[i];
+		}
+	}
+}
+
+void RVCSR::step(uint cycles, uint32_t events) {
 	uint64_t mcycle_64 = ((uint64_t)mcycleh << 32) | mcycle;
 	uint64_t minstret_64 = ((uint64_t)minstreth << 32) | minstret;
 	if (!(mcountinhibit & 0x1u)) {
-		++mcycle_64;
+		mcycle_64 += cycles;
 	}
 	if (!(mcountinhibit & 0x4u)) {
 		++minstret_64;
@@ -39,49 +152,32 @@ void RVCSR::step() {
 	if (!(pending_write_addr && *pending_write_addr == CSR_MINSTRET)) {
 		minstret = minstret_64 & 0xffffffffu;
 	}
-	if (pending_write_addr) {
-		switch (*pending_write_addr) {
-			case CSR_MSTATUS:        mstatus        = pending_write_data;               break;
-			case CSR_MIE:            mie            = pending_write_data;               break;
-			case CSR_MTVEC:          mtvec          = pending_write_data & 0xfffffffdu; break;
-			case CSR_MSCRATCH:       mscratch       = pending_write_data;               break;
-			case CSR_MEPC:           mepc           = pending_write_data & 0xfffffffeu; break;
-			case CSR_MCAUSE:         mcause         = pending_write_data & 0x8000000fu; break;
-
-			case CSR_MCYCLE:         mcycle         = pending_write_data;               break;
-			case CSR_MCYCLEH:        mcycleh        = pending_write_data;               break;
-			case CSR_MINSTRET:       minstret       = pending_write_data;               break;
-			case CSR_MINSTRETH:      minstreth      = pending_write_data;               break;
-			case CSR_MCOUNTINHIBIT:  mcountinhibit  = pending_write_data & 0x7u;        break;
-
-			case CSR_HAZARD3_MSLEEP: hazard3_msleep = pending_write_data & 0x7u;        break;
-
-			default:                                                                    break;
-		}
-
-		for (uint i = 0; i < IMPLEMENTED_PMP_REGIONS; ++i) {
-			if (pmpcfg_l(i)) {
-				continue;
-			}
-			if (*pending_write_addr == CSR_PMPADDR0 + i) {
-				pmpaddr[i] = pending_write_data & 0x3fffffffu;
-			} else if (*pending_write_addr == CSR_PMPCFG0 + i / 4) {
-				uint field_lsb = 8 * (i % 4);
-				pmpcfg[i / 4] = (pmpcfg[i / 4] & ~(0xffu << field_lsb))
-					| (pending_write_data & (0x9fu << field_lsb));
-			}
-		}
-
-		pending_write_addr = {};
+	// Usually zero, as few (if any) counters are programmed
+	events &= hpm_counted_events;
+	while (events) {
+		uint event = __builtin_ctz(events);
+		events &= events - 1;
+		for (uint32_t ctrs = hpm_event_counters[event]; ctrs; ctrs &= ctrs - 1)
+			++mhpmcounter[__builtin_ctz(ctrs)];
 	}
+	apply_pending_write();
+	irq_ctrl.step();
 }
 
 
 // Returns None on permission/decode fail
-std::optional<ux_t> RVCSR::read(uint16_t addr, bool side_effect) {
-	(void)side_effect;
+std::optional<ux_t> RVCSR::read(uint16_t addr, bool side_effect, ux_t wdata_raw, uint op) {
 	if (addr >= 1u << 12 || GETBITS(addr, 9, 8) > priv)
 		return {};
+	if (!debug_mode && (addr == CSR_DCSR || addr == CSR_DPC || addr == CSR_HAZARD3_DMDATA0))
+		return {};
+
+	if (addr >= CSR_MHPMCOUNTER3 && addr <= CSR_MHPMCOUNTER31)
+		return mhpmcounter[addr - CSR_MHPMCOUNTER3] & 0xffffffffu;
+	if (addr >= CSR_MHPMCOUNTER3H && addr <= CSR_MHPMCOUNTER31H)
+		return mhpmcounter[addr - CSR_MHPMCOUNTER3H] >> 32;
+	if (addr >= CSR_MHPMEVENT3 && addr <= CSR_MHPMEVENT31)
+		return mhpmevent[addr - CSR_MHPMEVENT3];
 
 	switch (addr) {
 		case CSR_MISA:           return 0x40901107u; // RV32IMABCX + U
@@ -130,7 +226,33 @@ std::optional<ux_t> RVCSR::read(uint16_t addr, bool side_effect) {
 
 		case CSR_HAZARD3_MSLEEP: return hazard3_msleep;
 
-		default:                 return {};
+		case CSR_TSELECT:        return tselect;
+		case CSR_TDATA1:         return get_tdata1(tselect);
+		case CSR_TDATA2:         return triggers[tselect].tdata2;
+		case CSR_TINFO:          return 0x4u;        // type=2 only
+		case CSR_TCONTROL:       return (tcontrol_mpte ? 0x80u : 0) | (tcontrol_mte ? 0x8u : 0);
+
+		case CSR_DCSR:
+			return
+				(4u << 28)                   | // xdebugver=4, 0.13.2 debug spec
+				(dcsr_ebreakm ? 1u << 15 : 0) |
+				(dcsr_ebreaku ? 1u << 12 : 0) |
+				DCSR_STOPCYCLE | DCSR_STOPTIME |
+				(dcsr_cause << 6)             |
+				(dcsr_step ? DCSR_STEP : 0)   |
+				(priv == PRV_M ? 0x3u : 0x0u);
+		case CSR_DPC:            return dpc;
+		case CSR_HAZARD3_DMDATA0: return dmdata0;
+
+		case CSR_HAZARD3_MEICONTEXT: {
+			// mtiesave/msiesave show the mie bits cleared by this access
+			bool clearts = GETBIT(wdata_raw, 1) && op != WRITE_CLEAR;
+			ux_t save = clearts ?
+				(mie & MIP_MTIP ? 0x8u : 0) | (mie & MIP_MSIP ? 0x4u : 0) : 0;
+			return *irq_ctrl.read(addr, wdata_raw, side_effect) | save;
+		}
+
+		default:                 return irq_ctrl.read(addr, wdata_raw, side_effect);
 	}
 }
 
@@ -138,8 +260,11 @@ std::optional<ux_t> RVCSR::read(uint16_t addr, bool side_effect) {
 bool RVCSR::write(uint16_t addr, ux_t data, uint op) {
 	if (addr >= 1u << 12 || GETBITS(addr, 9, 8) > priv)
 		return false;
+	if (!debug_mode && (addr == CSR_DCSR || addr == CSR_DPC || addr == CSR_HAZARD3_DMDATA0))
+		return false;
+	ux_t wdata_raw = data;
 	if (op == WRITE_CLEAR || op == WRITE_SET) {
-		std::optional<ux_t> rdata = read(addr, false);
+		std::optional<ux_t> rdata = read(addr, false, wdata_raw, op);
 		if (!rdata)
 			return false;
 		if (op == WRITE_CLEAR)
@@ -148,10 +273,17 @@ bool RVCSR::write(uint16_t addr, ux_t data, uint op) {
 			data = *rdata | data;
 	}
 	pending_write_addr = addr;
+	pending_write_raw = wdata_raw;
+	pending_write_clearts = addr == CSR_HAZARD3_MEICONTEXT && op != WRITE_CLEAR && GETBIT(wdata_raw, 1);
 	pending_write_data = data;
 	// Actual write is applied at end of step() -- ordering is important
 	// e.g. for mcycle updates. However we validate address for
 	// writability immediately.
+	if ((addr >= CSR_MHPMCOUNTER3 && addr <= CSR_MHPMCOUNTER31) ||
+			(addr >= CSR_MHPMCOUNTER3H && addr <= CSR_MHPMCOUNTER31H) ||
+			(addr >= CSR_MHPMEVENT3 && addr <= CSR_MHPMEVENT31)) {
+		return true;
+	}
 	switch (addr) {
 		case CSR_MISA:           break;
 		case CSR_MHARTID:        break;
@@ -197,11 +329,56 @@ bool RVCSR::write(uint16_t addr, ux_t data, uint op) {
 
 		case CSR_HAZARD3_MSLEEP: break;
 
+		case CSR_TSELECT:        break;
+		case CSR_TDATA1:         break;
+		case CSR_TDATA2:         break;
+		case CSR_TINFO:          break;
+		case CSR_TCONTROL:       break;
+
+		case CSR_DCSR:           break;
+		case CSR_DPC:            break;
+		case CSR_HAZARD3_DMDATA0: break;
+
+		case CSR_HAZARD3_MEIEA:      break;
+		case CSR_HAZARD3_MEIPA:      break;
+		case CSR_HAZARD3_MEIFA:      break;
+		case CSR_HAZARD3_MEIPRA:     break;
+		case CSR_HAZARD3_MEINEXT:    break;
+		case CSR_HAZARD3_MEICONTEXT: break;
+
 		default:                 return false;
 	}
 	return true;
 }
 
+std::optional<ux_t> RVCSR::peek(uint16_t addr) {
+	uint saved_priv = priv;
+	bool saved_debug_mode = debug_mode;
+	priv = PRV_M;
+	debug_mode = true;
+	std::optional<ux_t> rdata = read(addr, false);
+	priv = saved_priv;
+	debug_mode = saved_debug_mode;
+	return rdata;
+}
+
+bool RVCSR::poke(uint16_t addr, ux_t data) {
+	uint saved_priv = priv;
+	bool saved_debug_mode = debug_mode;
+	priv = PRV_M;
+	debug_mode = true;
+	bool ok = write(addr, data);
+	if (ok)
+		apply_pending_write();
+	else
+		pending_write_addr = {};
+	// A dcsr write sets the privilege level through dcsr.prv
+	if (!(ok && addr == CSR_DCSR))
+		priv = saved_priv;
+	debug_mode = saved_debug_mode;
+	return ok;
+}
+
 ux_t RVCSR::trap_enter_exception(uint xcause, ux_t xepc) {
 	assert(xcause < 32);
 	assert(!pending_write_addr);
@@ -210,9 +387,15 @@ ux_t RVCSR::trap_enter_exception(uint xcause, ux_t xepc) {
 
 std::optional<ux_t> RVCSR::trap_check_enter_irq(ux_t xepc) {
 	ux_t m_targeted_irqs = get_effective_xip() & mie;
-	bool take_m_irq = m_targeted_irqs && ((mstatus & MSTATUS_MIE) || priv < PRV_M);
+	// dcsr.stepie is hardwired to 0: no IRQs while single-stepping
+	bool take_m_irq = m_targeted_irqs && ((mstatus & MSTATUS_MIE) || priv < PRV_M) && !dcsr_step;
 	if (take_m_irq) {
-		ux_t cause = (1u << 31) | __builtin_ctz(m_targeted_irqs);
+		// Priority order from priv spec: external > software > timer
+		uint irq_num =
+			m_targeted_irqs & MIP_MEIP ? IRQ_M_EXT  :
+			m_targeted_irqs & MIP_MSIP ? IRQ_M_SOFT :
+			m_targeted_irqs & MIP_MTIP ? IRQ_M_TIMER : __builtin_ctz(m_targeted_irqs);
+		ux_t cause = (1u << 31) | irq_num;
 		return trap_enter(cause, xepc);
 	} else {
 		return std::nullopt;
@@ -221,6 +404,12 @@ std::optional<ux_t> RVCSR::trap_check_enter_irq(ux_t xepc) {
 
 // Update trap state (including change of privilege level), return trap target PC
 ux_t RVCSR::trap_enter(uint xcause, ux_t xepc) {
+	irq_ctrl.trap_enter(xcause == ((1u << 31) | IRQ_M_EXT));
+
+	// Triggers can't fire in a trap handler until it sets mte or returns
+	tcontrol_mpte = tcontrol_mte;
+	tcontrol_mte = false;
+
 	mstatus = (mstatus & ~MSTATUS_MPP) | (priv << 11);
 	priv = PRV_M;
 
@@ -242,6 +431,11 @@ ux_t RVCSR::trap_enter(uint xcause, ux_t xepc) {
 
 // Update trap state, return mepc:
 ux_t RVCSR::trap_mret() {
+	irq_ctrl.trap_mret();
+
+	// Unlike mstatus.mpie, tcontrol.mpte is unchanged by mret
+	tcontrol_mte = tcontrol_mpte;
+
 	priv = GETBITS(mstatus, 12, 11);
 	mstatus &= ~MSTATUS_MPP;
 	if (priv != PRV_M) {
@@ -258,6 +452,54 @@ ux_t RVCSR::trap_mret() {
 	return mepc;
 }
 
+void RVCSR::enter_debug_mode(uint cause, ux_t resume_pc) {
+	debug_mode = true;
+	dcsr_cause = cause;
+	dpc = resume_pc;
+}
+
+ux_t RVCSR::exit_debug_mode() {
+	debug_mode = false;
+	return dpc;
+}
+
+bool RVCSR::get_ebreak_to_debug() {
+	return priv == PRV_M ? dcsr_ebreakm : dcsr_ebreaku;
+}
+
+ux_t RVCSR::get_tdata1(uint i) {
+	const Trigger &t = triggers[i];
+	return
+		(2u << 28)                  | // type=2, address/data match
+		(t.dmode   ? 1u << 27 : 0) |
+		(t.action  ? 1u << 12 : 0) |
+		(t.m       ? 1u << 6  : 0) |
+		(t.u       ? 1u << 3  : 0) |
+		(t.execute ? 1u << 2  : 0);
+}
+
+void RVCSR::update_trigger_addrs() {
+	trigger_addrs.clear();
+	for (const Trigger &t : triggers) {
+		if (t.execute && (t.m || t.u))
+			trigger_addrs.insert(t.tdata2);
+	}
+}
+
+uint RVCSR::check_triggers_slow(ux_t pc) {
+	// A D-mode break takes priority if several triggers match
+	uint result = TRIGGER_NONE;
+	for (const Trigger &t : triggers) {
+		if (!t.execute || t.tdata2 != pc || !(priv == PRV_M ? t.m : t.u))
+			continue;
+		if (t.action && t.dmode)
+			return TRIGGER_BREAK_D;
+		else if (!t.action && tcontrol_mte)
+			result = TRIGGER_BREAK_M;
+	}
+	return result;
+}
+
 uint RVCSR::get_effective_priv() {
 	if (mstatus & MSTATUS_MPRV) {
 		return (mstatus & MSTATUS_MPP) >> __builtin_ctz(MSTATUS_MPP);
@@ -311,3 +553,93 @@ uint RVCSR::get_pmp_xwr(ux_t addr) {
 		       get_true_priv()      == PRV_M ? PMP_X : 0x0u;
 	}
 }
+
+std::vector<std::pair<uint16_t, ux_t>> RVCSR::get_restore_writes() {
+	std::vector<std::pair<uint16_t, ux_t>> writes = {
+		{CSR_MSTATUS,        mstatus},
+		{CSR_MIE,            mie},
+		{CSR_MTVEC,          mtvec},
+		{CSR_MSCRATCH,       mscratch},
+		{CSR_MEPC,           mepc},
+		{CSR_MCAUSE,         mcause},
+		// Counting stays inhibited until all the counters are restored, and
+		// each mhpmevent is written before its counter
+		{CSR_MCOUNTINHIBIT,  0xfffffffdu},
+	};
+	for (uint i = 0; i < N_HPM_COUNTERS; ++i)
+		writes.push_back({CSR_MHPMEVENT3 + i, mhpmevent[i]});
+	for (uint i = 0; i < N_HPM_COUNTERS; ++i) {
+		writes.push_back({CSR_MHPMCOUNTER3 + i, (ux_t)mhpmcounter[i]});
+		writes.push_back({CSR_MHPMCOUNTER3H + i, (ux_t)(mhpmcounter[i] >> 32)});
+	}
+	writes.push_back({CSR_MCYCLE,         mcycle});
+	writes.push_back({CSR_MCYCLEH,        mcycleh});
+	writes.push_back({CSR_MINSTRET,       minstret});
+	writes.push_back({CSR_MINSTRETH,      minstreth});
+	writes.push_back({CSR_MCOUNTINHIBIT,  mcountinhibit});
+	writes.push_back({CSR_HAZARD3_MSLEEP, hazard3_msleep});
+	// Addresses first, as a locked pmpcfg would make its pmpaddr read-only
+	for (int i = 0; i < IMPLEMENTED_PMP_REGIONS; ++i)
+		writes.push_back({CSR_PMPADDR0 + i, pmpaddr[i]});
+	for (int i = 0; i < (IMPLEMENTED_PMP_REGIONS + 3) / 4; ++i)
+		writes.push_back({CSR_PMPCFG0 + i, pmpcfg[i]});
+	for (ux_t window = 0; 16 * window < irq_ctrl.num_irqs; ++window) {
+		writes.push_back({CSR_HAZARD3_MEIEA, *irq_ctrl.read(CSR_HAZARD3_MEIEA, window, false) | window});
+		writes.push_back({CSR_HAZARD3_MEIFA, *irq_ctrl.read(CSR_HAZARD3_MEIFA, window, false) | window});
+	}
+	for (ux_t index = 0; 4 * index < irq_ctrl.num_irqs; ++index)
+		writes.push_back({CSR_HAZARD3_MEIPRA, *irq_ctrl.read(CSR_HAZARD3_MEIPRA, index, false) | index});
+	writes.push_back({CSR_HAZARD3_MEICONTEXT, *irq_ctrl.read(CSR_HAZARD3_MEICONTEXT, 0, false)});
+	// tdata2 first, so a trigger is never briefly armed on a stale address
+	for (uint i = 0; i < BREAKPOINT_TRIGGERS; ++i) {
+		writes.push_back({CSR_TSELECT, i});
+		writes.push_back({CSR_TDATA2, triggers[i].tdata2});
+		writes.push_back({CSR_TDATA1, get_tdata1(i)});
+	}
+	writes.push_back({CSR_TSELECT, tselect});
+	writes.push_back({CSR_TCONTROL, *read(CSR_TCONTROL, false)});
+	return writes;
+}
+
+void RVCSR::serialise(RVSnapshotIO &io) {
+	io.field(irq_t);
+	io.field(irq_s);
+	irq_ctrl.serialise(io);
+	io.field(priv);
+	io.field(mcycle);
+	io.field(mcycleh);
+	io.field(minstret);
+	io.field(minstreth);
+	io.field(mcountinhibit);
+	io.field(mhpmcounter);
+	io.field(mhpmevent);
+	if (io.loading)
+		update_hpm_counting();
+	io.field(mstatus);
+	io.field(mie);
+	io.field(mip);
+	io.field(mtvec);
+	io.field(mscratch);
+	io.field(mepc);
+	io.field(mcause);
+	io.field(hazard3_msleep);
+	io.field(pmpaddr);
+	io.field(pmpcfg);
+	io.field(debug_mode);
+	io.field(dcsr_ebreakm);
+	io.field(dcsr_ebreaku);
+	io.field(dcsr_step);
+	io.field(dcsr_cause);
+	io.field(dpc);
+	io.field(dmdata0);
+	io.field(triggers);
+	io.field(tselect);
+	io.field(tcontrol_mte);
+	io.field(tcontrol_mpte);
+	io.field(pending_write_addr);
+	io.field(pending_write_data);
+	io.field(pending_write_raw);
+	io.field(pending_write_clearts);
+	if (io.loading)
+		update_trigger_addrs();
+}
@@ -0,0 +1,156 @@
+#include "rv_elf.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+// ELF32 layout constants (from the System V gABI)
+static const uint EI_CLASS       = 4;
+static const uint EI_DATA        = 5;
+static const uint ELFCLASS32     = 1;
+static const uint ELFDATA2LSB    = 1;
+static const uint E_SHOFF        = 0x20;
+static const uint E_SHENTSIZE    = 0x2e;
+static const uint E_SHNUM        = 0x30;
+static const uint SH_TYPE        = 0x04;
+static const uint SH_OFFSET      = 0x10;
+static const uint SH_SIZE        = 0x14;
+static const uint SH_LINK        = 0x18;
+static const uint SH_ENTSIZE     = 0x24;
+static const uint SHT_SYMTAB     = 2;
+static const uint SYM_SIZE       = 16;
+static const uint STT_NOTYPE     = 0;
+static const uint STT_FUNC       = 2;
+static const uint STB_GLOBAL     = 1;
+static const uint STB_WEAK       = 2;
+static const uint SHN_UNDEF      = 0;
+static const uint SHN_LORESERVE  = 0xff00;
+
+template <typename T>
+static T get(const std::vector<uint8_t> &buf, size_t offset) {
+	T x = 0;
+	if (offset + sizeof(T) <= buf.size())
+		memcpy(&x, &buf[offset], sizeof(T));
+	return x;
+}
+
+bool RVSymbolTable::load(const std::string &path) {
+	std::ifstream fd(path, std::ios::binary);
+	if (!fd) {
+		fprintf(stderr, "Failed to open ELF file %s\n", path.c_str());
+		return false;
+	}
+	std::vector<uint8_t> buf((std::istreambuf_iterator<char>(fd)), std::istreambuf_iterator<char>());
+	if (buf.size() < 0x34 || memcmp(buf.data(), "\x7f" "ELF", 4) != 0 ||
+			buf[EI_CLASS] != ELFCLASS32 || buf[EI_DATA] != ELFDATA2LSB) {
+		fprintf(stderr, "%s is not a little-endian ELF32 file\n", path.c_str());
+		return false;
+	}
+
+	uint32_t shoff = get<uint32_t>(buf, E_SHOFF);
+	uint16_t shentsize = get<uint16_t>(buf, E_SHENTSIZE);
+	uint16_t shnum = get<uint16_t>(buf, E_SHNUM);
+	bool found_symtab = false;
+	for (uint i = 0; i < shnum; ++i) {
+		size_t sh = shoff + (size_t)i * shentsize;
+		if (get<uint32_t>(buf, sh + SH_TYPE) != SHT_SYMTAB)
+			continue;
+		found_symtab = true;
+		uint32_t sym_offset = get<uint32_t>(buf, sh + SH_OFFSET);
+		uint32_t sym_size = get<uint32_t>(buf, sh + SH_SIZE);
+		uint32_t sym_entsize = get<uint32_t>(buf, sh + SH_ENTSIZE);
+		size_t strtab_sh = shoff + (size_t)get<uint32_t>(buf, sh + SH_LINK) * shentsize;
+		uint32_t str_offset = get<uint32_t>(buf, strtab_sh + SH_OFFSET);
+		uint32_t str_size = get<uint32_t>(buf, strtab_sh + SH_SIZE);
+		if (sym_entsize < SYM_SIZE)
+			sym_entsize = SYM_SIZE;
+
+		for (uint32_t s = 0; s + SYM_SIZE <= sym_size; s += sym_entsize) {
+			size_t sym = sym_offset + s;
+			uint32_t name = get<uint32_t>(buf, sym + 0);
+			uint32_t value = get<uint32_t>(buf, sym + 4);
+			uint32_t size = get<uint32_t>(buf, sym + 8);
+			uint8_t info = get<uint8_t>(buf, sym + 12);
+			uint16_t shndx = get<uint16_t>(buf, sym + 14);
+			uint type = info & 0xf;
+			uint bind = info >> 4;
+			if ((type != STT_FUNC && type != STT_NOTYPE) || shndx == SHN_UNDEF || shndx >= SHN_LORESERVE)
+				continue;
+			if (name >= str_size || str_offset + name >= buf.size())
+				continue;
+			const char *str = (const char*)&buf[str_offset + name];
+			size_t maxlen = std::min<size_t>(str_size - name, buf.size() - (str_offset + name));
+			std::string sname(str, strnlen(str, maxlen));
+			// Skip empty names, assembler-local labels and mapping symbols
+			if (sname.empty() || sname.rfind(".L", 0) == 0 || sname[0] == '$')
+				continue;
+			bool is_entry = type == STT_FUNC || bind == STB_GLOBAL || bind == STB_WEAK;
+			symbols.push_back({value, size, sname, is_entry});
+		}
+	}
+	if (!found_symtab) {
+		fprintf(stderr, "%s has no symbol table\n", path.c_str());
+		return false;
+	}
+
+	// Sort by address. Where several symbols share an address, prefer ones
+	// with a size (e.g. a function over a label at its entry point).
+	std::stable_sort(symbols.begin(), symbols.end(), [](const Symbol &a, const Symbol &b) {
+		return a.addr < b.addr || (a.addr == b.addr && a.size > b.size);
+	});
+	symbols.erase(std::unique(symbols.begin(), symbols.end(), [](const Symbol &a, const Symbol &b) {
+		return a.addr == b.addr;
+	}), symbols.end());
+	return true;
+}
+
+const RVSymbolTable::Symbol *RVSymbolTable::lookup(ux_t addr) const {
+	auto it = std::upper_bound(symbols.begin(), symbols.end(), addr, [](ux_t a, const Symbol &s) {
+		return a < s.addr;
+	});
+	if (it == symbols.begin())
+		return nullptr;
+	--it;
+	if (it->size && addr - it->addr >= it->size)
+		return nullptr;
+	return &*it;
+}
+
+std::string RVSymbolTable::format_addr(ux_t addr) const {
+	char buf[16];
+	const Symbol *sym = lookup(addr);
+	if (!sym) {
+		snprintf(buf, sizeof(buf), "%08x", addr);
+		return buf;
+	}
+	if (addr == sym->addr)
+		return sym->name;
+	snprintf(buf, sizeof(buf), "+0x%x", addr - sym->addr);
+	return sym->name + buf;
+}
+
+const RVSymbolTable::Symbol *RVSymbolTable::find(const std::string &name) const {
+	for (const Symbol &s : symbols) {
+		if (s.name == name)
+			return &s;
+	}
+	return nullptr;
+}
+
+bool RVSymbolTable::resolve(const std::string &s, ux_t &addr) const {
+	if (s.empty())
+		return false;
+	char *end;
+	unsigned long x = strtoul(s.c_str(), &end, 0);
+	if (*end == '\0') {
+		addr = x;
+		return true;
+	}
+	const Symbol *sym = find(s);
+	if (sym)
+		addr = sym->addr;
+	return sym != nullptr;
+}
@@ -0,0 +1,313 @@
+#include "rv_fault.h"
+#include "rv_core.h"
+#include "rv_isa.h"
+#include "encoding/rv_csr.h"
+#include "encoding/rv_opcodes.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <map>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char *const type_names[RVFault::N_TYPES] = {"gpr", "ram", "skip", "csr"};
+static const char *const outcome_names[RVFaultCampaign::N_OUTCOMES] = {
+	"masked", "detected", "hang", "sdc", "error"
+};
+
+// Candidates for CSR faults: the state which firmware relies on staying put
+static const uint16_t fault_csrs[] = {
+	CSR_MSTATUS, CSR_MIE, CSR_MTVEC, CSR_MSCRATCH, CSR_MEPC, CSR_MCAUSE,
+	CSR_PMPCFG0, CSR_PMPADDR0, CSR_PMPADDR1, CSR_PMPADDR2, CSR_PMPADDR3
+};
+
+std::string RVFault::describe() const {
+	char buf[64];
+	switch (type) {
+	case GPR:
+		snprintf(buf, sizeof(buf), "gpr %s bit %u", friendly_reg_names[reg], bit);
+		break;
+	case RAM:
+		snprintf(buf, sizeof(buf), "ram %08x bit %u", addr, bit);
+		break;
+	case SKIP:
+		snprintf(buf, sizeof(buf), "skip");
+		break;
+	case CSR:
+		snprintf(buf, sizeof(buf), "csr %s bit %u", rv_csr_name(csr).c_str(), bit);
+		break;
+	default:
+		buf[0] = '\0';
+		break;
+	}
+	return buf;
+}
+
+RVFaultCampaign::RVFaultCampaign(RVCore &core_, TBMemIO &io_): core(core_), io(io_) {
+	count = 0;
+	window = 1;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	jobs = cpus > 0 ? cpus : 1;
+	types = (1u << RVFault::N_TYPES) - 1;
+	log = nullptr;
+	golden_steps = 0;
+	golden_exit_code = 0;
+	for (uint t = 0; t < RVFault::N_TYPES; ++t) {
+		for (uint o = 0; o < N_OUTCOMES; ++o)
+			outcomes[t][o] = 0;
+	}
+}
+
+bool RVFaultCampaign::set_types(const std::string &list) {
+	types = 0;
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t comma = std::min(list.find(',', pos), list.size());
+		std::string name = list.substr(pos, comma - pos);
+		uint t;
+		for (t = 0; t < RVFault::N_TYPES; ++t) {
+			if (name == type_names[t])
+				break;
+		}
+		if (t == RVFault::N_TYPES)
+			return false;
+		types |= 1u << t;
+		pos = comma + 1;
+	}
+	return types != 0;
+}
+
+RVFault RVFaultCampaign::random_fault() {
+	std::vector<RVFault::Type> enabled;
+	for (uint t = 0; t < RVFault::N_TYPES; ++t) {
+		if (types & (1u << t))
+			enabled.push_back((RVFault::Type)t);
+	}
+	auto uniform = [&](uint64_t n) {
+		return std::uniform_int_distribution<uint64_t>(0, n - 1)(rng);
+	};
+	RVFault f = {};
+	f.type = enabled[uniform(enabled.size())];
+	f.delay = uniform(window);
+	if (f.type == RVFault::GPR) {
+		f.reg = 1 + uniform(31);
+		f.bit = uniform(32);
+	} else if (f.type == RVFault::RAM) {
+		uint64_t total = 0;
+		for (auto [lo, hi] : ram_ranges)
+			total += hi - lo;
+		uint64_t offs = uniform(total);
+		for (auto [lo, hi] : ram_ranges) {
+			if (offs < hi - lo) {
+				f.addr = lo + offs;
+				break;
+			}
+			offs -= hi - lo;
+		}
+		f.bit = uniform(8);
+	} else if (f.type == RVFault::CSR) {
+		f.csr = fault_csrs[uniform(sizeof(fault_csrs) / sizeof(fault_csrs[0]))];
+		f.bit = uniform(32);
+	}
+	return f;
+}
+
+void RVFaultCampaign::inject(const RVFault &f) {
+	if (f.type == RVFault::GPR) {
+		core.regs[f.reg] ^= 1u << f.bit;
+	} else if (f.type == RVFault::RAM) {
+		core.ram[(f.addr - core.ram_base) >> 2] ^= 1u << (8 * (f.addr & 0x3) + f.bit);
+	} else if (f.type == RVFault::SKIP) {
+		std::optional<uint16_t> instr = core.r16(core.pc, 0x4u);
+		if (instr)
+			core.pc += (*instr & 0x3) == 0x3 ? 4 : 2;
+	} else if (f.type == RVFault::CSR) {
+		std::optional<ux_t> value = core.csr.peek(f.csr);
+		if (value)
+			core.csr.poke(f.csr, *value ^ (1u << f.bit));
+	}
+}
+
+RVFaultCampaign::Result RVFaultCampaign::simulate(const RVFault *fault, uint64_t max_steps,
+		std::string &output, std::vector<ux_t> *exceptions) {
+	io.output = &output;
+	uint64_t steps = 0;
+	size_t n_exceptions = 0;
+	try {
+		while (steps < max_steps) {
+			if (fault && steps == fault->delay)
+				inject(*fault);
+			rv_step_with_io(core, io);
+			++steps;
+			const std::optional<ux_t> &cause = core.step_info.trap_cause;
+			if (cause && !(*cause >> 31)) {
+				if (exceptions) {
+					exceptions->push_back(*cause);
+				} else if (n_exceptions >= golden_exceptions.size() ||
+						golden_exceptions[n_exceptions] != *cause) {
+					return {DETECTED, *cause, steps};
+				}
+				++n_exceptions;
+			}
+		}
+	}
+	catch (TBExitException e) {
+		bool match = e.exitcode == golden_exit_code && output == golden_output;
+		return {match ? MASKED : SDC, e.exitcode, steps};
+	}
+	return {HANG, 0, steps};
+}
+
+int RVFaultCampaign::run(uint64_t at, uint64_t max_steps) {
+	core.trace_writer = nullptr;
+	core.flight_recorder = nullptr;
+	core.heatmap = nullptr;
+	core.reverse = nullptr;
+
+	try {
+		for (uint64_t i = 0; i < at; ++i)
+			rv_step_with_io(core, io);
+	}
+	catch (TBExitException e) {
+		fprintf(stderr, "CPU exited before the fault injection point\n");
+		return -1;
+	}
+
+	// Keep the state at the injection point while the golden run goes on
+	std::vector<uint8_t> snapshot;
+	RVSnapshotIO save(snapshot, false);
+	core.serialise(save);
+	io.serialise(save);
+
+	Result golden = simulate(nullptr, max_steps, golden_output, &golden_exceptions);
+	if (golden.outcome == HANG || golden.steps == 0) {
+		fprintf(stderr, "Golden run did not exit within %" PRIu64 " steps of the injection point\n", max_steps);
+		return -1;
+	}
+	golden_steps = golden.steps;
+	golden_exit_code = golden.detail;
+	io.output = nullptr;
+
+	RVSnapshotIO restore(snapshot, true);
+	core.serialise(restore);
+	io.serialise(restore);
+	snapshot.clear();
+
+	if (ram_ranges.empty()) {
+		const uint32_t page_size = RVSnapshotIO::PAGE_SIZE;
+		for (ux_t page = core.ram_base; page < core.ram_top; page += page_size) {
+			ux_t end = std::min(page + page_size, core.ram_top);
+			for (ux_t a = page; a < end; a += 4) {
+				if (core.ram[(a - core.ram_base) >> 2]) {
+					ram_ranges.push_back({page, end});
+					break;
+				}
+			}
+		}
+		if (ram_ranges.empty())
+			types &= ~(1u << RVFault::RAM);
+	}
+	if (!types) {
+		fprintf(stderr, "No RAM to inject faults into\n");
+		return -1;
+	}
+	// Inject before the golden run exits, else the fault does nothing
+	window = std::min(window, golden_steps);
+	uint64_t hang_steps = 2 * golden_steps + 10000;
+
+	struct Child {
+		uint64_t index;
+		RVFault fault;
+		int fd;
+	};
+	std::map<pid_t, Child> running;
+	uint64_t launched = 0;
+	uint64_t finished = 0;
+	fflush(stdout);
+	fflush(stderr);
+	if (log)
+		fprintf(log, "index,delay,fault,outcome,detail,steps\n");
+	while (finished < count) {
+		while (launched < count && running.size() < jobs) {
+			RVFault fault = random_fault();
+			int fds[2];
+			if (pipe(fds) != 0) {
+				perror("pipe");
+				return -1;
+			}
+			pid_t pid = fork();
+			if (pid < 0) {
+				perror("fork");
+				return -1;
+			}
+			if (pid == 0) {
+				// Drop the read ends of every pipe, including those of the
+				// children still running, which this one inherited
+				close(fds[0]);
+				for (const auto &[sibling_pid, sibling] : running)
+					close(sibling.fd);
+				std::string output;
+				Result r = simulate(&fault, hang_steps, output, nullptr);
+				ssize_t written = write(fds[1], &r, sizeof(r));
+				_exit(written == sizeof(r) ? 0 : 1);
+			}
+			close(fds[1]);
+			running[pid] = {launched, fault, fds[0]};
+			++launched;
+		}
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			perror("waitpid");
+			return -1;
+		}
+		auto it = running.find(pid);
+		if (it == running.end())
+			continue;
+		const Child &child = it->second;
+		Result r;
+		if (read(child.fd, &r, sizeof(r)) != sizeof(r) || r.outcome >= N_OUTCOMES)
+			r = {ERROR, (uint32_t)status, 0};
+		close(child.fd);
+		++outcomes[child.fault.type][r.outcome];
+		if (log) {
+			fprintf(log, "%" PRIu64 ",%" PRIu64 ",%s,%s,%u,%" PRIu64 "\n", child.index, child.fault.delay,
+				child.fault.describe().c_str(), outcome_names[r.outcome], r.detail, r.steps);
+		}
+		running.erase(it);
+		++finished;
+	}
+	print_summary(stderr);
+	return 0;
+}
+
+void RVFaultCampaign::print_summary(FILE *f) {
+	fprintf(f, "Fault injection: %" PRIu64 " faults within %" PRIu64 " steps of the injection point\n",
+		count, window);
+	fprintf(f, "Golden run: %" PRIu64 " steps, %zu exceptions, exit code %d\n",
+		golden_steps, golden_exceptions.size(), (int)golden_exit_code);
+	fprintf(f, "          ");
+	for (uint o = 0; o < N_OUTCOMES; ++o)
+		fprintf(f, " %10s", outcome_names[o]);
+	fprintf(f, "\n");
+	uint64_t totals[N_OUTCOMES] = {0};
+	for (uint t = 0; t < RVFault::N_TYPES; ++t) {
+		if (!(types & (1u << t)))
+			continue;
+		fprintf(f, "  %-8s", type_names[t]);
+		for (uint o = 0; o < N_OUTCOMES; ++o) {
+			fprintf(f, " %10" PRIu64, outcomes[t][o]);
+			totals[o] += outcomes[t][o];
+		}
+		fprintf(f, "\n");
+	}
+	fprintf(f, "  %-8s", "total");
+	for (uint o = 0; o < N_OUTCOMES; ++o)
+		fprintf(f, " %10" PRIu64, totals[o]);
+	fprintf(f, "\n");
+	fprintf(f, "          ");
+	for (uint o = 0; o < N_OUTCOMES; ++o)
+		fprintf(f, " %9.2f%%", count ? 100.0 * totals[o] / count : 0.0);
+	fprintf(f, "\n");
+}
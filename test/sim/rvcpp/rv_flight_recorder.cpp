@@ -0,0 +1,108 @@
+#include "rv_flight_recorder.h"
+
+#include <cinttypes>
+#include <cstdlib>
+
+bool RVFlightRecorder::add_trigger(const std::string &spec) {
+	size_t eq = spec.find('=');
+	std::string name = spec.substr(0, eq);
+	std::string arg = eq == std::string::npos ? "" : spec.substr(eq + 1);
+	bool has_arg = eq != std::string::npos;
+	if (name == "exception") {
+		if (!has_arg) {
+			on_any_exception = true;
+			return true;
+		}
+		char *end;
+		unsigned long cause = strtoul(arg.c_str(), &end, 0);
+		if (arg.empty() || *end != '\0')
+			return false;
+		on_exception_causes.push_back(cause);
+		return true;
+	} else if (name == "pc" && has_arg) {
+		ux_t addr;
+		if (!symbols.resolve(arg, addr))
+			return false;
+		on_pcs.push_back(addr);
+		return true;
+	} else if (has_arg) {
+		return false;
+	} else if (name == "irq") {
+		on_irq = true;
+	} else if (name == "exit") {
+		on_exit = true;
+	} else if (name == "timeout") {
+		on_timeout = true;
+	} else if (name == "watch") {
+		on_watch = true;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void RVFlightRecorder::step(ux_t pc, bool sleeping, std::optional<ux_t> trap_cause) {
+	char reason[64];
+	if (trap_cause) {
+		bool irq = *trap_cause >> 31;
+		uint cause = *trap_cause & ((1u << 31) - 1);
+		if (irq && on_irq) {
+			snprintf(reason, sizeof(reason), "IRQ + %u", cause);
+			dump(reason);
+		} else if (!irq) {
+			bool match = on_any_exception;
+			for (uint c : on_exception_causes)
+				match = match || c == cause;
+			if (match) {
+				snprintf(reason, sizeof(reason), "exception cause %u", cause);
+				dump(reason);
+			}
+		}
+	} else if (!sleeping) {
+		for (ux_t trigger_pc : on_pcs) {
+			if (pc == trigger_pc) {
+				dump("PC " + symbols.format_addr(pc));
+				break;
+			}
+		}
+	}
+}
+
+void RVFlightRecorder::exited(ux_t exit_code, ux_t pc) {
+	if (on_exit && exit_code != 0) {
+		char reason[64];
+		snprintf(reason, sizeof(reason), "exit code %d", (int)exit_code);
+		dump(std::string(reason) + " at " + symbols.format_addr(pc));
+	}
+}
+
+void RVFlightRecorder::timed_out(int64_t cycles) {
+	if (on_timeout) {
+		char reason[64];
+		snprintf(reason, sizeof(reason), "timeout after %" PRId64 " cycles", cycles);
+		dump(reason);
+	}
+}
+
+void RVFlightRecorder::watch_hit(const std::string &what) {
+	if (on_watch)
+		dump(what);
+}
+
+void RVFlightRecorder::dump(const std::string &reason) {
+	if (dumps == MAX_DUMPS)
+		return;
+	++dumps;
+	fprintf(out, "Flight recorder: %s, last %zu entries:\n", reason.c_str(), count);
+	RVTracePrinter printer(symbols, true);
+	for (size_t i = 0; i < count; ++i) {
+		const Entry &e = ring[(head + ring.size() - count + i) % ring.size()];
+		printer.print(out, e.rec);
+		if (e.repeats)
+			fprintf(out, "                   : (repeated %" PRIu64 " more times)\n", e.repeats);
+	}
+	if (dumps == MAX_DUMPS)
+		fprintf(out, "Flight recorder: dump limit reached, ignoring further triggers\n");
+	fprintf(out, "\n");
+	count = 0;
+}
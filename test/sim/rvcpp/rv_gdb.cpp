@@ -0,0 +1,462 @@
+#include "rv_gdb.h"
+#include "rv_core.h"
+#include "encoding/rv_csr.h"
+
+#include <cstring>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Check for Ctrl-C from GDB this often while running
+static const uint64_t INTERRUPT_POLL_STEPS = 1u << 14;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// Parse a hex number starting at pos, and advance pos past it. Returns false
+// if there are no hex digits.
+static bool parse_hex(const std::string &s, size_t &pos, uint64_t &value) {
+	size_t start = pos;
+	value = 0;
+	while (pos < s.size() && hex_value(s[pos]) >= 0)
+		value = value << 4 | hex_value(s[pos++]);
+	return pos > start;
+}
+
+static bool expect(const std::string &s, size_t &pos, char c) {
+	if (pos < s.size() && s[pos] == c) {
+		++pos;
+		return true;
+	}
+	return false;
+}
+
+// Registers are sent as target-endian (little-endian) hex bytes
+static void append_reg(std::string &out, ux_t value) {
+	for (uint i = 0; i < sizeof(ux_t); ++i) {
+		uint8_t b = value >> 8 * i;
+		out += hex_digits[b >> 4];
+		out += hex_digits[b & 0xf];
+	}
+}
+
+static bool parse_reg(const std::string &s, size_t pos, ux_t &value) {
+	if (s.size() - pos < 2 * sizeof(ux_t))
+		return false;
+	value = 0;
+	for (uint i = 0; i < sizeof(ux_t); ++i) {
+		int hi = hex_value(s[pos + 2 * i]);
+		int lo = hex_value(s[pos + 2 * i + 1]);
+		if (hi < 0 || lo < 0)
+			return false;
+		value |= (ux_t)(hi << 4 | lo) << 8 * i;
+	}
+	return true;
+}
+
+RVGDBServer::RVGDBServer(RVCore &core_, TBMemIO &io_, std::function<uint()> step_, uint64_t max_cycles_):
+		core(core_), io(io_), step(step_) {
+	max_cycles = max_cycles_;
+	cycles = 0;
+	listen_fd = -1;
+	fd = -1;
+	no_ack = false;
+	timed_out = false;
+	hit_hw_breakpoint = false;
+}
+
+RVGDBServer::~RVGDBServer() {
+	if (fd >= 0)
+		close(fd);
+	if (listen_fd >= 0)
+		close(listen_fd);
+	if (!unix_path.empty())
+		unlink(unix_path.c_str());
+}
+
+bool RVGDBServer::listen(const std::string &spec) {
+	bool is_port = !spec.empty() && spec.find_first_not_of("0123456789") == std::string::npos;
+	if (is_port) {
+		listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+		int opt = 1;
+		if (listen_fd >= 0)
+			setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+		struct sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(std::stoul(spec));
+		if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+			fprintf(stderr, "Failed to bind to localhost port %s\n", spec.c_str());
+			return false;
+		}
+	} else {
+		listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		struct sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		if (spec.size() >= sizeof(addr.sun_path)) {
+			fprintf(stderr, "Socket path %s is too long\n", spec.c_str());
+			return false;
+		}
+		strcpy(addr.sun_path, spec.c_str());
+		unlink(spec.c_str());
+		if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+			fprintf(stderr, "Failed to bind to socket %s\n", spec.c_str());
+			return false;
+		}
+		unix_path = spec;
+	}
+	if (::listen(listen_fd, 1) < 0) {
+		fprintf(stderr, "Failed to listen on %s\n", spec.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool RVGDBServer::get_packet(std::string &packet) {
+	// $data#cc, ignoring acks and anything else between packets
+	enum {WAIT, DATA, CSUM0, CSUM1} state = WAIT;
+	uint8_t sum = 0;
+	int csum = 0;
+	packet.clear();
+	while (true) {
+		char c;
+		if (read(fd, &c, 1) != 1)
+			return false;
+		if (state == WAIT) {
+			if (c == '$') {
+				state = DATA;
+				sum = 0;
+				packet.clear();
+			}
+		} else if (state == DATA) {
+			if (c == '#') {
+				state = CSUM0;
+			} else {
+				packet += c;
+				sum += c;
+			}
+		} else if (state == CSUM0) {
+			csum = hex_value(c) << 4;
+			state = CSUM1;
+		} else {
+			csum |= hex_value(c);
+			if (no_ack)
+				return true;
+			if (csum == sum) {
+				if (write(fd, "+", 1) != 1)
+					return false;
+				return true;
+			}
+			if (write(fd, "-", 1) != 1)
+				return false;
+			state = WAIT;
+		}
+	}
+}
+
+bool RVGDBServer::put_packet(const std::string &data) {
+	std::string out = "$";
+	uint8_t sum = 0;
+	for (char c : data) {
+		// Escape the characters which would break framing
+		if (c == '$' || c == '#' || c == '}' || c == '*') {
+			out += '}';
+			sum += '}';
+			c ^= 0x20;
+		}
+		out += c;
+		sum += c;
+	}
+	out += '#';
+	out += hex_digits[sum >> 4];
+	out += hex_digits[sum & 0xf];
+	size_t done = 0;
+	while (done < out.size()) {
+		ssize_t n = write(fd, out.data() + done, out.size() - done);
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+bool RVGDBServer::interrupt_pending() {
+	struct pollfd pfd = {fd, POLLIN, 0};
+	if (fd < 0 || poll(&pfd, 1, 0) <= 0)
+		return false;
+	char c;
+	if (read(fd, &c, 1) != 1)
+		return false;
+	return c == 0x03;
+}
+
+RVGDBServer::Stop RVGDBServer::resume(bool single_step) {
+	if (core.csr.get_debug_mode())
+		core.debug_resume();
+	try {
+		for (uint64_t i = 0; ; ++i) {
+			bool asleep = core.stalled_on_wfi || core.stalled_on_block;
+			if (i > 0 && !asleep && (sw_breakpoints.count(core.pc) || hw_breakpoints.count(core.pc))) {
+				hit_hw_breakpoint = !sw_breakpoints.count(core.pc);
+				return STOP_BREAKPOINT;
+			}
+			if (i > 0 && i % INTERRUPT_POLL_STEPS == 0 && interrupt_pending())
+				return STOP_INTERRUPT;
+			if (cycles >= max_cycles) {
+				timed_out = true;
+				return STOP_TIMEOUT;
+			}
+			cycles += step();
+			if (watch.hit)
+				return STOP_WATCHPOINT;
+			if (core.csr.get_debug_mode())
+				return STOP_DEBUG_HALT;
+			if (single_step && !core.stalled_on_wfi && !core.stalled_on_block)
+				return STOP_STEP;
+		}
+	}
+	catch (TBExitException e) {
+		exit_code = e.exitcode;
+		return STOP_EXIT;
+	}
+}
+
+std::string RVGDBServer::stop_reply(Stop stop) {
+	char buf[64];
+	switch (stop) {
+	case STOP_BREAKPOINT:
+		return hit_hw_breakpoint ? "T05hwbreak:;" : "T05swbreak:;";
+	case STOP_WATCHPOINT: {
+		const char *kind = watch.hit->type == RVWatchpoints::WRITE ? "watch" :
+			watch.hit->type == RVWatchpoints::READ ? "rwatch" : "awatch";
+		snprintf(buf, sizeof(buf), "T05%s:%x;", kind, watch.hit->addr);
+		return buf;
+	}
+	case STOP_INTERRUPT:
+		return "S02";
+	case STOP_DEBUG_HALT:
+		return core.csr.get_dcsr_cause() == DCSR_CAUSE_SWBP ? "T05swbreak:;" :
+			core.csr.get_dcsr_cause() == DCSR_CAUSE_HWBP ? "T05hwbreak:;" : "S05";
+	case STOP_EXIT:
+		snprintf(buf, sizeof(buf), "W%02x", *exit_code & 0xff);
+		return buf;
+	case STOP_TIMEOUT:
+		// SIGALRM
+		return "X0e";
+	default:
+		return "S05";
+	}
+}
+
+std::optional<uint8_t> RVGDBServer::read_mem(ux_t addr) {
+	// Debugger accesses bypass PMP and the watchpoints
+	if (addr >= core.ram_base && addr < core.ram_top)
+		return core.ram[(addr - core.ram_base) >> 2] >> 8 * (addr & 0x3) & 0xffu;
+	return core.mem.r8(addr);
+}
+
+bool RVGDBServer::write_mem(ux_t addr, uint8_t data) {
+	if (addr >= core.ram_base && addr < core.ram_top) {
+		ux_t &word = core.ram[(addr - core.ram_base) >> 2];
+		word = (word & ~(0xffu << 8 * (addr & 0x3))) | (ux_t)data << 8 * (addr & 0x3);
+		return true;
+	}
+	return core.mem.w8(addr, data);
+}
+
+std::optional<ux_t> RVGDBServer::read_reg(uint regnum) {
+	if (regnum < 32)
+		return core.regs[regnum];
+	if (regnum == GDB_REG_PC)
+		return core.pc;
+	if (regnum >= GDB_REG_CSR0 && regnum < GDB_REG_CSR0 + 4096)
+		return core.csr.peek(regnum - GDB_REG_CSR0);
+	return std::nullopt;
+}
+
+bool RVGDBServer::write_reg(uint regnum, ux_t data) {
+	if (regnum == 0)
+		return true;
+	if (regnum < 32) {
+		core.regs[regnum] = data;
+		return true;
+	}
+	if (regnum == GDB_REG_PC) {
+		core.pc = data & ~(ux_t)1;
+		// Resuming from a halt goes to dpc
+		if (core.csr.get_debug_mode())
+			core.csr.poke(CSR_DPC, core.pc);
+		return true;
+	}
+	if (regnum >= GDB_REG_CSR0 && regnum < GDB_REG_CSR0 + 4096)
+		return core.csr.poke(regnum - GDB_REG_CSR0, data);
+	return false;
+}
+
+std::optional<std::string> RVGDBServer::handle(const std::string &packet, bool &finished) {
+	size_t pos = 1;
+	uint64_t addr, len, value;
+	char cmd = packet.empty() ? 0 : packet[0];
+
+	if (cmd == '?') {
+		return std::string("S05");
+	} else if (cmd == 'g') {
+		std::string out;
+		for (uint i = 0; i <= GDB_REG_PC; ++i)
+			append_reg(out, *read_reg(i));
+		return out;
+	} else if (cmd == 'G') {
+		for (uint i = 0; i <= GDB_REG_PC; ++i) {
+			ux_t data;
+			if (!parse_reg(packet, 1 + 2 * sizeof(ux_t) * i, data))
+				return std::string("E01");
+			write_reg(i, data);
+		}
+		return std::string("OK");
+	} else if (cmd == 'p') {
+		std::optional<ux_t> data;
+		if (parse_hex(packet, pos, value))
+			data = read_reg(value);
+		if (!data)
+			return std::string("E01");
+		std::string out;
+		append_reg(out, *data);
+		return out;
+	} else if (cmd == 'P') {
+		ux_t data;
+		if (!parse_hex(packet, pos, value) || !expect(packet, pos, '=') || !parse_reg(packet, pos, data) ||
+				!write_reg(value, data))
+			return std::string("E01");
+		return std::string("OK");
+	} else if (cmd == 'm') {
+		if (!parse_hex(packet, pos, addr) || !expect(packet, pos, ',') || !parse_hex(packet, pos, len))
+			return std::string("E01");
+		std::string out;
+		for (uint64_t i = 0; i < len; ++i) {
+			std::optional<uint8_t> b = read_mem(addr + i);
+			if (!b)
+				return i ? out : std::string("E01");
+			out += hex_digits[*b >> 4];
+			out += hex_digits[*b & 0xf];
+		}
+		return out;
+	} else if (cmd == 'M') {
+		if (!parse_hex(packet, pos, addr) || !expect(packet, pos, ',') || !parse_hex(packet, pos, len) ||
+				!expect(packet, pos, ':') || packet.size() - pos < 2 * len)
+			return std::string("E01");
+		for (uint64_t i = 0; i < len; ++i) {
+			int hi = hex_value(packet[pos + 2 * i]);
+			int lo = hex_value(packet[pos + 2 * i + 1]);
+			if (hi < 0 || lo < 0 || !write_mem(addr + i, hi << 4 | lo))
+				return std::string("E01");
+		}
+		return std::string("OK");
+	} else if (cmd == 'c' || cmd == 's' || packet.rfind("vCont;", 0) == 0) {
+		bool single_step;
+		if (cmd == 'v') {
+			// All-stop, single hart: only the first action matters
+			pos = 6;
+			single_step = pos < packet.size() && (packet[pos] == 's' || packet[pos] == 'S');
+		} else {
+			single_step = cmd == 's';
+			if (parse_hex(packet, pos, addr))
+				core.pc = addr;
+		}
+		watch.hit = std::nullopt;
+		Stop stop = resume(single_step);
+		if (stop == STOP_EXIT || stop == STOP_TIMEOUT)
+			finished = true;
+		return stop_reply(stop);
+	} else if (packet == "vCont?") {
+		return std::string("vCont;c;s");
+	} else if (cmd == 'Z' || cmd == 'z') {
+		uint64_t type;
+		if (!parse_hex(packet, pos, type) || !expect(packet, pos, ',') || !parse_hex(packet, pos, addr) ||
+				!expect(packet, pos, ',') || !parse_hex(packet, pos, len) || type > 4)
+			return std::string("E01");
+		bool insert = cmd == 'Z';
+		if (type <= 1) {
+			std::unordered_set<ux_t> &set = type == 0 ? sw_breakpoints : hw_breakpoints;
+			if (insert)
+				set.insert(addr);
+			else
+				set.erase(addr);
+		} else {
+			uint wtype = type == 2 ? RVWatchpoints::WRITE : type == 3 ? RVWatchpoints::READ : RVWatchpoints::ACCESS;
+			if (insert)
+				watch.add(addr, len, wtype);
+			else if (!watch.remove(addr, len, wtype))
+				return std::string("E01");
+			core.watch = watch.empty() ? nullptr : &watch;
+		}
+		return std::string("OK");
+	} else if (cmd == 'D') {
+		// Detach, and let the program run to completion
+		put_packet("OK");
+		close(fd);
+		fd = -1;
+		sw_breakpoints.clear();
+		hw_breakpoints.clear();
+		watch.clear();
+		core.watch = nullptr;
+		resume(false);
+		finished = true;
+		return std::nullopt;
+	} else if (cmd == 'k') {
+		finished = true;
+		return std::nullopt;
+	} else if (cmd == 'H' || cmd == 'T') {
+		return std::string("OK");
+	} else if (packet.rfind("qSupported", 0) == 0) {
+		return std::string("PacketSize=4000;QStartNoAckMode+;swbreak+;hwbreak+;vContSupported+");
+	} else if (packet == "QStartNoAckMode") {
+		put_packet("OK");
+		no_ack = true;
+		return std::nullopt;
+	} else if (packet == "qAttached") {
+		return std::string("1");
+	} else if (packet == "qC") {
+		return std::string("QC1");
+	} else if (packet == "qfThreadInfo") {
+		return std::string("m1");
+	} else if (packet == "qsThreadInfo") {
+		return std::string("l");
+	}
+	// Empty reply: not supported
+	return std::string();
+}
+
+bool RVGDBServer::run() {
+	fprintf(stderr, "Waiting for GDB connection\n");
+	fd = accept(listen_fd, nullptr, nullptr);
+	if (fd < 0) {
+		perror("accept");
+		return false;
+	}
+	fprintf(stderr, "GDB connected\n");
+	bool finished = false;
+	std::string packet;
+	while (!finished) {
+		if (!get_packet(packet)) {
+			fprintf(stderr, "GDB disconnected\n");
+			break;
+		}
+		std::optional<std::string> reply = handle(packet, finished);
+		if (reply && !put_packet(*reply))
+			break;
+	}
+	core.watch = nullptr;
+	return true;
+}
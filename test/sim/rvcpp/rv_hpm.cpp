@@ -0,0 +1,78 @@
+#include "rv_hpm.h"
+#include "rv_core.h"
+#include "encoding/rv_opcodes.h"
+
+#include <cinttypes>
+
+#define BITS_UPTO(msb) (~((-1u << (msb)) << 1))
+#define BITRANGE(msb, lsb) (BITS_UPTO((msb) - (lsb)) << (lsb))
+#define GETBITS(x, msb, lsb) (((x) & BITRANGE(msb, lsb)) >> (lsb))
+#define GETBIT(x, bit) (((x) >> (bit)) & 1u)
+
+const char *const hpm_event_names[N_HPM_EVENTS] = {
+	"none",
+	"loads",
+	"stores",
+	"branches",
+	"branches taken",
+	"mispredicts",
+	"load-use stalls",
+	"divides",
+	"compressed",
+	"traps"
+};
+
+uint32_t hpm_instr_events(uint32_t instr, bool taken) {
+	uint32_t events = 0;
+	bool is_branch = false;
+	if ((instr & 0x3) == 0x3) {
+		uint opc = GETBITS(instr, 6, 2);
+		if (opc == RVCore::OPC_LOAD || RVOPC_MATCH(instr, LR_W))
+			events |= 1u << HPM_EVENT_LOAD;
+		else if (opc == RVCore::OPC_STORE || RVOPC_MATCH(instr, SC_W))
+			events |= 1u << HPM_EVENT_STORE;
+		else if (opc == RVCore::OPC_BRANCH)
+			is_branch = true;
+		else if (opc == RVCore::OPC_OP && GETBITS(instr, 31, 25) == 0x01 && GETBIT(instr, 14))
+			events |= 1u << HPM_EVENT_DIV;
+	} else {
+		events |= 1u << HPM_EVENT_COMPRESSED;
+		// Zcb loads and stores are all in quadrant 0, funct3 = 100. Bit 11
+		// distinguishes stores from loads.
+		bool zcb_ls = (instr & 0xe003u) == 0x8000u;
+		if (RVOPC_MATCH(instr, C_LW) || RVOPC_MATCH(instr, C_LWSP) || (zcb_ls && !GETBIT(instr, 11)) ||
+				RVOPC_MATCH(instr, CM_POP) || RVOPC_MATCH(instr, CM_POPRET) || RVOPC_MATCH(instr, CM_POPRETZ))
+			events |= 1u << HPM_EVENT_LOAD;
+		else if (RVOPC_MATCH(instr, C_SW) || RVOPC_MATCH(instr, C_SWSP) || (zcb_ls && GETBIT(instr, 11)) ||
+				RVOPC_MATCH(instr, CM_PUSH))
+			events |= 1u << HPM_EVENT_STORE;
+		else if (RVOPC_MATCH(instr, C_BEQZ) || RVOPC_MATCH(instr, C_BNEZ))
+			is_branch = true;
+	}
+	if (is_branch) {
+		events |= 1u << HPM_EVENT_BRANCH;
+		if (taken)
+			events |= 1u << HPM_EVENT_BRANCH_TAKEN;
+	}
+	return events;
+}
+
+void RVHPMTotals::print_summary(FILE *f, bool timing_enabled, RVCSR &csr) const {
+	fprintf(f, "Event totals:\n");
+	for (uint i = 1; i < N_HPM_EVENTS; ++i) {
+		bool needs_timing = i == HPM_EVENT_MISPREDICT || i == HPM_EVENT_LOAD_USE;
+		fprintf(f, "  %2u %-16s %12" PRIu64 "%s\n", i, hpm_event_names[i], count[i],
+			needs_timing && !timing_enabled ? "  (needs --timing)" : "");
+	}
+	bool any_programmed = false;
+	for (uint i = 0; i < N_HPM_COUNTERS; ++i) {
+		ux_t event = csr.get_hpm_event(i);
+		if (event == HPM_EVENT_NONE)
+			continue;
+		if (!any_programmed)
+			fprintf(f, "Programmed counters:\n");
+		any_programmed = true;
+		fprintf(f, "  mhpmcounter%-2u %-16s %12" PRIu64 "\n", i + 3, hpm_event_names[event],
+			csr.get_hpm_counter(i));
+	}
+}
@@ -0,0 +1,136 @@
+#include "rv_instr_mix.h"
+#include "rv_isa.h"
+#include "encoding/rv_opcodes.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <map>
+#include <string>
+
+#define BITS_UPTO(msb) (~((-1u << (msb)) << 1))
+#define BITRANGE(msb, lsb) (BITS_UPTO((msb) - (lsb)) << (lsb))
+#define GETBITS(x, msb, lsb) (((x) & BITRANGE(msb, lsb)) >> (lsb))
+#define GETBIT(x, bit) (((x) >> (bit)) & 1u)
+
+// Size in bytes of the RV32C sequence equivalent to a Zcmp instruction
+static uint zcmp_equivalent_bytes(uint32_t instr) {
+	if (RVOPC_MATCH(instr, CM_MVSA01) || RVOPC_MATCH(instr, CM_MVA01S))
+		return 4;
+	// rlist 4 is {ra}, 5..14 is {ra, s0..s(rlist - 5)}, 15 is {ra, s0..s11}
+	uint rlist = GETBITS(instr, 7, 4);
+	uint nregs = rlist == 15 ? 13 : rlist - 3;
+	uint bytes = 2 * nregs + 2;
+	if (RVOPC_MATCH(instr, CM_POPRET))
+		bytes += 2;
+	else if (RVOPC_MATCH(instr, CM_POPRETZ))
+		bytes += 4;
+	return bytes;
+}
+
+static double percent(uint64_t x, uint64_t total) {
+	return total ? 100.0 * x / total : 0.0;
+}
+
+void RVInstrMix::print_summary(FILE *f, const RVSymbolTable &symbols, uint top_n) const {
+	// Fold encodings into mnemonics. The extra entry is for unknown encodings.
+	std::vector<uint64_t> by_instr(rv_instr_table_size + 1);
+	uint64_t n16 = 0;
+	uint64_t n32 = 0;
+	uint64_t zcmp_count = 0;
+	uint64_t zcmp_bytes = 0;
+	uint64_t zcmp_equiv_bytes = 0;
+	auto add = [&](uint32_t instr, uint64_t count) {
+		int i = rv_instr_lookup(instr);
+		by_instr[i < 0 ? rv_instr_table_size : i] += count;
+		if ((instr & 0x3) == 0x3) {
+			n32 += count;
+		} else {
+			n16 += count;
+			if (i >= 0 && rv_instr_table[i].ext == EXT_ZCMP) {
+				zcmp_count += count;
+				zcmp_bytes += 2 * count;
+				zcmp_equiv_bytes += zcmp_equivalent_bytes(instr) * count;
+			}
+		}
+	};
+	for (uint32_t instr = 0; instr < count16.size(); ++instr) {
+		if (count16[instr])
+			add(instr, count16[instr]);
+	}
+	for (auto &[instr, count] : count32)
+		add(instr, count);
+
+	uint64_t total = n16 + n32;
+	uint64_t total_bytes = 2 * n16 + 4 * n32;
+	fprintf(f, "Instruction mix: %" PRIu64 " instructions, %" PRIu64 " bytes fetched\n", total, total_bytes);
+	fprintf(f, "  16-bit: %12" PRIu64 " instrs (%5.1f%%) %12" PRIu64 " bytes (%5.1f%%)\n",
+		n16, percent(n16, total), 2 * n16, percent(2 * n16, total_bytes));
+	fprintf(f, "  32-bit: %12" PRIu64 " instrs (%5.1f%%) %12" PRIu64 " bytes (%5.1f%%)\n",
+		n32, percent(n32, total), 4 * n32, percent(4 * n32, total_bytes));
+	if (total)
+		fprintf(f, "  Average fetch: %.2f bytes per instruction\n", (double)total_bytes / total);
+
+	uint64_t by_ext[N_EXTS] = {0};
+	for (uint i = 0; i < rv_instr_table_size; ++i)
+		by_ext[rv_instr_table[i].ext] += by_instr[i];
+	fprintf(f, "By extension:\n");
+	for (uint e = 0; e < N_EXTS; ++e) {
+		if (by_ext[e])
+			fprintf(f, "  %-10s %12" PRIu64 " %5.1f%%\n", rv_ext_names[e], by_ext[e], percent(by_ext[e], total));
+	}
+	if (by_instr[rv_instr_table_size]) {
+		fprintf(f, "  %-10s %12" PRIu64 " %5.1f%%\n", "unknown", by_instr[rv_instr_table_size],
+			percent(by_instr[rv_instr_table_size], total));
+	}
+
+	std::vector<uint> order;
+	for (uint i = 0; i < rv_instr_table_size; ++i) {
+		if (by_instr[i])
+			order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&](uint a, uint b) {
+		return by_instr[a] > by_instr[b];
+	});
+	fprintf(f, "Top instructions:\n");
+	for (uint i = 0; i < order.size() && i < top_n; ++i) {
+		const RVInstrDesc &d = rv_instr_table[order[i]];
+		fprintf(f, "  %-12s %-10s %12" PRIu64 " %5.1f%%\n", d.name, rv_ext_names[d.ext],
+			by_instr[order[i]], percent(by_instr[order[i]], total));
+	}
+
+	if (zcmp_count) {
+		fprintf(f, "Zcmp: %" PRIu64 " instructions, %" PRIu64 " bytes fetched, vs %" PRIu64
+			" bytes for equivalent RV32C sequences\n", zcmp_count, zcmp_bytes, zcmp_equiv_bytes);
+		fprintf(f, "  Fetch bytes saved: %" PRIu64 " (%.1f%% of fetch bytes without Zcmp)\n", zcmp_equiv_bytes - zcmp_bytes,
+			percent(zcmp_equiv_bytes - zcmp_bytes, total_bytes + zcmp_equiv_bytes - zcmp_bytes));
+	}
+
+	// Fold fetch bytes by function, or by 1 kiB block if there are no symbols
+	std::map<std::string, uint64_t> regions;
+	for (uint32_t i = 0; i < n_halfwords; ++i) {
+		if (!fetch_bytes[i])
+			continue;
+		ux_t addr = base + 2 * i;
+		const RVSymbolTable::Symbol *sym = symbols.lookup(addr);
+		std::string name;
+		if (sym) {
+			name = sym->name;
+		} else {
+			char buf[32];
+			snprintf(buf, sizeof(buf), "%08x-%08x", addr & ~0x3ffu, (addr | 0x3ffu) + 1);
+			name = buf;
+		}
+		regions[name] += fetch_bytes[i];
+	}
+	if (other_fetch_bytes)
+		regions["(outside image)"] += other_fetch_bytes;
+	std::vector<std::pair<std::string, uint64_t>> region_list(regions.begin(), regions.end());
+	std::sort(region_list.begin(), region_list.end(), [](const auto &a, const auto &b) {
+		return a.second > b.second;
+	});
+	fprintf(f, "Fetch bytes by %s:\n", symbols.empty() ? "region" : "function");
+	for (uint i = 0; i < region_list.size() && i < top_n; ++i) {
+		fprintf(f, "  %12" PRIu64 " %5.1f%%  %s\n", region_list[i].second,
+			percent(region_list[i].second, total_bytes), region_list[i].first.c_str());
+	}
+}
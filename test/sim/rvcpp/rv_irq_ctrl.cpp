@@ -0,0 +1,222 @@
+#include "rv_irq_ctrl.h"
+#include "rv_snapshot.h"
+#include "encoding/rv_csr.h"
+
+void RVIRQCtrl::reset(uint num_irqs_) {
+	num_irqs = num_irqs_ > MAX_IRQS ? MAX_IRQS : num_irqs_;
+	for (uint w = 0; w < N_WORDS; ++w) {
+		if (num_irqs >= 32 * (w + 1))
+			impl_mask[w] = 0xffffffffu;
+		else if (num_irqs > 32 * w)
+			impl_mask[w] = 0xffffffffu >> (32 - (num_irqs - 32 * w));
+		else
+			impl_mask[w] = 0;
+		irq_in_next[w] = 0;
+		irq_in[w] = 0;
+		meiea[w] = 0;
+		meifa[w] = 0;
+	}
+	for (uint i = 0; i < MAX_IRQS; ++i)
+		meipra[i] = 0;
+	for (uint p = 0; p < N_PRIORITIES; ++p) {
+		for (uint w = 0; w < N_WORDS; ++w) {
+			pri_bucket[p][w] = p == 0 ? impl_mask[w] : 0;
+			active[p][w] = 0;
+		}
+		active_words[p] = 0;
+	}
+	active_pri = 0;
+	irq_in_changed = false;
+
+	meicontext_pppreempt = 0;
+	meicontext_ppreempt = 0;
+	meicontext_preempt = 0;
+	meicontext_noirq = true;
+	meicontext_irq = 0;
+	meicontext_mreteirq = false;
+	pending_meifa_clear = std::nullopt;
+}
+
+void RVIRQCtrl::update_word(uint word) {
+	uint32_t pend_en = (irq_in[word] | meifa[word]) & meiea[word];
+	for (uint p = 0; p < N_PRIORITIES; ++p) {
+		uint32_t a = pend_en & pri_bucket[p][word];
+		active[p][word] = a;
+		if (a)
+			active_words[p] |= 1u << word;
+		else
+			active_words[p] &= ~(1u << word);
+		if (active_words[p])
+			active_pri |= 1u << p;
+		else
+			active_pri &= ~(1u << p);
+	}
+}
+
+void RVIRQCtrl::set_priority(uint irq, uint priority) {
+	uint word = irq / 32;
+	uint32_t bit = 1u << (irq % 32);
+	pri_bucket[meipra[irq]][word] &= ~bit;
+	pri_bucket[priority][word] |= bit;
+	meipra[irq] = priority;
+	update_word(word);
+}
+
+RVIRQCtrl::NextIRQ RVIRQCtrl::get_next() const {
+	uint32_t visible_pri = active_pri & (0xffffffffu << meicontext_ppreempt);
+	if (!visible_pri)
+		return {true, 0, 0};
+	uint p = 31 - __builtin_clz(visible_pri);
+	uint w = __builtin_ctz(active_words[p]);
+	return {false, 32 * w + __builtin_ctz(active[p][w]), p};
+}
+
+uint RVIRQCtrl::preempt_level_next(const NextIRQ &next) const {
+	if (next.noirq)
+		return N_PRIORITIES;
+	return ((1u << (4 - PRIORITY_BITS)) + next.priority) & (0x10u | PRIORITY_MASK);
+}
+
+static inline ux_t window16_read(const uint32_t *array, ux_t index) {
+	return ((array[index / 2] >> (16 * (index % 2))) & 0xffffu) << 16;
+}
+
+std::optional<ux_t> RVIRQCtrl::read(uint16_t addr, ux_t wdata_raw, bool side_effect) {
+	switch (addr) {
+	case CSR_HAZARD3_MEIEA:
+		return window16_read(meiea, wdata_raw & 0x1fu);
+	case CSR_HAZARD3_MEIPA: {
+		uint index = wdata_raw & 0x1fu;
+		uint32_t meipa = irq_in[index / 2] | meifa[index / 2];
+		return ((meipa >> (16 * (index % 2))) & 0xffffu) << 16;
+	}
+	case CSR_HAZARD3_MEIFA:
+		return window16_read(meifa, wdata_raw & 0x1fu);
+	case CSR_HAZARD3_MEIPRA: {
+		uint first = 4 * (wdata_raw & 0x7fu);
+		ux_t rdata = 0;
+		for (uint i = 0; i < 4; ++i)
+			rdata |= (ux_t)meipra[first + i] << (16 + 4 * i);
+		return rdata;
+	}
+	case CSR_HAZARD3_MEINEXT: {
+		NextIRQ next = get_next();
+		if (side_effect && !next.noirq)
+			pending_meifa_clear = next.irq;
+		return ((ux_t)next.noirq << 31) | (next.irq << 2);
+	}
+	case CSR_HAZARD3_MEICONTEXT:
+		return
+			meicontext_pppreempt << 28 |
+			meicontext_ppreempt << 24 |
+			meicontext_preempt << 16 |
+			(ux_t)meicontext_noirq << 15 |
+			meicontext_irq << 4 |
+			(ux_t)meicontext_mreteirq;
+	default:
+		return {};
+	}
+}
+
+void RVIRQCtrl::write(uint16_t addr, ux_t wdata, ux_t wdata_raw) {
+	switch (addr) {
+	case CSR_HAZARD3_MEIEA:
+	case CSR_HAZARD3_MEIFA: {
+		uint32_t *array = addr == CSR_HAZARD3_MEIEA ? meiea : meifa;
+		uint index = wdata_raw & 0x1fu;
+		uint word = index / 2;
+		uint shift = 16 * (index % 2);
+		array[word] = (array[word] & ~(0xffffu << shift)) | ((wdata >> 16) << shift);
+		array[word] &= impl_mask[word];
+		update_word(word);
+		break;
+	}
+	case CSR_HAZARD3_MEIPRA: {
+		uint first = 4 * (wdata_raw & 0x7fu);
+		for (uint i = 0; i < 4; ++i) {
+			if (first + i < num_irqs)
+				set_priority(first + i, (wdata >> (16 + 4 * i)) & PRIORITY_MASK);
+		}
+		break;
+	}
+	case CSR_HAZARD3_MEINEXT:
+		if (wdata & 0x1u) {
+			NextIRQ next = get_next();
+			meicontext_preempt = preempt_level_next(next);
+			meicontext_noirq = next.noirq;
+			meicontext_irq = next.irq;
+		}
+		break;
+	case CSR_HAZARD3_MEICONTEXT:
+		meicontext_pppreempt = (wdata >> 28) & PRIORITY_MASK;
+		meicontext_ppreempt = (wdata >> 24) & PRIORITY_MASK;
+		meicontext_preempt = (wdata >> 16) & (0x10u | PRIORITY_MASK);
+		meicontext_noirq = (wdata >> 15) & 0x1u;
+		meicontext_irq = (wdata >> 4) & 0x1ffu;
+		meicontext_mreteirq = wdata & 0x1u;
+		break;
+	default:
+		break;
+	}
+}
+
+void RVIRQCtrl::step() {
+	if (pending_meifa_clear) {
+		uint irq = *pending_meifa_clear;
+		meifa[irq / 32] &= ~(1u << (irq % 32));
+		update_word(irq / 32);
+		pending_meifa_clear = std::nullopt;
+	}
+	if (irq_in_changed) {
+		for (uint w = 0; w < N_WORDS; ++w) {
+			if (irq_in[w] != irq_in_next[w]) {
+				irq_in[w] = irq_in_next[w];
+				update_word(w);
+			}
+		}
+		irq_in_changed = false;
+	}
+}
+
+void RVIRQCtrl::trap_enter(bool is_eirq) {
+	if (is_eirq) {
+		uint preempt_next = preempt_level_next(get_next());
+		meicontext_pppreempt = meicontext_ppreempt & PRIORITY_MASK;
+		meicontext_ppreempt = meicontext_preempt & PRIORITY_MASK;
+		meicontext_preempt = preempt_next;
+		meicontext_mreteirq = true;
+	} else {
+		meicontext_mreteirq = false;
+	}
+}
+
+void RVIRQCtrl::trap_mret() {
+	if (meicontext_mreteirq) {
+		meicontext_preempt = meicontext_ppreempt & PRIORITY_MASK;
+		meicontext_ppreempt = meicontext_pppreempt & PRIORITY_MASK;
+		meicontext_pppreempt = 0;
+	}
+	meicontext_mreteirq = false;
+}
+
+void RVIRQCtrl::serialise(RVSnapshotIO &io) {
+	io.field(num_irqs);
+	io.field(impl_mask);
+	io.field(irq_in_next);
+	io.field(irq_in_changed);
+	io.field(irq_in);
+	io.field(meiea);
+	io.field(meifa);
+	io.field(meipra);
+	io.field(pri_bucket);
+	io.field(active);
+	io.field(active_words);
+	io.field(active_pri);
+	io.field(meicontext_pppreempt);
+	io.field(meicontext_ppreempt);
+	io.field(meicontext_preempt);
+	io.field(meicontext_noirq);
+	io.field(meicontext_irq);
+	io.field(meicontext_mreteirq);
+	io.field(pending_meifa_clear);
+}
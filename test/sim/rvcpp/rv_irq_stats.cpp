@@ -0,0 +1,100 @@
+#include "rv_irq_stats.h"
+#include "encoding/rv_csr.h"
+
+#include <cinttypes>
+
+void RVIRQStats::Histogram::add(uint64_t x) {
+	if (count == 0 || x < min)
+		min = x;
+	if (count == 0 || x > max)
+		max = x;
+	++count;
+	sum += x;
+	uint bucket = x ? 64 - __builtin_clzll(x) : 0;
+	if (bucket >= N_BUCKETS)
+		bucket = N_BUCKETS - 1;
+	++buckets[bucket];
+}
+
+void RVIRQStats::Histogram::print(FILE *f, const char *name) const {
+	fprintf(f, "    %-9s count %-8" PRIu64 " min %-8" PRIu64 " mean %-10.1f max %" PRIu64 "\n",
+		name, count, min, (double)sum / count, max);
+	for (uint i = 0; i < N_BUCKETS; ++i) {
+		if (!buckets[i])
+			continue;
+		uint64_t lo = i ? 1ull << (i - 1) : 0;
+		uint64_t hi = i ? (1ull << i) - 1 : 0;
+		fprintf(f, "      %10" PRIu64 " .. %-10" PRIu64 " : %" PRIu64 "\n", lo, hi, buckets[i]);
+	}
+}
+
+void RVIRQStats::sample(uint64_t now, ux_t xip, uint64_t timer_age) {
+	ux_t rise = xip & ~prev_xip;
+	ux_t fall = prev_xip & ~xip;
+	for (uint i = 0; i < N_CAUSES; ++i) {
+		if (fall & (1u << i)) {
+			// Deasserted without being taken
+			assert_pending[i] = false;
+			rearmed[i] = false;
+		}
+		if (rise & (1u << i)) {
+			uint64_t t = now;
+			if (i == IRQ_M_TIMER && timer_age < now - prev_time)
+				t = now - timer_age;
+			assert_pending[i] = true;
+			assert_time[i] = t;
+			rearmed[i] = false;
+		}
+	}
+	prev_xip = xip;
+	prev_time = now;
+}
+
+void RVIRQStats::trap_enter(uint64_t now, ux_t cause) {
+	bool is_irq = cause & (1u << 31);
+	uint c = cause & ~(1u << 31);
+	if (is_irq && c < N_CAUSES && assert_pending[c]) {
+		latency[c].add(now - assert_time[c]);
+		// Still asserted, so can be taken again with no new rising edge
+		assert_pending[c] = prev_xip & (1u << c);
+		assert_time[c] = now;
+		rearmed[c] = assert_pending[c];
+	}
+	if (trap_stack.size() >= MAX_TRAP_DEPTH)
+		trap_stack.erase(trap_stack.begin());
+	trap_stack.push_back({is_irq, c, now});
+}
+
+void RVIRQStats::mret(uint64_t now) {
+	for (uint i = 0; i < N_CAUSES; ++i) {
+		if (rearmed[i])
+			assert_time[i] = now;
+	}
+	if (trap_stack.empty())
+		return;
+	TrapFrame frame = trap_stack.back();
+	trap_stack.pop_back();
+	if (frame.is_irq && frame.cause < N_CAUSES)
+		duration[frame.cause].add(now - frame.entry_time);
+}
+
+void RVIRQStats::print_summary(FILE *f) const {
+	fprintf(f, "IRQ latency summary:\n");
+	bool any = false;
+	for (uint i = 0; i < N_CAUSES; ++i) {
+		if (!latency[i].count && !duration[i].count)
+			continue;
+		any = true;
+		const char *name =
+			i == IRQ_M_SOFT  ? "soft"     :
+			i == IRQ_M_TIMER ? "timer"    :
+			i == IRQ_M_EXT   ? "external" : "other";
+		fprintf(f, "  mcause 0x%08x (%s):\n", (1u << 31) | i, name);
+		if (latency[i].count)
+			latency[i].print(f, "Latency:");
+		if (duration[i].count)
+			duration[i].print(f, "Handler:");
+	}
+	if (!any)
+		fprintf(f, "  No interrupts taken\n");
+}
@@ -0,0 +1,557 @@
+#include "rv_isa.h"
+#include "rv_elf.h"
+#include "encoding/rv_opcodes.h"
+#include "encoding/rv_csr.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <optional>
+
+const char *const rv_ext_names[N_EXTS] = {
+	"I",
+	"Zicsr",
+	"Zifencei",
+	"M",
+	"A",
+	"Zba",
+	"Zbb",
+	"Zbc",
+	"Zbs",
+	"Zbkb",
+	"Zbkx",
+	"C",
+	"Zcb",
+	"Zcmp",
+	"Xh3b",
+	"Xh3power"
+};
+
+#define OPC(opc, name, ext, fmt) {name, RVOPC_ ## opc ## _BITS, RVOPC_ ## opc ## _MASK, ext, fmt}
+
+const RVInstrDesc rv_instr_table[] = {
+	// Hints which alias base instructions must come first
+	OPC(H3_BLOCK,    "h3.block",    EXT_XH3POWER, FMT_NONE),
+	OPC(H3_UNBLOCK,  "h3.unblock",  EXT_XH3POWER, FMT_NONE),
+
+	OPC(BEQ,         "beq",         EXT_I,        FMT_B),
+	OPC(BNE,         "bne",         EXT_I,        FMT_B),
+	OPC(BLT,         "blt",         EXT_I,        FMT_B),
+	OPC(BGE,         "bge",         EXT_I,        FMT_B),
+	OPC(BLTU,        "bltu",        EXT_I,        FMT_B),
+	OPC(BGEU,        "bgeu",        EXT_I,        FMT_B),
+	OPC(JALR,        "jalr",        EXT_I,        FMT_JALR),
+	OPC(JAL,         "jal",         EXT_I,        FMT_J),
+	OPC(LUI,         "lui",         EXT_I,        FMT_U),
+	OPC(AUIPC,       "auipc",       EXT_I,        FMT_U),
+	OPC(ADDI,        "addi",        EXT_I,        FMT_I),
+	OPC(SLLI,        "slli",        EXT_I,        FMT_SHAMT),
+	OPC(SLTI,        "slti",        EXT_I,        FMT_I),
+	OPC(SLTIU,       "sltiu",       EXT_I,        FMT_I),
+	OPC(XORI,        "xori",        EXT_I,        FMT_I),
+	OPC(SRLI,        "srli",        EXT_I,        FMT_SHAMT),
+	OPC(SRAI,        "srai",        EXT_I,        FMT_SHAMT),
+	OPC(ORI,         "ori",         EXT_I,        FMT_I),
+	OPC(ANDI,        "andi",        EXT_I,        FMT_I),
+	OPC(ADD,         "add",         EXT_I,        FMT_R),
+	OPC(SUB,         "sub",         EXT_I,        FMT_R),
+	OPC(SLL,         "sll",         EXT_I,        FMT_R),
+	OPC(SLT,         "slt",         EXT_I,        FMT_R),
+	OPC(SLTU,        "sltu",        EXT_I,        FMT_R),
+	OPC(XOR,         "xor",         EXT_I,        FMT_R),
+	OPC(SRL,         "srl",         EXT_I,        FMT_R),
+	OPC(SRA,         "sra",         EXT_I,        FMT_R),
+	OPC(OR,          "or",          EXT_I,        FMT_R),
+	OPC(AND,         "and",         EXT_I,        FMT_R),
+	OPC(LB,          "lb",          EXT_I,        FMT_LOAD),
+	OPC(LH,          "lh",          EXT_I,        FMT_LOAD),
+	OPC(LW,          "lw",          EXT_I,        FMT_LOAD),
+	OPC(LBU,         "lbu",         EXT_I,        FMT_LOAD),
+	OPC(LHU,         "lhu",         EXT_I,        FMT_LOAD),
+	OPC(SB,          "sb",          EXT_I,        FMT_STORE),
+	OPC(SH,          "sh",          EXT_I,        FMT_STORE),
+	OPC(SW,          "sw",          EXT_I,        FMT_STORE),
+	OPC(FENCE,       "fence",       EXT_I,        FMT_FENCE),
+	OPC(ECALL,       "ecall",       EXT_I,        FMT_NONE),
+	OPC(EBREAK,      "ebreak",      EXT_I,        FMT_NONE),
+	OPC(MRET,        "mret",        EXT_I,        FMT_NONE),
+	OPC(WFI,         "wfi",         EXT_I,        FMT_NONE),
+	OPC(FENCE_I,     "fence.i",     EXT_ZIFENCEI, FMT_NONE),
+	OPC(CSRRW,       "csrrw",       EXT_ZICSR,    FMT_CSR),
+	OPC(CSRRS,       "csrrs",       EXT_ZICSR,    FMT_CSR),
+	OPC(CSRRC,       "csrrc",       EXT_ZICSR,    FMT_CSR),
+	OPC(CSRRWI,      "csrrwi",      EXT_ZICSR,    FMT_CSRI),
+	OPC(CSRRSI,      "csrrsi",      EXT_ZICSR,    FMT_CSRI),
+	OPC(CSRRCI,      "csrrci",      EXT_ZICSR,    FMT_CSRI),
+
+	OPC(MUL,         "mul",         EXT_M,        FMT_R),
+	OPC(MULH,        "mulh",        EXT_M,        FMT_R),
+	OPC(MULHSU,      "mulhsu",      EXT_M,        FMT_R),
+	OPC(MULHU,       "mulhu",       EXT_M,        FMT_R),
+	OPC(DIV,         "div",         EXT_M,        FMT_R),
+	OPC(DIVU,        "divu",        EXT_M,        FMT_R),
+	OPC(REM,         "rem",         EXT_M,        FMT_R),
+	OPC(REMU,        "remu",        EXT_M,        FMT_R),
+
+	OPC(LR_W,        "lr.w",        EXT_A,        FMT_LR),
+	OPC(SC_W,        "sc.w",        EXT_A,        FMT_AMO),
+	OPC(AMOSWAP_W,   "amoswap.w",   EXT_A,        FMT_AMO),
+	OPC(AMOADD_W,    "amoadd.w",    EXT_A,        FMT_AMO),
+	OPC(AMOXOR_W,    "amoxor.w",    EXT_A,        FMT_AMO),
+	OPC(AMOAND_W,    "amoand.w",    EXT_A,        FMT_AMO),
+	OPC(AMOOR_W,     "amoor.w",     EXT_A,        FMT_AMO),
+	OPC(AMOMIN_W,    "amomin.w",    EXT_A,        FMT_AMO),
+	OPC(AMOMAX_W,    "amomax.w",    EXT_A,        FMT_AMO),
+	OPC(AMOMINU_W,   "amominu.w",   EXT_A,        FMT_AMO),
+	OPC(AMOMAXU_W,   "amomaxu.w",   EXT_A,        FMT_AMO),
+
+	OPC(SH1ADD,      "sh1add",      EXT_ZBA,      FMT_R),
+	OPC(SH2ADD,      "sh2add",      EXT_ZBA,      FMT_R),
+	OPC(SH3ADD,      "sh3add",      EXT_ZBA,      FMT_R),
+
+	// zext.h is an alias of pack with rs2 = x0, so must precede Zbkb
+	OPC(ANDN,        "andn",        EXT_ZBB,      FMT_R),
+	OPC(CLZ,         "clz",         EXT_ZBB,      FMT_R2),
+	OPC(CPOP,        "cpop",        EXT_ZBB,      FMT_R2),
+	OPC(CTZ,         "ctz",         EXT_ZBB,      FMT_R2),
+	OPC(MAX,         "max",         EXT_ZBB,      FMT_R),
+	OPC(MAXU,        "maxu",        EXT_ZBB,      FMT_R),
+	OPC(MIN,         "min",         EXT_ZBB,      FMT_R),
+	OPC(MINU,        "minu",        EXT_ZBB,      FMT_R),
+	OPC(ORC_B,       "orc.b",       EXT_ZBB,      FMT_R2),
+	OPC(ORN,         "orn",         EXT_ZBB,      FMT_R),
+	OPC(REV8,        "rev8",        EXT_ZBB,      FMT_R2),
+	OPC(ROL,         "rol",         EXT_ZBB,      FMT_R),
+	OPC(ROR,         "ror",         EXT_ZBB,      FMT_R),
+	OPC(RORI,        "rori",        EXT_ZBB,      FMT_SHAMT),
+	OPC(SEXT_B,      "sext.b",      EXT_ZBB,      FMT_R2),
+	OPC(SEXT_H,      "sext.h",      EXT_ZBB,      FMT_R2),
+	OPC(XNOR,        "xnor",        EXT_ZBB,      FMT_R),
+	OPC(ZEXT_H,      "zext.h",      EXT_ZBB,      FMT_R2),
+
+	OPC(CLMUL,       "clmul",       EXT_ZBC,      FMT_R),
+	OPC(CLMULH,      "clmulh",      EXT_ZBC,      FMT_R),
+	OPC(CLMULR,      "clmulr",      EXT_ZBC,      FMT_R),
+
+	OPC(BCLR,        "bclr",        EXT_ZBS,      FMT_R),
+	OPC(BCLRI,       "bclri",       EXT_ZBS,      FMT_SHAMT),
+	OPC(BEXT,        "bext",        EXT_ZBS,      FMT_R),
+	OPC(BEXTI,       "bexti",       EXT_ZBS,      FMT_SHAMT),
+	OPC(BINV,        "binv",        EXT_ZBS,      FMT_R),
+	OPC(BINVI,       "binvi",       EXT_ZBS,      FMT_SHAMT),
+	OPC(BSET,        "bset",        EXT_ZBS,      FMT_R),
+	OPC(BSETI,       "bseti",       EXT_ZBS,      FMT_SHAMT),
+
+	OPC(PACK,        "pack",        EXT_ZBKB,     FMT_R),
+	OPC(PACKH,       "packh",       EXT_ZBKB,     FMT_R),
+	OPC(BREV8,       "brev8",       EXT_ZBKB,     FMT_R2),
+	OPC(UNZIP,       "unzip",       EXT_ZBKB,     FMT_R2),
+	OPC(ZIP,         "zip",         EXT_ZBKB,     FMT_R2),
+
+	OPC(XPERM_B,     "xperm8",      EXT_ZBKX,     FMT_R),
+	OPC(XPERM_N,     "xperm4",      EXT_ZBKX,     FMT_R),
+
+	OPC(H3_BEXTM,    "h3.bextm",    EXT_XH3B,     FMT_BEXTM),
+	OPC(H3_BEXTMI,   "h3.bextmi",   EXT_XH3B,     FMT_BEXTMI),
+
+	// Special cases of c.lui, c.mv and c.add, which must come first. These
+	// have no definitions of their own in rv_opcodes.h.
+	{"c.addi16sp", 0x6101u, 0xef83u, EXT_C,        FMT_C_ADDI16SP},
+	{"c.ebreak",   0x9002u, 0xffffu, EXT_C,        FMT_NONE},
+	{"c.jr",       0x8002u, 0xf07fu, EXT_C,        FMT_C_JR},
+	{"c.jalr",     0x9002u, 0xf07fu, EXT_C,        FMT_C_JR},
+
+	OPC(C_ADDI4SPN,  "c.addi4spn",  EXT_C,        FMT_C_ADDI4SPN),
+	OPC(C_LW,        "c.lw",        EXT_C,        FMT_C_LW),
+	OPC(C_SW,        "c.sw",        EXT_C,        FMT_C_SW),
+	OPC(C_ADDI,      "c.addi",      EXT_C,        FMT_C_LI),
+	OPC(C_JAL,       "c.jal",       EXT_C,        FMT_C_J),
+	OPC(C_J,         "c.j",         EXT_C,        FMT_C_J),
+	OPC(C_LI,        "c.li",        EXT_C,        FMT_C_LI),
+	OPC(C_LUI,       "c.lui",       EXT_C,        FMT_C_LUI),
+	OPC(C_SRLI,      "c.srli",      EXT_C,        FMT_C_SHIFT_S),
+	OPC(C_SRAI,      "c.srai",      EXT_C,        FMT_C_SHIFT_S),
+	OPC(C_ANDI,      "c.andi",      EXT_C,        FMT_C_ANDI),
+	OPC(C_SUB,       "c.sub",       EXT_C,        FMT_C_R_S),
+	OPC(C_XOR,       "c.xor",       EXT_C,        FMT_C_R_S),
+	OPC(C_OR,        "c.or",        EXT_C,        FMT_C_R_S),
+	OPC(C_AND,       "c.and",       EXT_C,        FMT_C_R_S),
+	OPC(C_BEQZ,      "c.beqz",      EXT_C,        FMT_C_B),
+	OPC(C_BNEZ,      "c.bnez",      EXT_C,        FMT_C_B),
+	OPC(C_SLLI,      "c.slli",      EXT_C,        FMT_C_SLLI),
+	OPC(C_MV,        "c.mv",        EXT_C,        FMT_C_R),
+	OPC(C_ADD,       "c.add",       EXT_C,        FMT_C_R),
+	OPC(C_LWSP,      "c.lwsp",      EXT_C,        FMT_C_LWSP),
+	OPC(C_SWSP,      "c.swsp",      EXT_C,        FMT_C_SWSP),
+
+	OPC(C_LBU,       "c.lbu",       EXT_ZCB,      FMT_C_LB),
+	OPC(C_LHU,       "c.lhu",       EXT_ZCB,      FMT_C_LH),
+	OPC(C_LH,        "c.lh",        EXT_ZCB,      FMT_C_LH),
+	OPC(C_SB,        "c.sb",        EXT_ZCB,      FMT_C_SB),
+	OPC(C_SH,        "c.sh",        EXT_ZCB,      FMT_C_SH),
+	OPC(C_ZEXT_B,    "c.zext.b",    EXT_ZCB,      FMT_C_UNARY),
+	OPC(C_SEXT_B,    "c.sext.b",    EXT_ZCB,      FMT_C_UNARY),
+	OPC(C_ZEXT_H,    "c.zext.h",    EXT_ZCB,      FMT_C_UNARY),
+	OPC(C_SEXT_H,    "c.sext.h",    EXT_ZCB,      FMT_C_UNARY),
+	OPC(C_NOT,       "c.not",       EXT_ZCB,      FMT_C_UNARY),
+	OPC(C_MUL,       "c.mul",       EXT_ZCB,      FMT_C_R_S),
+
+	OPC(CM_PUSH,     "cm.push",     EXT_ZCMP,     FMT_CM_RLIST),
+	OPC(CM_POP,      "cm.pop",      EXT_ZCMP,     FMT_CM_RLIST),
+	OPC(CM_POPRETZ,  "cm.popretz",  EXT_ZCMP,     FMT_CM_RLIST),
+	OPC(CM_POPRET,   "cm.popret",   EXT_ZCMP,     FMT_CM_RLIST),
+	OPC(CM_MVSA01,   "cm.mvsa01",   EXT_ZCMP,     FMT_CM_MV),
+	OPC(CM_MVA01S,   "cm.mva01s",   EXT_ZCMP,     FMT_CM_MV),
+};
+
+const uint rv_instr_table_size = sizeof(rv_instr_table) / sizeof(rv_instr_table[0]);
+
+int rv_instr_lookup(uint32_t instr) {
+	bool is_32bit = (instr & 0x3) == 0x3;
+	if (!is_32bit)
+		instr &= 0xffffu;
+	for (uint i = 0; i < rv_instr_table_size; ++i) {
+		const RVInstrDesc &d = rv_instr_table[i];
+		// 16-bit entries have a mask which doesn't cover bits 1:0 == 11
+		bool entry_is_32bit = (d.bits & 0x3) == 0x3;
+		if (entry_is_32bit == is_32bit && (instr & d.mask) == d.bits)
+			return i;
+	}
+	return -1;
+}
+
+// Inclusive msb:lsb style, like Verilog (and like the ISA manual)
+#define BITS_UPTO(msb) (~((-1u << (msb)) << 1))
+#define BITRANGE(msb, lsb) (BITS_UPTO((msb) - (lsb)) << (lsb))
+#define GETBITS(x, msb, lsb) (((x) & BITRANGE(msb, lsb)) >> (lsb))
+#define GETBIT(x, bit) (((x) >> (bit)) & 1u)
+
+struct RVCSRName {
+	uint16_t addr;
+	const char *name;
+};
+
+#define CSR(csr, name) {CSR_ ## csr, name}
+
+static const RVCSRName csr_names[] = {
+	CSR(FFLAGS, "fflags"),
+	CSR(FRM, "frm"),
+	CSR(FCSR, "fcsr"),
+	CSR(CYCLE, "cycle"),
+	CSR(TIME, "time"),
+	CSR(INSTRET, "instret"),
+	CSR(SSTATUS, "sstatus"),
+	CSR(SIE, "sie"),
+	CSR(STVEC, "stvec"),
+	CSR(SCOUNTEREN, "scounteren"),
+	CSR(SSCRATCH, "sscratch"),
+	CSR(SEPC, "sepc"),
+	CSR(SCAUSE, "scause"),
+	CSR(STVAL, "stval"),
+	CSR(SIP, "sip"),
+	CSR(SATP, "satp"),
+	CSR(MSTATUS, "mstatus"),
+	CSR(MISA, "misa"),
+	CSR(MEDELEG, "medeleg"),
+	CSR(MIDELEG, "mideleg"),
+	CSR(MIE, "mie"),
+	CSR(MTVEC, "mtvec"),
+	CSR(MCOUNTEREN, "mcounteren"),
+	CSR(MSCRATCH, "mscratch"),
+	CSR(MEPC, "mepc"),
+	CSR(MCAUSE, "mcause"),
+	CSR(MTVAL, "mtval"),
+	CSR(MIP, "mip"),
+	CSR(TSELECT, "tselect"),
+	CSR(TDATA1, "tdata1"),
+	CSR(TDATA2, "tdata2"),
+	CSR(TDATA3, "tdata3"),
+	CSR(DCSR, "dcsr"),
+	CSR(DPC, "dpc"),
+	CSR(DSCRATCH, "dscratch"),
+	CSR(MCYCLE, "mcycle"),
+	CSR(MINSTRET, "minstret"),
+	CSR(MCOUNTINHIBIT, "mcountinhibit"),
+	CSR(MVENDORID, "mvendorid"),
+	CSR(MARCHID, "marchid"),
+	CSR(MIMPID, "mimpid"),
+	CSR(MHARTID, "mhartid"),
+	CSR(MCONFIGPTR, "mconfigptr"),
+	CSR(CYCLEH, "cycleh"),
+	CSR(TIMEH, "timeh"),
+	CSR(INSTRETH, "instreth"),
+	CSR(MCYCLEH, "mcycleh"),
+	CSR(MINSTRETH, "minstreth"),
+	CSR(MENTROPY, "mentropy"),
+	CSR(MNOISE, "mnoise"),
+	CSR(HAZARD3_MEIEA, "meiea"),
+	CSR(HAZARD3_MEIPA, "meipa"),
+	CSR(HAZARD3_MEIFA, "meifa"),
+	CSR(HAZARD3_MEIPRA, "meipra"),
+	CSR(HAZARD3_MEINEXT, "meinext"),
+	CSR(HAZARD3_MEICONTEXT, "meicontext"),
+	CSR(HAZARD3_MSLEEP, "msleep"),
+};
+
+std::string rv_csr_name(uint16_t addr) {
+	char buf[24];
+	for (const RVCSRName &c : csr_names) {
+		if (c.addr == addr)
+			return c.name;
+	}
+	// Numbered families
+	if (addr >= CSR_HPMCOUNTER3 && addr <= CSR_HPMCOUNTER31) {
+		snprintf(buf, sizeof(buf), "hpmcounter%u", addr - CSR_HPMCOUNTER3 + 3);
+	} else if (addr >= CSR_HPMCOUNTER3H && addr <= CSR_HPMCOUNTER31H) {
+		snprintf(buf, sizeof(buf), "hpmcounter%uh", addr - CSR_HPMCOUNTER3H + 3);
+	} else if (addr >= CSR_MHPMCOUNTER3 && addr <= CSR_MHPMCOUNTER31) {
+		snprintf(buf, sizeof(buf), "mhpmcounter%u", addr - CSR_MHPMCOUNTER3 + 3);
+	} else if (addr >= CSR_MHPMCOUNTER3H && addr <= CSR_MHPMCOUNTER31H) {
+		snprintf(buf, sizeof(buf), "mhpmcounter%uh", addr - CSR_MHPMCOUNTER3H + 3);
+	} else if (addr >= CSR_MHPMEVENT3 && addr <= CSR_MHPMEVENT31) {
+		snprintf(buf, sizeof(buf), "mhpmevent%u", addr - CSR_MHPMEVENT3 + 3);
+	} else if (addr >= CSR_PMPCFG0 && addr <= CSR_PMPCFG3) {
+		snprintf(buf, sizeof(buf), "pmpcfg%u", addr - CSR_PMPCFG0);
+	} else if (addr >= CSR_PMPADDR0 && addr <= CSR_PMPADDR15) {
+		snprintf(buf, sizeof(buf), "pmpaddr%u", addr - CSR_PMPADDR0);
+	} else {
+		snprintf(buf, sizeof(buf), "0x%03x", addr);
+	}
+	return buf;
+}
+
+static inline int32_t sext(uint32_t bits, int sign_bit) {
+	return (int32_t)(bits << (31 - sign_bit)) >> (31 - sign_bit);
+}
+
+static inline int32_t imm_i(uint32_t instr) {
+	return (int32_t)instr >> 20;
+}
+
+static inline int32_t imm_s(uint32_t instr) {
+	return ((int32_t)instr >> 25 << 5) | GETBITS(instr, 11, 7);
+}
+
+static inline int32_t imm_b(uint32_t instr) {
+	return sext((GETBITS(instr, 11, 8) << 1) | (GETBITS(instr, 30, 25) << 5)
+		| (GETBIT(instr, 7) << 11) | (GETBIT(instr, 31) << 12), 12);
+}
+
+static inline int32_t imm_j(uint32_t instr) {
+	return sext((GETBITS(instr, 30, 21) << 1) | (GETBIT(instr, 20) << 11)
+		| (GETBITS(instr, 19, 12) << 12) | (GETBIT(instr, 31) << 20), 20);
+}
+
+static inline int32_t imm_ci(uint32_t instr) {
+	return sext(GETBITS(instr, 6, 2) | (GETBIT(instr, 12) << 5), 5);
+}
+
+static inline int32_t imm_cj(uint32_t instr) {
+	return sext((GETBIT(instr, 12) << 11)
+		| (GETBIT(instr, 11) << 4)
+		| (GETBITS(instr, 10, 9) << 8)
+		| (GETBIT(instr, 8) << 10)
+		| (GETBIT(instr, 7) << 6)
+		| (GETBIT(instr, 6) << 7)
+		| (GETBITS(instr, 5, 3) << 1)
+		| (GETBIT(instr, 2) << 5), 11);
+}
+
+static inline int32_t imm_cb(uint32_t instr) {
+	return sext((GETBIT(instr, 12) << 8)
+		| (GETBITS(instr, 11, 10) << 3)
+		| (GETBITS(instr, 6, 5) << 6)
+		| (GETBITS(instr, 4, 3) << 1)
+		| (GETBIT(instr, 2) << 5), 8);
+}
+
+static const char *reg(uint r) {
+	return friendly_reg_names[r & 0x1f];
+}
+
+// Register names for the 3-bit fields of compressed instructions
+static const char *reg_s(uint r) {
+	return friendly_reg_names[(r & 0x7) + 8];
+}
+
+// Zcmp's mapping of its 3-bit fields onto s0-s7
+static const char *reg_zcmp_s(uint r) {
+	return friendly_reg_names[(r & 0x7) + 8 + 8 * ((r & 0x6) != 0)];
+}
+
+static std::string fence_set(uint bits) {
+	std::string s;
+	for (uint i = 0; i < 4; ++i) {
+		if (bits & (0x8u >> i))
+			s += "iorw"[i];
+	}
+	return s.empty() ? "0" : s;
+}
+
+std::string rv_disasm(uint32_t instr, ux_t pc, const RVSymbolTable *symbols) {
+	int i = rv_instr_lookup(instr);
+	if (i < 0)
+		return "unknown";
+	const RVInstrDesc &d = rv_instr_table[i];
+	uint rd = GETBITS(instr, 11, 7);
+	uint rs1 = GETBITS(instr, 19, 15);
+	uint rs2 = GETBITS(instr, 24, 20);
+	char ops[96] = "";
+	std::optional<ux_t> target;
+
+	switch (d.fmt) {
+	case FMT_NONE:
+		break;
+	case FMT_R:
+		snprintf(ops, sizeof(ops), "%s, %s, %s", reg(rd), reg(rs1), reg(rs2));
+		break;
+	case FMT_R2:
+		snprintf(ops, sizeof(ops), "%s, %s", reg(rd), reg(rs1));
+		break;
+	case FMT_I:
+		snprintf(ops, sizeof(ops), "%s, %s, %d", reg(rd), reg(rs1), imm_i(instr));
+		break;
+	case FMT_SHAMT:
+		snprintf(ops, sizeof(ops), "%s, %s, %u", reg(rd), reg(rs1), rs2);
+		break;
+	case FMT_LOAD:
+	case FMT_JALR:
+		snprintf(ops, sizeof(ops), "%s, %d(%s)", reg(rd), imm_i(instr), reg(rs1));
+		break;
+	case FMT_STORE:
+		snprintf(ops, sizeof(ops), "%s, %d(%s)", reg(rs2), imm_s(instr), reg(rs1));
+		break;
+	case FMT_B:
+		target = pc + imm_b(instr);
+		snprintf(ops, sizeof(ops), "%s, %s, 0x%x", reg(rs1), reg(rs2), *target);
+		break;
+	case FMT_U:
+		snprintf(ops, sizeof(ops), "%s, 0x%x", reg(rd), instr >> 12);
+		break;
+	case FMT_J:
+		target = pc + imm_j(instr);
+		snprintf(ops, sizeof(ops), "%s, 0x%x", reg(rd), *target);
+		break;
+	case FMT_FENCE:
+		snprintf(ops, sizeof(ops), "%s, %s", fence_set(GETBITS(instr, 27, 24)).c_str(),
+			fence_set(GETBITS(instr, 23, 20)).c_str());
+		break;
+	case FMT_CSR:
+		snprintf(ops, sizeof(ops), "%s, %s, %s", reg(rd), rv_csr_name(instr >> 20).c_str(), reg(rs1));
+		break;
+	case FMT_CSRI:
+		snprintf(ops, sizeof(ops), "%s, %s, %u", reg(rd), rv_csr_name(instr >> 20).c_str(), rs1);
+		break;
+	case FMT_LR:
+		snprintf(ops, sizeof(ops), "%s, (%s)", reg(rd), reg(rs1));
+		break;
+	case FMT_AMO:
+		snprintf(ops, sizeof(ops), "%s, %s, (%s)", reg(rd), reg(rs2), reg(rs1));
+		break;
+	case FMT_BEXTM:
+		snprintf(ops, sizeof(ops), "%s, %s, %s, %u", reg(rd), reg(rs1), reg(rs2),
+			GETBITS(instr, 28, 26) + 1);
+		break;
+	case FMT_BEXTMI:
+		snprintf(ops, sizeof(ops), "%s, %s, %u, %u", reg(rd), reg(rs1), rs2,
+			GETBITS(instr, 28, 26) + 1);
+		break;
+	case FMT_C_ADDI4SPN:
+		snprintf(ops, sizeof(ops), "%s, sp, %u", reg_s(GETBITS(instr, 4, 2)),
+			(GETBITS(instr, 12, 11) << 4) | (GETBITS(instr, 10, 7) << 6)
+			| (GETBIT(instr, 6) << 2) | (GETBIT(instr, 5) << 3));
+		break;
+	case FMT_C_LW:
+	case FMT_C_SW:
+		snprintf(ops, sizeof(ops), "%s, %u(%s)", reg_s(GETBITS(instr, 4, 2)),
+			(GETBIT(instr, 6) << 2) | (GETBITS(instr, 12, 10) << 3) | (GETBIT(instr, 5) << 6),
+			reg_s(GETBITS(instr, 9, 7)));
+		break;
+	case FMT_C_LI:
+		snprintf(ops, sizeof(ops), "%s, %d", reg(rd), imm_ci(instr));
+		break;
+	case FMT_C_J:
+		target = pc + imm_cj(instr);
+		snprintf(ops, sizeof(ops), "0x%x", *target);
+		break;
+	case FMT_C_LUI:
+		snprintf(ops, sizeof(ops), "%s, 0x%x", reg(rd), imm_ci(instr) & 0xfffffu);
+		break;
+	case FMT_C_ADDI16SP:
+		snprintf(ops, sizeof(ops), "sp, %d", sext((GETBIT(instr, 12) << 9) | (GETBIT(instr, 6) << 4)
+			| (GETBIT(instr, 5) << 6) | (GETBITS(instr, 4, 3) << 7) | (GETBIT(instr, 2) << 5), 9));
+		break;
+	case FMT_C_SHIFT_S:
+		snprintf(ops, sizeof(ops), "%s, %u", reg_s(GETBITS(instr, 9, 7)), GETBITS(instr, 6, 2));
+		break;
+	case FMT_C_ANDI:
+		snprintf(ops, sizeof(ops), "%s, %d", reg_s(GETBITS(instr, 9, 7)), imm_ci(instr));
+		break;
+	case FMT_C_R_S:
+		snprintf(ops, sizeof(ops), "%s, %s", reg_s(GETBITS(instr, 9, 7)), reg_s(GETBITS(instr, 4, 2)));
+		break;
+	case FMT_C_B:
+		target = pc + imm_cb(instr);
+		snprintf(ops, sizeof(ops), "%s, 0x%x", reg_s(GETBITS(instr, 9, 7)), *target);
+		break;
+	case FMT_C_SLLI:
+		snprintf(ops, sizeof(ops), "%s, %u", reg(rd), GETBITS(instr, 6, 2));
+		break;
+	case FMT_C_R:
+		snprintf(ops, sizeof(ops), "%s, %s", reg(rd), reg(GETBITS(instr, 6, 2)));
+		break;
+	case FMT_C_JR:
+		snprintf(ops, sizeof(ops), "%s", reg(rd));
+		break;
+	case FMT_C_LWSP:
+		snprintf(ops, sizeof(ops), "%s, %u(sp)", reg(rd),
+			(GETBIT(instr, 12) << 5) | (GETBITS(instr, 6, 4) << 2) | (GETBITS(instr, 3, 2) << 6));
+		break;
+	case FMT_C_SWSP:
+		snprintf(ops, sizeof(ops), "%s, %u(sp)", reg(GETBITS(instr, 6, 2)),
+			(GETBITS(instr, 12, 9) << 2) | (GETBITS(instr, 8, 7) << 6));
+		break;
+	case FMT_C_LB:
+	case FMT_C_SB:
+		snprintf(ops, sizeof(ops), "%s, %u(%s)", reg_s(GETBITS(instr, 4, 2)),
+			GETBIT(instr, 6) | (GETBIT(instr, 5) << 1), reg_s(GETBITS(instr, 9, 7)));
+		break;
+	case FMT_C_LH:
+	case FMT_C_SH:
+		snprintf(ops, sizeof(ops), "%s, %u(%s)", reg_s(GETBITS(instr, 4, 2)),
+			GETBIT(instr, 5) << 1, reg_s(GETBITS(instr, 9, 7)));
+		break;
+	case FMT_C_UNARY:
+		snprintf(ops, sizeof(ops), "%s", reg_s(GETBITS(instr, 9, 7)));
+		break;
+	case FMT_CM_RLIST: {
+		uint rlist = GETBITS(instr, 7, 4);
+		uint nregs = rlist == 0xf ? 13 : rlist - 3;
+		uint adj_base = nregs > 12 ? 0x40 : nregs > 8 ? 0x30 : nregs > 4 ? 0x20 : 0x10;
+		uint adj = adj_base + 16 * GETBITS(instr, 3, 2);
+		const char *sign = RVOPC_MATCH(instr, CM_PUSH) ? "-" : "";
+		if (nregs == 1)
+			snprintf(ops, sizeof(ops), "{ra}, %s%u", sign, adj);
+		else if (nregs == 2)
+			snprintf(ops, sizeof(ops), "{ra, s0}, %s%u", sign, adj);
+		else
+			snprintf(ops, sizeof(ops), "{ra, s0-s%u}, %s%u", nregs == 13 ? 11 : nregs - 2, sign, adj);
+		break;
+	}
+	case FMT_CM_MV:
+		snprintf(ops, sizeof(ops), "%s, %s", reg_zcmp_s(GETBITS(instr, 9, 7)), reg_zcmp_s(GETBITS(instr, 4, 2)));
+		break;
+	}
+
+	std::string s = d.name;
+	if (d.fmt == FMT_LR || d.fmt == FMT_AMO) {
+		static const char *const ordering[4] = {"", ".rl", ".aq", ".aqrl"};
+		s += ordering[GETBITS(instr, 26, 25)];
+	}
+	if (ops[0]) {
+		s.resize(std::max<size_t>(s.size() + 1, 11), ' ');
+		s += ops;
+	}
+	if (target && symbols && !symbols->empty() && symbols->lookup(*target))
+		s += " <" + symbols->format_addr(*target) + ">";
+	return s;
+}
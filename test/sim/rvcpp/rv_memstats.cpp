@@ -0,0 +1,129 @@
+#include "rv_memstats.h"
+
+#include <algorithm>
+#include <cinttypes>
+
+void RVHeatmap::write_file(FILE *f) const {
+	fprintf(f, "# line_size %u\n", 1u << line_shift);
+	fprintf(f, "# address reads writes execs\n");
+	auto print_line = [&](ux_t addr, const Counts &c) {
+		if (c.reads || c.writes || c.execs)
+			fprintf(f, "%08x %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", addr, c.reads, c.writes, c.execs);
+	};
+	std::vector<ux_t> other_addrs;
+	for (auto &[addr, c] : other_lines)
+		other_addrs.push_back(addr);
+	std::sort(other_addrs.begin(), other_addrs.end());
+	auto other = other_addrs.begin();
+	for (uint32_t i = 0; i < ram_lines.size(); ++i) {
+		ux_t addr = ram_base + (i << line_shift);
+		for (; other != other_addrs.end() && *other < addr; ++other)
+			print_line(*other, other_lines.at(*other));
+		print_line(addr, ram_lines[i]);
+	}
+	for (; other != other_addrs.end(); ++other)
+		print_line(*other, other_lines.at(*other));
+}
+
+void RVHeatmap::print_summary(FILE *f, uint top_n) const {
+	uint line_size = 1u << line_shift;
+	struct RegionTotals {
+		Counts counts;
+		uint32_t lines_touched;
+		uint32_t lines_written;
+	};
+	std::vector<RegionTotals> totals(regions.size() + 1);
+	std::vector<std::pair<ux_t, Counts>> data_lines;
+
+	auto add = [&](ux_t addr, const Counts &c) {
+		if (!(c.reads || c.writes || c.execs))
+			return;
+		size_t r = 0;
+		while (r < regions.size() && addr - regions[r].base >= regions[r].size)
+			++r;
+		RegionTotals &t = totals[r];
+		t.counts.reads += c.reads;
+		t.counts.writes += c.writes;
+		t.counts.execs += c.execs;
+		++t.lines_touched;
+		if (c.writes)
+			++t.lines_written;
+		if (c.reads || c.writes)
+			data_lines.push_back({addr, c});
+	};
+	for (uint32_t i = 0; i < ram_lines.size(); ++i)
+		add(ram_base + (i << line_shift), ram_lines[i]);
+	for (auto &[addr, c] : other_lines)
+		add(addr, c);
+
+	fprintf(f, "Memory heatmap (%u-byte lines):\n", line_size);
+	fprintf(f, "  %-12s %-8s %10s %10s %14s %14s %14s\n",
+		"region", "base", "touched", "written", "reads", "writes", "execs");
+	for (size_t r = 0; r <= regions.size(); ++r) {
+		const RegionTotals &t = totals[r];
+		if (!t.lines_touched)
+			continue;
+		const char *name = r < regions.size() ? regions[r].name.c_str() : "other";
+		char base[16] = "-";
+		if (r < regions.size())
+			snprintf(base, sizeof(base), "%08x", regions[r].base);
+		fprintf(f, "  %-12s %-8s %9uB %9uB %14" PRIu64 " %14" PRIu64 " %14" PRIu64 "\n",
+			name, base, t.lines_touched * line_size, t.lines_written * line_size,
+			t.counts.reads, t.counts.writes, t.counts.execs);
+	}
+
+	std::sort(data_lines.begin(), data_lines.end(), [](const auto &a, const auto &b) {
+		uint64_t wa = a.second.reads + a.second.writes;
+		uint64_t wb = b.second.reads + b.second.writes;
+		return wa > wb || (wa == wb && a.first < b.first);
+	});
+	fprintf(f, "Hottest data lines:\n");
+	fprintf(f, "  %-8s %14s %14s\n", "address", "reads", "writes");
+	for (size_t i = 0; i < data_lines.size() && i < top_n; ++i) {
+		fprintf(f, "  %08x %14" PRIu64 " %14" PRIu64 "\n", data_lines[i].first,
+			data_lines[i].second.reads, data_lines[i].second.writes);
+	}
+}
+
+void RVStackStats::step(bool trap, bool mret, ux_t sp) {
+	// Ignore the reset value of sp, before firmware has set it up
+	if (!started && sp == 0)
+		return;
+	started = true;
+	if (trap) {
+		++nesting;
+	} else if (mret && nesting > 0) {
+		--nesting;
+		return;
+	}
+	uint level = std::min(nesting, MAX_LEVELS - 1);
+	if (trap) {
+		entry_sp[level] = sp;
+		++entries[level];
+	}
+	if (sp < min_sp[level])
+		min_sp[level] = sp;
+	if (level == 0) {
+		if (sp > level0_max_sp)
+			level0_max_sp = sp;
+		max_depth[0] = level0_max_sp - min_sp[0];
+	} else if (sp < entry_sp[level] && entry_sp[level] - sp > max_depth[level]) {
+		max_depth[level] = entry_sp[level] - sp;
+	}
+}
+
+void RVStackStats::print_summary(FILE *f) const {
+	fprintf(f, "Stack usage (hart 0):\n");
+	fprintf(f, "  %-5s %12s %-8s %10s\n", "level", "entries", "min sp", "max depth");
+	ux_t total = 0;
+	for (uint i = 0; i < MAX_LEVELS; ++i) {
+		if (min_sp[i] == ~0u)
+			continue;
+		if (i == 0)
+			fprintf(f, "  %-5u %12s %08x %9uB\n", i, "-", min_sp[i], max_depth[i]);
+		else
+			fprintf(f, "  %-5u %12" PRIu64 " %08x %9uB\n", i, entries[i], min_sp[i], max_depth[i]);
+		total += max_depth[i];
+	}
+	fprintf(f, "  Worst case (sum over levels): %uB\n", total);
+}
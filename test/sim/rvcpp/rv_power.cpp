@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cinttypes>
+#include <vector>
+
+#include "rv_power.h"
+#include "rv_snapshot.h"
+
+// msleep bits
+static const uint MSLEEP_DEEPSLEEP    = 1u << 0;
+static const uint MSLEEP_POWERDOWN    = 1u << 1;
+static const uint MSLEEP_SLEEPONBLOCK = 1u << 2;
+
+const char *const RVPower::state_names[N_STATES] = {
+	"run",
+	"sleep",
+	"deepsleep",
+	"powerdown"
+};
+
+// Same decision as the S_AWAKE state of hazard3_power_ctrl.v. A block without
+// sleeponblock is just a pipeline stall.
+static RVPower::state_t sleep_state(bool is_block, uint msleep) {
+	if (is_block && !(msleep & MSLEEP_SLEEPONBLOCK))
+		return RVPower::S_SLEEP;
+	if (msleep & MSLEEP_POWERDOWN)
+		return RVPower::S_POWERDOWN;
+	if (msleep & MSLEEP_DEEPSLEEP)
+		return RVPower::S_DEEPSLEEP;
+	return RVPower::S_SLEEP;
+}
+
+uint RVPower::step(uint64_t now, ux_t pc, uint cycles, bool sleeping,
+		bool stalled_on_wfi, bool stalled_on_block, uint msleep) {
+	state_t next_state;
+	uint extra = 0;
+	if (sleeping) {
+		Site &site = sites[sleep_pc];
+		next_state = sleep_state(site.is_block, msleep);
+		site.cycles[next_state] += cycles;
+		sleep_len += cycles;
+	} else {
+		if (in_sleep) {
+			// The sleep ended at the start of this step.
+			Site &site = sites[sleep_pc];
+			if (sleep_len == 0)
+				++site.fall_through;
+			if (state == S_DEEPSLEEP)
+				extra = WAKE_CYCLES_DEEPSLEEP;
+			else if (state == S_POWERDOWN)
+				extra = WAKE_CYCLES_POWERDOWN;
+			site.cycles[state] += extra;
+			state_cycles[state] += extra;
+			wake_cycles += extra;
+			in_sleep = false;
+		}
+		next_state = S_RUN;
+	}
+
+	if (next_state != state) {
+		if (timeline) {
+			fprintf(timeline, "%12" PRIu64 " %08x %-9s -> %s\n", now + extra,
+				next_state == S_RUN ? pc : sleep_pc, state_names[state], state_names[next_state]);
+		}
+		++state_entries[next_state];
+		state = next_state;
+	}
+	state_cycles[state] += cycles;
+
+	if (!in_sleep && (stalled_on_wfi || stalled_on_block)) {
+		in_sleep = true;
+		sleep_pc = pc;
+		sleep_len = 0;
+		Site &site = sites[pc];
+		site.is_block = stalled_on_block;
+		++site.entries;
+	}
+	return extra;
+}
+
+void RVPower::serialise(RVSnapshotIO &io) {
+	io.field(state);
+	io.field(in_sleep);
+	io.field(sleep_pc);
+	io.field(sleep_len);
+	// A sleep in progress is accounted to its site, which must exist (with
+	// the right type) when the sleep ends
+	bool sleep_is_block = in_sleep && sites[sleep_pc].is_block;
+	io.field(sleep_is_block);
+	if (io.loading && in_sleep)
+		sites[sleep_pc].is_block = sleep_is_block;
+}
+
+void RVPower::print_summary(FILE *f) const {
+	uint64_t total = 0;
+	for (uint i = 0; i < N_STATES; ++i)
+		total += state_cycles[i];
+	double c = total ? (double)total : 1.0;
+
+	fprintf(f, "Power state summary:\n");
+	fprintf(f, "  %-10s %12s %8s %10s\n", "State", "Cycles", "Time", "Entries");
+	for (uint i = 0; i < N_STATES; ++i) {
+		fprintf(f, "  %-10s %12" PRIu64 " %7.2f%% %10" PRIu64 "\n", state_names[i],
+			state_cycles[i], 100.0 * state_cycles[i] / c, state_entries[i]);
+	}
+	fprintf(f, "  Wakeup latency cycles: %" PRIu64 "\n", wake_cycles);
+
+	if (sites.empty())
+		return;
+
+	// Sites with the most time asleep first
+	std::vector<std::pair<ux_t, Site>> sorted(sites.begin(), sites.end());
+	auto sleep_total = [](const Site &s) {
+		return s.cycles[S_SLEEP] + s.cycles[S_DEEPSLEEP] + s.cycles[S_POWERDOWN];
+	};
+	std::stable_sort(sorted.begin(), sorted.end(), [&](const auto &a, const auto &b) {
+		return sleep_total(a.second) > sleep_total(b.second);
+	});
+
+	fprintf(f, "Sleep sites (\"sleep\" is time stalled with the clock running):\n");
+	fprintf(f, "  %-8s %-5s %10s %10s %12s %12s %12s\n",
+		"PC", "Kind", "Entries", "FallThru", "sleep", "deepsleep", "powerdown");
+	for (const auto &[pc, site] : sorted) {
+		fprintf(f, "  %08x %-5s %10" PRIu64 " %10" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+			pc, site.is_block ? "block" : "wfi", site.entries, site.fall_through,
+			site.cycles[S_SLEEP], site.cycles[S_DEEPSLEEP], site.cycles[S_POWERDOWN]);
+	}
+}
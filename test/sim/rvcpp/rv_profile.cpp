@@ -0,0 +1,105 @@
+#include "rv_profile.h"
+#include "rv_core.h"
+#include "encoding/rv_opcodes.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <map>
+#include <string>
+
+#define BITS_UPTO(msb) (~((-1u << (msb)) << 1))
+#define BITRANGE(msb, lsb) (BITS_UPTO((msb) - (lsb)) << (lsb))
+#define GETBITS(x, msb, lsb) (((x) & BITRANGE(msb, lsb)) >> (lsb))
+#define GETBIT(x, bit) (((x) >> (bit)) & 1u)
+
+bool RVProfile::is_control_transfer(uint32_t instr) {
+	if ((instr & 0x3) == 0x3) {
+		uint opc = GETBITS(instr, 6, 2);
+		// SYSTEM with funct3 == 0 is ecall/ebreak/mret/wfi, which either trap
+		// or may be followed by a trap. CSR instructions don't end a block.
+		return opc == RVCore::OPC_BRANCH || opc == RVCore::OPC_JAL || opc == RVCore::OPC_JALR ||
+			(opc == RVCore::OPC_SYSTEM && GETBITS(instr, 14, 12) == 0);
+	} else {
+		// c.jr, c.jalr and c.ebreak are c.mv/c.add encodings with rs2 == 0
+		bool cr_jump = (instr & 0xe07fu) == 0x8002u;
+		return cr_jump || RVOPC_MATCH(instr, C_J) || RVOPC_MATCH(instr, C_JAL) ||
+			RVOPC_MATCH(instr, C_BEQZ) || RVOPC_MATCH(instr, C_BNEZ) ||
+			RVOPC_MATCH(instr, CM_POPRET) || RVOPC_MATCH(instr, CM_POPRETZ);
+	}
+}
+
+static double percent(uint64_t x, uint64_t total) {
+	return total ? 100.0 * x / total : 0.0;
+}
+
+void RVProfile::print_summary(FILE *f, const RVSymbolTable &symbols, uint top_n) const {
+	struct Totals {
+		uint64_t instrs;
+		uint64_t cycles;
+	};
+
+	uint64_t total_instrs = other_instrs;
+	uint64_t total_cycles = other_cycles;
+	std::map<const RVSymbolTable::Symbol*, Totals> funcs;
+	for (uint32_t i = 0; i < n_halfwords; ++i) {
+		if (!instrs[i])
+			continue;
+		uint64_t c = count_cycles ? cycles[i] : instrs[i];
+		Totals &t = funcs[symbols.lookup(base + 2 * i)];
+		t.instrs += instrs[i];
+		t.cycles += c;
+		total_instrs += instrs[i];
+		total_cycles += c;
+	}
+	const char *weight_name = count_cycles ? "cycles" : "instructions";
+
+	fprintf(f, "Profile: %" PRIu64 " instructions", total_instrs);
+	if (count_cycles)
+		fprintf(f, ", %" PRIu64 " cycles (excluding %" PRIu64 " trap entry, %" PRIu64 " sleep)",
+			total_cycles, trap_cycles, sleep_cycles);
+	fprintf(f, ", %" PRIu64 " traps\n", trap_count);
+	if (other_instrs) {
+		fprintf(f, "  %" PRIu64 " instructions executed outside of loaded image\n", other_instrs);
+	}
+
+	std::vector<std::pair<const RVSymbolTable::Symbol*, Totals>> func_list(funcs.begin(), funcs.end());
+	std::sort(func_list.begin(), func_list.end(), [](const auto &a, const auto &b) {
+		return a.second.cycles > b.second.cycles;
+	});
+	fprintf(f, "Top functions by %s%s:\n", weight_name, symbols.empty() ? " (no symbols loaded)" : "");
+	fprintf(f, "  %12s %6s", "instrs", "%");
+	if (count_cycles)
+		fprintf(f, " %12s %6s %5s", "cycles", "%", "CPI");
+	fprintf(f, "  function\n");
+	for (uint i = 0; i < func_list.size() && i < top_n; ++i) {
+		const Totals &t = func_list[i].second;
+		fprintf(f, "  %12" PRIu64 " %5.1f%%", t.instrs, percent(t.instrs, total_instrs));
+		if (count_cycles)
+			fprintf(f, " %12" PRIu64 " %5.1f%% %5.2f", t.cycles, percent(t.cycles, total_cycles),
+				(double)t.cycles / t.instrs);
+		fprintf(f, "  %s\n", func_list[i].first ? func_list[i].first->name.c_str() : "(unknown)");
+	}
+
+	std::vector<uint32_t> blocks;
+	for (uint32_t i = 0; i < n_halfwords; ++i) {
+		if (block_entries[i])
+			blocks.push_back(i);
+	}
+	const std::vector<uint64_t> &block_weight = count_cycles ? block_cycles : block_instrs;
+	std::sort(blocks.begin(), blocks.end(), [&](uint32_t a, uint32_t b) {
+		return block_weight[a] > block_weight[b];
+	});
+	fprintf(f, "Top basic blocks by %s:\n", weight_name);
+	fprintf(f, "  %-8s %-8s %12s %12s", "start", "last", "entries", "instrs");
+	if (count_cycles)
+		fprintf(f, " %12s", "cycles");
+	fprintf(f, " %6s  location\n", "%");
+	for (uint i = 0; i < blocks.size() && i < top_n; ++i) {
+		uint32_t b = blocks[i];
+		ux_t start = base + 2 * b;
+		fprintf(f, "  %08x %08x %12" PRIu64 " %12" PRIu64, start, block_last[b], block_entries[b], block_instrs[b]);
+		if (count_cycles)
+			fprintf(f, " %12" PRIu64, block_cycles[b]);
+		fprintf(f, " %5.1f%%  %s\n", percent(block_weight[b], total_cycles), symbols.format_addr(start).c_str());
+	}
+}
@@ -0,0 +1,249 @@
+#include "rv_reverse.h"
+#include "rv_core.h"
+#include "rv_isa.h"
+#include "encoding/rv_opcodes.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+// Replay with the core's instrumentation detached, and IO printing
+// suppressed, since it all happened once already
+struct ReplayGuard {
+	RVCore &core;
+	TBMemIO &io;
+	RVTraceWriter *trace_writer;
+	RVFlightRecorder *flight_recorder;
+	RVHeatmap *heatmap;
+	bool quiet;
+
+	ReplayGuard(RVCore &core_, TBMemIO &io_): core(core_), io(io_) {
+		trace_writer = core.trace_writer;
+		flight_recorder = core.flight_recorder;
+		heatmap = core.heatmap;
+		quiet = io.quiet;
+		core.trace_writer = nullptr;
+		core.flight_recorder = nullptr;
+		core.heatmap = nullptr;
+		io.quiet = true;
+	}
+
+	~ReplayGuard() {
+		core.trace_writer = trace_writer;
+		core.flight_recorder = flight_recorder;
+		core.heatmap = heatmap;
+		io.quiet = quiet;
+	}
+};
+
+RVReverse::RVReverse(RVCore &core_, TBMemIO &io_, uint64_t interval_): core(core_), io(io_) {
+	ram = (uint8_t*)core.ram;
+	ram_base = core.ram_base;
+	ram_size = core.ram_top - core.ram_base;
+	interval = interval_;
+	position = 0;
+	present = 0;
+	page_epoch.resize((ram_size + PAGE_SIZE - 1) / PAGE_SIZE);
+	next_epoch = 1;
+	watch_start = 0;
+	watch_end = 0;
+	watch_hit = false;
+	take_checkpoint();
+}
+
+void RVReverse::save_page(uint32_t page) {
+	size_t offs = (size_t)page * PAGE_SIZE;
+	size_t size = std::min<size_t>(PAGE_SIZE, ram_size - offs);
+	checkpoints.back().undo.push_back({page, std::vector<uint8_t>(ram + offs, ram + offs + size)});
+	page_epoch[page] = checkpoints.back().epoch;
+}
+
+void RVReverse::take_checkpoint() {
+	if (!checkpoints.empty() && checkpoints.back().step == position)
+		return;
+	Checkpoint cp;
+	cp.step = position;
+	cp.epoch = next_epoch++;
+	RVSnapshotIO sio(cp.state, false);
+	sio.include_ram = false;
+	core.serialise(sio);
+	io.serialise(sio);
+	checkpoints.push_back(std::move(cp));
+}
+
+void RVReverse::restore(size_t index) {
+	for (size_t i = checkpoints.size(); i-- > index;) {
+		for (auto &[page, data] : checkpoints[i].undo)
+			memcpy(ram + (size_t)page * PAGE_SIZE, data.data(), data.size());
+	}
+	checkpoints.resize(index + 1);
+	Checkpoint &cp = checkpoints.back();
+	cp.undo.clear();
+	cp.epoch = next_epoch++;
+	RVSnapshotIO sio(cp.state, true);
+	sio.include_ram = false;
+	core.serialise(sio);
+	io.serialise(sio);
+	assert(sio.ok);
+	position = cp.step;
+}
+
+void RVReverse::replay_step() {
+	rv_step_with_io(core, io);
+	++position;
+	if (position % interval == 0)
+		take_checkpoint();
+}
+
+bool RVReverse::seek(uint64_t step) {
+	if (step > present)
+		return false;
+	ReplayGuard guard(core, io);
+	if (step < position) {
+		size_t index = checkpoints.size() - 1;
+		while (checkpoints[index].step > step)
+			--index;
+		restore(index);
+	}
+	while (position < step)
+		replay_step();
+	return true;
+}
+
+bool RVReverse::find_last(const std::function<void()> &before, const std::function<bool()> &after) {
+	ReplayGuard guard(core, io);
+	uint64_t start = position;
+	uint64_t seg_end = position;
+	size_t index = checkpoints.size() - 1;
+	while (index > 0 && checkpoints[index].step >= seg_end)
+		--index;
+	while (seg_end > 0) {
+		uint64_t seg_start = checkpoints[index].step;
+		restore(index);
+		bool found = false;
+		uint64_t hit = 0;
+		while (position < seg_end) {
+			before();
+			replay_step();
+			if (after()) {
+				found = true;
+				hit = position - 1;
+			}
+		}
+		if (found)
+			return seek(hit);
+		if (index == 0)
+			break;
+		seg_end = seg_start;
+		--index;
+	}
+	seek(start);
+	return false;
+}
+
+void RVReverse::print_position(const RVSymbolTable &symbols, FILE *out) {
+	ux_t pc = core.pc;
+	fprintf(out, "Step %" PRIu64 ": %08x", position, pc);
+	if (!symbols.empty())
+		fprintf(out, " <%s>", symbols.format_addr(pc).c_str());
+	std::optional<uint16_t> lo = core.r16(pc, 0x4u);
+	std::optional<uint16_t> hi = core.r16(pc + 2, 0x4u);
+	if (lo && ((*lo & 0x3) != 0x3 || hi)) {
+		uint32_t instr = (*lo & 0x3) == 0x3 ? *lo | (uint32_t)*hi << 16 : *lo;
+		fprintf(out, ": %s", rv_disasm(instr, pc, &symbols).c_str());
+	}
+	fprintf(out, "\n");
+}
+
+static bool parse_reg(const std::string &s, uint &reg) {
+	for (uint i = 0; i < 32; ++i) {
+		if (s == friendly_reg_names[i] || s == "x" + std::to_string(i)) {
+			reg = i;
+			return true;
+		}
+	}
+	if (s == "fp") {
+		reg = 8;
+		return true;
+	}
+	return false;
+}
+
+bool RVReverse::query(const std::string &q, const RVSymbolTable &symbols, FILE *out) {
+	size_t eq = q.find('=');
+	std::string name = q.substr(0, eq);
+	std::string arg = eq == std::string::npos ? "" : q.substr(eq + 1);
+
+	if (name == "back" || name == "forward") {
+		uint64_t n = 1;
+		if (!arg.empty()) {
+			char *end;
+			n = strtoull(arg.c_str(), &end, 0);
+			if (*end != '\0')
+				return false;
+		}
+		uint64_t target = name == "back" ? position - std::min(n, position) : std::min(position + n, present);
+		seek(target);
+		print_position(symbols, out);
+	} else if (name == "present" && arg.empty()) {
+		seek(present);
+		print_position(symbols, out);
+	} else if (name == "write" && !arg.empty()) {
+		ux_t lo, hi;
+		size_t colon = arg.find(':');
+		if (colon != std::string::npos) {
+			if (!symbols.resolve(arg.substr(0, colon), lo) || !symbols.resolve(arg.substr(colon + 1), hi) || hi <= lo)
+				return false;
+		} else {
+			if (!symbols.resolve(arg, lo))
+				return false;
+			const RVSymbolTable::Symbol *sym = symbols.find(arg);
+			hi = sym && sym->size ? lo + sym->size : lo + 1;
+		}
+		watch_start = lo;
+		watch_end = hi;
+		bool found = find_last([&]() {watch_hit = false;}, [&]() {return watch_hit;});
+		watch_start = 0;
+		watch_end = 0;
+		if (!found) {
+			fprintf(out, "No write to %08x..%08x before step %" PRIu64 "\n", lo, hi, position);
+			return true;
+		}
+		print_position(symbols, out);
+		// Show the bytes written, by stepping over the write and back
+		std::vector<uint8_t> old_data, new_data;
+		ux_t show_end = std::min(hi, lo + 16);
+		for (ux_t a = lo; a < show_end; ++a)
+			old_data.push_back(core.r8(a, 0x4u).value_or(0));
+		seek(position + 1);
+		for (ux_t a = lo; a < show_end; ++a)
+			new_data.push_back(core.r8(a, 0x4u).value_or(0));
+		seek(position - 1);
+		fprintf(out, "  %08x:", lo);
+		for (uint8_t b : old_data)
+			fprintf(out, " %02x", b);
+		fprintf(out, " ->");
+		for (uint8_t b : new_data)
+			fprintf(out, " %02x", b);
+		fprintf(out, "%s\n", show_end < hi ? " ..." : "");
+	} else if (name == "reg" && !arg.empty()) {
+		uint reg;
+		if (!parse_reg(arg, reg) || reg == 0)
+			return false;
+		ux_t old_value = 0;
+		bool found = find_last([&]() {old_value = core.regs[reg];}, [&]() {return core.regs[reg] != old_value;});
+		if (!found) {
+			fprintf(out, "No change to %s before step %" PRIu64 "\n", friendly_reg_names[reg], position);
+			return true;
+		}
+		print_position(symbols, out);
+		ux_t before = core.regs[reg];
+		seek(position + 1);
+		ux_t after = core.regs[reg];
+		seek(position - 1);
+		fprintf(out, "  %s: %08x -> %08x\n", friendly_reg_names[reg], before, after);
+	} else {
+		return false;
+	}
+	return true;
+}
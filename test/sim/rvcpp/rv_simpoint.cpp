@@ -0,0 +1,264 @@
+#include "rv_simpoint.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+
+void RVSimPoint::enter_block(ux_t pc) {
+	auto it = block_ids.find(pc);
+	if (it != block_ids.end()) {
+		cur_block = it->second;
+	} else {
+		cur_block = block_ids.size();
+		block_ids[pc] = cur_block;
+		counts.push_back(0);
+	}
+}
+
+void RVSimPoint::end_interval() {
+	BBV bbv;
+	std::sort(touched.begin(), touched.end());
+	for (uint32_t id : touched) {
+		bbv.push_back({id, counts[id]});
+		counts[id] = 0;
+	}
+	touched.clear();
+	bbvs.push_back(std::move(bbv));
+}
+
+// Deterministic pseudorandom projection weight in [-1, 1] for one block ID
+// and output dimension, so the projection matrix never needs to be stored
+static double projection_weight(uint32_t id, uint dim) {
+	uint64_t x = ((uint64_t)id << 8 | dim) + 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return (double)(x >> 11) / (double)(1ull << 52) - 1.0;
+}
+
+typedef std::vector<double> Point;
+
+static double dist2(const Point &a, const Point &b) {
+	double d = 0.0;
+	for (size_t i = 0; i < a.size(); ++i)
+		d += (a[i] - b[i]) * (a[i] - b[i]);
+	return d;
+}
+
+struct KMeansResult {
+	std::vector<Point> centres;
+	std::vector<uint> assignment;
+	double distortion;
+};
+
+static KMeansResult kmeans(const std::vector<Point> &points, uint k, std::mt19937_64 &rng, uint max_iterations) {
+	size_t n = points.size();
+	KMeansResult r;
+	// k-means++ initialisation
+	r.centres.push_back(points[rng() % n]);
+	std::vector<double> d2(n);
+	while (r.centres.size() < k) {
+		double sum = 0.0;
+		for (size_t i = 0; i < n; ++i) {
+			d2[i] = std::numeric_limits<double>::max();
+			for (const Point &c : r.centres)
+				d2[i] = std::min(d2[i], dist2(points[i], c));
+			sum += d2[i];
+		}
+		size_t pick = rng() % n;
+		if (sum > 0.0) {
+			double target = std::uniform_real_distribution<double>(0.0, sum)(rng);
+			for (pick = 0; pick + 1 < n && target >= d2[pick]; ++pick)
+				target -= d2[pick];
+		}
+		r.centres.push_back(points[pick]);
+	}
+
+	r.assignment.assign(n, 0);
+	for (uint iter = 0; iter < max_iterations; ++iter) {
+		bool changed = iter == 0;
+		for (size_t i = 0; i < n; ++i) {
+			uint best = 0;
+			double best_d = std::numeric_limits<double>::max();
+			for (uint c = 0; c < k; ++c) {
+				double d = dist2(points[i], r.centres[c]);
+				if (d < best_d) {
+					best_d = d;
+					best = c;
+				}
+			}
+			if (r.assignment[i] != best) {
+				r.assignment[i] = best;
+				changed = true;
+			}
+		}
+		if (!changed)
+			break;
+		std::vector<size_t> sizes(k, 0);
+		for (Point &c : r.centres)
+			std::fill(c.begin(), c.end(), 0.0);
+		for (size_t i = 0; i < n; ++i) {
+			++sizes[r.assignment[i]];
+			for (size_t d = 0; d < points[i].size(); ++d)
+				r.centres[r.assignment[i]][d] += points[i][d];
+		}
+		for (uint c = 0; c < k; ++c) {
+			if (sizes[c] == 0) {
+				// Reseed an empty cluster on a random point
+				r.centres[c] = points[rng() % n];
+			} else {
+				for (double &x : r.centres[c])
+					x /= sizes[c];
+			}
+		}
+	}
+
+	r.distortion = 0.0;
+	for (size_t i = 0; i < n; ++i)
+		r.distortion += dist2(points[i], r.centres[r.assignment[i]]);
+	return r;
+}
+
+// Bayesian information criterion for a clustering, as in X-means and
+// SimPoint. Higher is better.
+static double bic(const std::vector<Point> &points, const KMeansResult &r) {
+	double n = points.size();
+	double k = r.centres.size();
+	double dims = points[0].size();
+	std::vector<double> sizes(r.centres.size(), 0.0);
+	for (uint a : r.assignment)
+		sizes[a] += 1.0;
+	double variance = n > k ? r.distortion / (n - k) : 0.0;
+	variance = std::max(variance, 1e-12);
+	double loglik = 0.0;
+	for (double rn : sizes) {
+		if (rn == 0.0)
+			continue;
+		loglik += rn * std::log(rn) - rn * std::log(n) - rn * 0.5 * std::log(2.0 * M_PI)
+			- rn * dims * 0.5 * std::log(variance) - (rn - k) * 0.5;
+	}
+	double params = k * (dims + 1.0);
+	return loglik - params * 0.5 * std::log(n);
+}
+
+void RVSimPoint::cluster(uint max_k) {
+	simpoints.clear();
+	// A trailing partial interval is not representative of anything, unless
+	// it's the only one
+	size_t n = bbvs.size();
+	if (n > 1 && instret % interval != 0)
+		--n;
+	if (n == 0)
+		return;
+
+	std::vector<Point> points(n, Point(PROJECTED_DIMS, 0.0));
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t total = 0;
+		for (auto &[id, count] : bbvs[i])
+			total += count;
+		for (auto &[id, count] : bbvs[i]) {
+			double x = (double)count / total;
+			for (uint d = 0; d < PROJECTED_DIMS; ++d)
+				points[i][d] += x * projection_weight(id, d);
+		}
+	}
+
+	std::mt19937_64 rng(1);
+	std::vector<KMeansResult> results;
+	std::vector<double> scores;
+	for (uint k = 1; k <= max_k && k <= n; ++k) {
+		KMeansResult best;
+		best.distortion = std::numeric_limits<double>::max();
+		for (uint restart = 0; restart < KMEANS_RESTARTS; ++restart) {
+			KMeansResult r = kmeans(points, k, rng, KMEANS_MAX_ITERATIONS);
+			if (r.distortion < best.distortion)
+				best = std::move(r);
+		}
+		scores.push_back(bic(points, best));
+		results.push_back(std::move(best));
+	}
+	double min_score = *std::min_element(scores.begin(), scores.end());
+	double max_score = *std::max_element(scores.begin(), scores.end());
+	size_t chosen = 0;
+	while (chosen + 1 < scores.size() && scores[chosen] < min_score + 0.9 * (max_score - min_score))
+		++chosen;
+	const KMeansResult &r = results[chosen];
+
+	for (uint c = 0; c < r.centres.size(); ++c) {
+		size_t size = 0;
+		size_t closest = 0;
+		double closest_d = std::numeric_limits<double>::max();
+		for (size_t i = 0; i < n; ++i) {
+			if (r.assignment[i] != c)
+				continue;
+			++size;
+			double d = dist2(points[i], r.centres[c]);
+			if (d < closest_d) {
+				closest_d = d;
+				closest = i;
+			}
+		}
+		if (size)
+			simpoints.push_back({(uint)simpoints.size(), closest, (double)size / n});
+	}
+}
+
+bool RVSimPoint::finish(const std::string &prefix, uint max_k) {
+	if (!touched.empty())
+		end_interval();
+	cluster(max_k);
+
+	FILE *bb = fopen((prefix + ".bb").c_str(), "w");
+	FILE *sp = fopen((prefix + ".simpoints").c_str(), "w");
+	FILE *wt = fopen((prefix + ".weights").c_str(), "w");
+	bool ok = bb && sp && wt;
+	if (ok) {
+		for (const BBV &bbv : bbvs) {
+			fprintf(bb, "T");
+			for (auto &[id, count] : bbv)
+				fprintf(bb, ":%u:%" PRIu64 " ", id + 1, count);
+			fprintf(bb, "\n");
+		}
+		for (const SimPoint &s : simpoints) {
+			fprintf(sp, "%" PRIu64 " %u\n", s.interval, s.cluster);
+			fprintf(wt, "%f %u\n", s.weight, s.cluster);
+		}
+	} else {
+		fprintf(stderr, "Failed to open %s.{bb,simpoints,weights} for writing\n", prefix.c_str());
+	}
+	for (FILE *f : {bb, sp, wt}) {
+		if (f)
+			fclose(f);
+	}
+	return ok;
+}
+
+void RVSimPoint::print_summary(FILE *f) const {
+	fprintf(f, "SimPoint: %zu intervals of %" PRIu64 " instructions, %zu basic blocks, %zu clusters\n",
+		bbvs.size(), interval, block_ids.size(), simpoints.size());
+	fprintf(f, "  %-7s %12s %16s %8s\n", "cluster", "interval", "start instret", "weight");
+	for (const SimPoint &s : simpoints) {
+		fprintf(f, "  %-7u %12" PRIu64 " %16" PRIu64 " %8.4f\n", s.cluster, s.interval,
+			s.interval * interval, s.weight);
+	}
+}
+
+bool RVSimPoint::read_simpoints(const std::string &path, std::vector<uint64_t> &intervals) {
+	std::ifstream in(path);
+	if (!in) {
+		fprintf(stderr, "Failed to open %s\n", path.c_str());
+		return false;
+	}
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream fields(line);
+		uint64_t interval;
+		if (fields >> interval)
+			intervals.push_back(interval);
+	}
+	return true;
+}
@@ -0,0 +1,165 @@
+#include "rv_snapshot.h"
+#include "rv_core.h"
+#include "rv_mem.h"
+#include "rv_power.h"
+
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+
+void RVSnapshotIO::raw(void *data, size_t size) {
+	if (!ok || !size)
+		return;
+	if (buf) {
+		if (!loading) {
+			buf->insert(buf->end(), (uint8_t*)data, (uint8_t*)data + size);
+		} else if (buf_pos + size <= buf->size()) {
+			memcpy(data, buf->data() + buf_pos, size);
+			buf_pos += size;
+		} else {
+			ok = false;
+		}
+		return;
+	}
+	size_t done = loading ? fread(data, size, 1, f) : fwrite(data, size, 1, f);
+	if (done != 1)
+		ok = false;
+}
+
+void RVSnapshotIO::expect(uint32_t value) {
+	uint32_t x = value;
+	field(x);
+	if (x != value)
+		ok = false;
+}
+
+void RVSnapshotIO::sparse(void *data, size_t size) {
+	uint8_t *bytes = (uint8_t*)data;
+	uint32_t n_pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+	auto page_size = [&](uint32_t page) -> size_t {
+		return std::min<size_t>(PAGE_SIZE, size - (size_t)page * PAGE_SIZE);
+	};
+	expect(size);
+	if (loading) {
+		memset(data, 0, size);
+		uint32_t count = 0;
+		field(count);
+		for (uint32_t i = 0; i < count && ok; ++i) {
+			uint32_t page = 0;
+			field(page);
+			if (page >= n_pages) {
+				ok = false;
+				break;
+			}
+			raw(bytes + (size_t)page * PAGE_SIZE, page_size(page));
+		}
+	} else {
+		static const uint8_t zeroes[PAGE_SIZE] = {0};
+		std::vector<uint32_t> pages;
+		for (uint32_t page = 0; page < n_pages; ++page) {
+			if (memcmp(bytes + (size_t)page * PAGE_SIZE, zeroes, page_size(page)) != 0)
+				pages.push_back(page);
+		}
+		uint32_t count = pages.size();
+		field(count);
+		for (uint32_t page : pages) {
+			field(page);
+			raw(bytes + (size_t)page * PAGE_SIZE, page_size(page));
+		}
+	}
+}
+
+void RVSnapshotIO::header() {
+	char magic[8];
+	memcpy(magic, "RVCPPSNP", 8);
+	raw(magic, sizeof(magic));
+	if (memcmp(magic, "RVCPPSNP", 8) != 0)
+		ok = false;
+	expect(VERSION);
+}
+
+// Optional models are stored behind a flag saying whether the saving run
+// had them enabled
+template <typename T>
+static void serialise_model(RVSnapshotIO &io, T *model, const char *option) {
+	bool present = model != nullptr;
+	io.field(present);
+	if (!present) {
+		if (io.loading && model && io.ok)
+			fprintf(stderr, "Snapshot has no %s state, starting it from reset\n", option);
+		return;
+	}
+	T discard;
+	(model ? model : &discard)->serialise(io);
+}
+
+bool rv_save_snapshot(const std::string &path, RVCore &core, TBMemIO &tbio, RVPower *power) {
+	FILE *f = fopen(path.c_str(), "wb");
+	RVSnapshotIO io(f, false);
+	io.header();
+	core.serialise(io);
+	tbio.serialise(io);
+	serialise_model(io, core.timing, "--timing");
+	serialise_model(io, power, "--power");
+	if (f)
+		io.ok = fclose(f) == 0 && io.ok;
+	if (!io.ok)
+		fprintf(stderr, "Failed to write snapshot %s\n", path.c_str());
+	return io.ok;
+}
+
+bool rv_load_snapshot(const std::string &path, RVCore &core, TBMemIO &tbio, RVPower *power) {
+	FILE *f = fopen(path.c_str(), "rb");
+	RVSnapshotIO io(f, true);
+	io.header();
+	core.serialise(io);
+	tbio.serialise(io);
+	serialise_model(io, core.timing, "--timing");
+	serialise_model(io, power, "--power");
+	if (f)
+		fclose(f);
+	if (!io.ok)
+		fprintf(stderr, "Failed to load snapshot %s (missing, truncated, or a different RAM size)\n", path.c_str());
+	return io.ok;
+}
+
+bool rv_save_handoff(const std::string &prefix, RVCore &core, TBMemIO &tbio) {
+	std::string bin_path = prefix + ".bin";
+	std::string txt_path = prefix + ".txt";
+
+	const uint8_t *ram = (const uint8_t*)core.ram;
+	size_t ram_used = core.ram_top - core.ram_base;
+	while (ram_used > 0 && ram[ram_used - 1] == 0)
+		--ram_used;
+	FILE *f = fopen(bin_path.c_str(), "wb");
+	bool ok = f && fwrite(ram, 1, ram_used, f) == ram_used;
+	if (f)
+		ok = fclose(f) == 0 && ok;
+	if (!ok) {
+		fprintf(stderr, "Failed to write %s\n", bin_path.c_str());
+		return false;
+	}
+
+	f = fopen(txt_path.c_str(), "w");
+	if (!f) {
+		fprintf(stderr, "Failed to write %s\n", txt_path.c_str());
+		return false;
+	}
+	fprintf(f, "# rvcpp state handoff, RAM image in %s\n", bin_path.c_str());
+	fprintf(f, "pc %08x\n", core.pc);
+	fprintf(f, "priv %u\n", core.csr.get_true_priv());
+	for (uint i = 1; i < 32; ++i)
+		fprintf(f, "x %u %08x\n", i, core.regs[i]);
+	for (auto [addr, data] : core.csr.get_restore_writes())
+		fprintf(f, "csr %03x %08x\n", addr, data);
+	fprintf(f, "mtime %016" PRIx64 "\n", tbio.mtime);
+	fprintf(f, "mtimecmp %016" PRIx64 "\n", tbio.mtimecmp);
+	fprintf(f, "softirq %u\n", (uint)tbio.softirq);
+	for (uint i = 0; i < TBMemIO::IRQ_WORDS; ++i)
+		fprintf(f, "irq %u %08x\n", i, tbio.irq[i]);
+	if (fclose(f) != 0) {
+		fprintf(stderr, "Failed to write %s\n", txt_path.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,36 @@
+#include "rv_state_hash.h"
+#include "rv_core.h"
+#include "encoding/rv_csr.h"
+
+#include <cinttypes>
+
+void RVStateHash::step(const RVStepInfo &info) {
+	if (info.sleeping)
+		return;
+	uint n_before_pc = info.n_gpr_writes ? info.n_gpr_writes - 1 : 0;
+	if (info.trap_cause) {
+		ux_t cause = *info.trap_cause;
+		bool retired = cause == XCAUSE_ECALL_M || cause == XCAUSE_ECALL_U || cause == XCAUSE_EBREAK;
+		if (!retired) {
+			// A Zcmp pop which faults part way through has still written
+			// the registers it loaded before the fault
+			for (uint i = 0; i < info.n_gpr_writes; ++i) {
+				mix(info.gpr_writes[i].reg);
+				mix(info.gpr_writes[i].data);
+			}
+			return;
+		}
+	}
+	for (uint i = 0; i < n_before_pc; ++i) {
+		mix(info.gpr_writes[i].reg);
+		mix(info.gpr_writes[i].data);
+	}
+	mix(info.pc);
+	++instret;
+	if (instret % interval == 0 && instret >= print_start && instret <= print_end)
+		fprintf(out, "%" PRIu64 " %08x %016" PRIx64 "\n", instret, info.pc, hash);
+	for (uint i = n_before_pc; i < info.n_gpr_writes; ++i) {
+		mix(info.gpr_writes[i].reg);
+		mix(info.gpr_writes[i].data);
+	}
+}
@@ -0,0 +1,190 @@
+#include "rv_stimulus.h"
+
+#include <cinttypes>
+#include <cstring>
+
+static const uint8_t header[8] = {'R', 'V', 'S', 'T', 'I', 'M', 1, 0};
+
+bool RVStimulus::open(const std::string &path, Mode mode_) {
+	f = fopen(path.c_str(), mode_ == RECORD ? "wb" : "rb");
+	if (!f) {
+		fprintf(stderr, "Failed to open %s\n", path.c_str());
+		return false;
+	}
+	if (mode_ == RECORD) {
+		fwrite(header, 1, sizeof(header), f);
+	} else {
+		uint8_t buf[sizeof(header)];
+		if (fread(buf, 1, sizeof(buf), f) != sizeof(buf) || memcmp(buf, header, sizeof(header)) != 0) {
+			fprintf(stderr, "%s is not a stimulus log, or is from a different version\n", path.c_str());
+			fclose(f);
+			f = nullptr;
+			return false;
+		}
+	}
+	mode = mode_;
+	if (mode == REPLAY)
+		fetch_next();
+	return true;
+}
+
+void RVStimulus::finish(FILE *out) {
+	if (mode == RECORD) {
+		fprintf(out, "Stimulus: recorded %" PRIu64 " events in %" PRIu64 " steps\n", events, step);
+	} else if (mode == REPLAY) {
+		fprintf(out, "Stimulus: replayed %" PRIu64 " events in %" PRIu64 " steps\n", events, step);
+		if (have_next) {
+			fprintf(out, "Stimulus: run ended at step %" PRIu64 " with events left in the log (next at step %" PRIu64 ")\n",
+				step, next_step);
+		}
+	}
+	if (f)
+		fclose(f);
+	f = nullptr;
+	mode = OFF;
+}
+
+void RVStimulus::put_varint(uint64_t x) {
+	do {
+		uint8_t b = x & 0x7f;
+		x >>= 7;
+		fputc(b | (x ? 0x80 : 0), f);
+	} while (x);
+}
+
+bool RVStimulus::get_varint(uint64_t &x) {
+	x = 0;
+	for (uint shift = 0; shift < 64; shift += 7) {
+		int b = fgetc(f);
+		if (b == EOF)
+			return false;
+		x |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+void RVStimulus::put_event(uint8_t type) {
+	put_varint(step - last_event_step);
+	fputc(type, f);
+	last_event_step = step;
+	++events;
+}
+
+void RVStimulus::fetch_next() {
+	have_next = false;
+	uint64_t delta, addr, data;
+	if (!get_varint(delta))
+		return;
+	int type = fgetc(f);
+	if (type == EOF)
+		return;
+	next_step = last_event_step + delta;
+	next_type = type;
+	if (type == STIM_IRQ_T || type == STIM_IRQ_S) {
+		// No payload
+	} else if (type == STIM_IRQ_E) {
+		int index = fgetc(f);
+		if (index == EOF || (uint)index >= IRQ_WORDS || !get_varint(data))
+			return;
+		next_index = index;
+		next_data = data;
+	} else if (type >= STIM_READ8 && type <= STIM_READ32) {
+		if (!get_varint(addr) || !get_varint(data))
+			return;
+		next_addr = addr;
+		next_data = data;
+	} else if (type == STIM_READ_ERR) {
+		if (!get_varint(addr))
+			return;
+		int size = fgetc(f);
+		if (size == EOF)
+			return;
+		next_addr = addr;
+		next_index = size;
+	} else {
+		fprintf(stderr, "Stimulus: bad event type %d in log\n", type);
+		return;
+	}
+	last_event_step = next_step;
+	have_next = true;
+}
+
+void RVStimulus::diverge(const char *what) {
+	fprintf(stderr, "Stimulus: replay diverged at step %" PRIu64 ": %s\n", step, what);
+	diverged = true;
+	mode = OFF;
+}
+
+void RVStimulus::irqs(bool &t, bool &s, uint32_t *e) {
+	if (mode == RECORD) {
+		if (t != irq_t)
+			put_event(STIM_IRQ_T);
+		if (s != irq_s)
+			put_event(STIM_IRQ_S);
+		for (uint i = 0; i < IRQ_WORDS; ++i) {
+			if (e[i] != irq_e[i]) {
+				put_event(STIM_IRQ_E);
+				fputc(i, f);
+				put_varint(e[i]);
+			}
+		}
+		irq_t = t;
+		irq_s = s;
+		memcpy(irq_e, e, sizeof(irq_e));
+	} else if (mode == REPLAY) {
+		while (have_next && next_step <= step) {
+			if (next_type == STIM_IRQ_T) {
+				irq_t = !irq_t;
+			} else if (next_type == STIM_IRQ_S) {
+				irq_s = !irq_s;
+			} else if (next_type == STIM_IRQ_E) {
+				irq_e[next_index] = next_data;
+			} else if (next_step == step) {
+				// A read in the coming step
+				break;
+			} else {
+				// Reads are consumed during their step, so this one didn't happen
+				diverge("the recorded run made a device read which this run did not");
+				return;
+			}
+			++events;
+			fetch_next();
+		}
+		t = irq_t;
+		s = irq_s;
+		memcpy(e, irq_e, sizeof(irq_e));
+	}
+}
+
+void RVStimulus::record_read(ux_t addr, uint size, std::optional<uint32_t> data) {
+	if (data) {
+		put_event(size == 1 ? STIM_READ8 : size == 2 ? STIM_READ16 : STIM_READ32);
+		put_varint(addr);
+		put_varint(*data);
+	} else {
+		put_event(STIM_READ_ERR);
+		put_varint(addr);
+		fputc(size, f);
+	}
+}
+
+bool RVStimulus::replay_read(ux_t addr, uint size, std::optional<uint32_t> &data) {
+	uint8_t type = size == 1 ? STIM_READ8 : size == 2 ? STIM_READ16 : STIM_READ32;
+	bool match = have_next && next_step == step && next_addr == addr && (next_type == type ||
+		(next_type == STIM_READ_ERR && next_index == size));
+	if (!match) {
+		char buf[96];
+		snprintf(buf, sizeof(buf), "unexpected %u-byte device read from %08x", size, addr);
+		diverge(buf);
+		return false;
+	}
+	if (next_type == STIM_READ_ERR)
+		data = std::nullopt;
+	else
+		data = next_data;
+	++events;
+	fetch_next();
+	return true;
+}
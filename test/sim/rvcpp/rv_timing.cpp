@@ -0,0 +1,295 @@
+#include "rv_timing.h"
+#include "rv_core.h"
+#include "rv_hpm.h"
+#include "rv_snapshot.h"
+#include "encoding/rv_opcodes.h"
+
+#include <cinttypes>
+
+// Inclusive msb:lsb style, like Verilog (and like the ISA manual)
+#define BITS_UPTO(msb) (~((-1u << (msb)) << 1))
+#define BITRANGE(msb, lsb) (BITS_UPTO((msb) - (lsb)) << (lsb))
+#define GETBITS(x, msb, lsb) (((x) & BITRANGE(msb, lsb)) >> (lsb))
+#define GETBIT(x, bit) (((x) >> (bit)) & 1u)
+
+// Bitmap of registers read by an instruction in stage 2 of the pipeline, i.e.
+// the ones which can cause a load-use stall. Store data is consumed in stage
+// 3, so it is not included.
+static uint32_t stage2_reads(uint32_t instr) {
+	uint32_t mask = 0;
+	if ((instr & 0x3) == 0x3) {
+		uint32_t rs1 = 1u << GETBITS(instr, 19, 15);
+		uint32_t rs2 = 1u << GETBITS(instr, 24, 20);
+		switch (GETBITS(instr, 6, 2)) {
+			case RVCore::OPC_LUI:
+			case RVCore::OPC_AUIPC:
+			case RVCore::OPC_JAL:     mask = 0;                                                    break;
+			case RVCore::OPC_OP:
+			case RVCore::OPC_BRANCH:  mask = rs1 | rs2;                                            break;
+			case RVCore::OPC_CUSTOM0: mask = RVOPC_MATCH(instr, H3_BEXTM) ? rs1 | rs2 : rs1;      break;
+			case RVCore::OPC_SYSTEM:  mask = GETBIT(instr, 14) ? 0 : rs1;                          break;
+			default:                  mask = rs1;                                                  break;
+		}
+	} else {
+		uint32_t rs1_s = 1u << (GETBITS(instr, 9, 7) + 8);
+		uint32_t rs2_s = 1u << (GETBITS(instr, 4, 2) + 8);
+		uint32_t rs1_l = 1u << GETBITS(instr, 11, 7);
+		uint32_t rs2_l = 1u << GETBITS(instr, 6, 2);
+		uint32_t sp = 1u << 2;
+		// Case labels are octal: one digit for quadrant, one for funct3
+		uint quadrant_funct3 = (instr & 0x3) << 3 | GETBITS(instr, 15, 13);
+		switch (quadrant_funct3) {
+			// Quadrant 00: c.addi4spn, c.lw, Zcb loads/stores, c.sw
+			case 000: mask = sp;                                                                   break;
+			case 002:
+			case 004:
+			case 006: mask = rs1_s;                                                                break;
+			// Quadrant 01
+			case 010: mask = rs1_l;                                                                break;
+			case 013: mask = GETBITS(instr, 11, 7) == 2 ? sp : 0;                                  break;
+			case 014:
+				if (GETBITS(instr, 11, 10) != 0x3 || (GETBIT(instr, 12) && GETBITS(instr, 6, 5) == 0x3))
+					mask = rs1_s;
+				else
+					mask = rs1_s | rs2_s;
+				break;
+			case 016:
+			case 017: mask = rs1_s;                                                                break;
+			// Quadrant 10
+			case 020: mask = rs1_l;                                                                break;
+			case 022:
+			case 026: mask = sp;                                                                   break;
+			case 024:
+				if (GETBITS(instr, 6, 2) == 0)
+					mask = rs1_l;
+				else if (GETBIT(instr, 12))
+					mask = rs1_l | rs2_l;
+				else
+					mask = rs2_l;
+				break;
+			case 025:
+				if (RVOPC_MATCH(instr, CM_MVSA01))
+					mask = (1u << 10) | (1u << 11);
+				else if (RVOPC_MATCH(instr, CM_MVA01S))
+					mask = ~0u;
+				else
+					mask = sp;
+				break;
+			default:  mask = 0;                                                                    break;
+		}
+	}
+	return mask & ~1u;
+}
+
+// Destination register of a load whose result is written in stage 3, or 0.
+static uint get_load_rd(uint32_t instr) {
+	if ((instr & 0x3) == 0x3) {
+		if (GETBITS(instr, 6, 2) == RVCore::OPC_LOAD || RVOPC_MATCH(instr, LR_W) || RVOPC_MATCH(instr, SC_W))
+			return GETBITS(instr, 11, 7);
+	} else if (RVOPC_MATCH(instr, C_LW) || RVOPC_MATCH(instr, C_LBU) ||
+			RVOPC_MATCH(instr, C_LHU) || RVOPC_MATCH(instr, C_LH)) {
+		return GETBITS(instr, 4, 2) + 8;
+	} else if (RVOPC_MATCH(instr, C_LWSP)) {
+		return GETBITS(instr, 11, 7);
+	}
+	return 0;
+}
+
+static inline bool is_excl(uint32_t instr) {
+	return RVOPC_MATCH(instr, LR_W) || RVOPC_MATCH(instr, SC_W);
+}
+
+static inline bool is_amo(uint32_t instr) {
+	return (instr & 0x3) == 0x3 && GETBITS(instr, 6, 2) == RVCore::OPC_AMO && !is_excl(instr);
+}
+
+static inline uint zcmp_n_regs(uint32_t instr) {
+	uint rlist = GETBITS(instr, 7, 4);
+	return rlist == 0xf ? 13 : rlist - 3;
+}
+
+uint RVTiming::retire(ux_t pc, uint32_t instr, ux_t next_pc, const ux_t *regs) {
+	bool is_32bit = (instr & 0x3) == 0x3;
+	uint size_hwords = is_32bit ? 2 : 1;
+	ux_t seq_pc = pc + 2 * size_hwords;
+	uint opc = GETBITS(instr, 6, 2);
+
+	// Instruction must be fully present in the prefetch buffer before it can
+	// issue. In the 2-port configuration this only happens after a jump to an
+	// unaligned 32-bit instruction.
+	uint fetch_stall = 0;
+	while (fetch_hwords < size_hwords) {
+		fetch_hwords += 2;
+		++fetch_stall;
+		if (prev_redirect)
+			++stall_fetch_align;
+		else
+			++stall_bus_arb;
+	}
+	fetch_hwords -= size_hwords;
+
+	uint exec_cycles = 1;
+	uint data_cycles = 0;
+	bool redirect = false;
+	events = 0;
+
+	bool load_use = load_rd && (stage2_reads(instr) & (1u << load_rd));
+	bool excl_stall = prev_excl && (is_excl(instr) || is_amo(instr));
+	if (load_use || excl_stall) {
+		++exec_cycles;
+		if (load_use) {
+			++stall_load_use;
+			events |= 1u << HPM_EVENT_LOAD_USE;
+		} else {
+			++stall_excl;
+		}
+	}
+
+	if (is_32bit) {
+		if (opc == RVCore::OPC_LOAD || opc == RVCore::OPC_STORE || is_excl(instr)) {
+			data_cycles = 1;
+		} else if (is_amo(instr)) {
+			// Paired exclusive read/write, 2 cycles per access
+			data_cycles = 2;
+			exec_cycles += 3;
+			stall_amo += 3;
+		} else if (opc == RVCore::OPC_JAL || opc == RVCore::OPC_JALR || RVOPC_MATCH(instr, MRET)) {
+			redirect = true;
+			++exec_cycles;
+			++stall_jump;
+		} else if (opc == RVCore::OPC_OP && GETBITS(instr, 31, 25) == 0x01 && GETBIT(instr, 14)) {
+			// div/divu/rem/remu. Signed variants take an extra cycle when
+			// the result needs sign correction.
+			uint funct3 = GETBITS(instr, 14, 12);
+			sx_t rs1 = regs[GETBITS(instr, 19, 15)];
+			sx_t rs2 = regs[GETBITS(instr, 24, 20)];
+			bool sign_correct =
+				(funct3 == 0x4 && (rs1 ^ rs2) < 0) ||
+				(funct3 == 0x6 && rs1 < 0);
+			uint extra = sign_correct ? 18 : 17;
+			exec_cycles += extra;
+			stall_muldiv += extra;
+		}
+	} else {
+		if (RVOPC_MATCH(instr, C_LW) || RVOPC_MATCH(instr, C_SW) || RVOPC_MATCH(instr, C_LWSP) ||
+				RVOPC_MATCH(instr, C_SWSP) || (instr & 0xe003u) == 0x8000u) {
+			// (Last case is all of the Zcb loads/stores)
+			data_cycles = 1;
+		} else if (RVOPC_MATCH(instr, C_J) || RVOPC_MATCH(instr, C_JAL) ||
+				((RVOPC_MATCH(instr, C_MV) || RVOPC_MATCH(instr, C_ADD)) &&
+				GETBITS(instr, 6, 2) == 0 && GETBITS(instr, 11, 7) != 0)) {
+			// c.j, c.jal, c.jr, c.jalr
+			redirect = true;
+			++exec_cycles;
+			++stall_jump;
+		} else if (RVOPC_MATCH(instr, CM_PUSH) || RVOPC_MATCH(instr, CM_POP) ||
+				RVOPC_MATCH(instr, CM_POPRET) || RVOPC_MATCH(instr, CM_POPRETZ)) {
+			uint n = zcmp_n_regs(instr);
+			uint total = n + 1;
+			if (RVOPC_MATCH(instr, CM_POPRET)) {
+				total = n == 1 ? 4 : n + 2;
+				redirect = true;
+			} else if (RVOPC_MATCH(instr, CM_POPRETZ)) {
+				total = n == 1 ? 5 : n + 3;
+				redirect = true;
+			}
+			data_cycles = n;
+			stall_zcmp += total - 1;
+			exec_cycles += total - 1;
+		} else if (RVOPC_MATCH(instr, CM_MVSA01) || RVOPC_MATCH(instr, CM_MVA01S)) {
+			++exec_cycles;
+			++stall_zcmp;
+		}
+	}
+
+	if ((is_32bit && opc == RVCore::OPC_BRANCH) || RVOPC_MATCH(instr, C_BEQZ) || RVOPC_MATCH(instr, C_BNEZ)) {
+		// The frontend remembers the last taken backward branch, and predicts
+		// it taken the next time it is seen. Everything else is predicted
+		// nontaken. Correctly-predicted taken branches are stitched together
+		// by the frontend, so have no refetch.
+		bool predict_taken = bp_valid && bp_pc == pc;
+		bool taken = next_pc != seq_pc;
+		++branches;
+		if (predict_taken != taken) {
+			redirect = true;
+			++exec_cycles;
+			++stall_mispredict;
+			++mispredicts;
+			events |= 1u << HPM_EVENT_MISPREDICT;
+		}
+		if (taken && next_pc < pc) {
+			bp_valid = true;
+			bp_pc = pc;
+		} else if (predict_taken && !taken) {
+			bp_valid = false;
+		}
+	}
+
+	// Fetch gets every cycle on a dedicated port, but only the cycles without
+	// a data access on a shared port.
+	data_bus_cycles += data_cycles;
+	uint fetch_slots = bus_ports == PORTS_1 ? exec_cycles - data_cycles : exec_cycles;
+	if (redirect) {
+		fetch_hwords = next_pc & 0x2u ? 1 : 2;
+	} else {
+		fetch_hwords += 2 * fetch_slots;
+		if (fetch_hwords > BUFFER_HWORDS)
+			fetch_hwords = BUFFER_HWORDS;
+	}
+	prev_redirect = redirect;
+
+	load_rd = get_load_rd(instr);
+	prev_excl = is_excl(instr);
+
+	uint total = fetch_stall + exec_cycles;
+	++instrs;
+	cycles += total;
+	return total;
+}
+
+uint RVTiming::trap() {
+	// Trap vectors are always word-aligned
+	fetch_hwords = 2;
+	prev_redirect = true;
+	load_rd = 0;
+	prev_excl = false;
+	stall_trap += TRAP_ENTRY_CYCLES;
+	cycles += TRAP_ENTRY_CYCLES;
+	return TRAP_ENTRY_CYCLES;
+}
+
+uint RVTiming::wfi() {
+	++stall_wfi;
+	++cycles;
+	return 1;
+}
+
+void RVTiming::serialise(RVSnapshotIO &io) {
+	io.field(load_rd);
+	io.field(prev_excl);
+	io.field(prev_redirect);
+	io.field(bp_valid);
+	io.field(bp_pc);
+	io.field(fetch_hwords);
+}
+
+void RVTiming::print_summary(FILE *f) {
+	double c = cycles ? (double)cycles : 1.0;
+	fprintf(f, "Timing model summary (%s):\n", bus_ports == PORTS_1 ? "1-port bus" : "2-port bus");
+	fprintf(f, "  Instructions:          %12" PRIu64 "\n", instrs);
+	fprintf(f, "  Cycles:                %12" PRIu64 "  (CPI %.3f)\n", cycles,
+		instrs ? (double)cycles / instrs : 0.0);
+	fprintf(f, "  Load-use stalls:       %12" PRIu64 "  (%5.2f%%)\n", stall_load_use,    100.0 * stall_load_use    / c);
+	fprintf(f, "  Exclusive stalls:      %12" PRIu64 "  (%5.2f%%)\n", stall_excl,        100.0 * stall_excl        / c);
+	fprintf(f, "  Mispredict cycles:     %12" PRIu64 "  (%5.2f%%)\n", stall_mispredict,  100.0 * stall_mispredict  / c);
+	fprintf(f, "  Jump cycles:           %12" PRIu64 "  (%5.2f%%)\n", stall_jump,        100.0 * stall_jump        / c);
+	fprintf(f, "  Divide cycles:         %12" PRIu64 "  (%5.2f%%)\n", stall_muldiv,      100.0 * stall_muldiv      / c);
+	fprintf(f, "  AMO cycles:            %12" PRIu64 "  (%5.2f%%)\n", stall_amo,         100.0 * stall_amo         / c);
+	fprintf(f, "  Zcmp cycles:           %12" PRIu64 "  (%5.2f%%)\n", stall_zcmp,        100.0 * stall_zcmp        / c);
+	fprintf(f, "  Trap entry cycles:     %12" PRIu64 "  (%5.2f%%)\n", stall_trap,        100.0 * stall_trap        / c);
+	fprintf(f, "  Sleep cycles:          %12" PRIu64 "  (%5.2f%%)\n", stall_wfi,         100.0 * stall_wfi         / c);
+	fprintf(f, "  Unaligned fetch:       %12" PRIu64 "  (%5.2f%%)\n", stall_fetch_align, 100.0 * stall_fetch_align / c);
+	fprintf(f, "  Bus arbitration:       %12" PRIu64 "  (%5.2f%%)\n", stall_bus_arb,     100.0 * stall_bus_arb     / c);
+	fprintf(f, "  Data bus cycles:       %12" PRIu64 "  (%5.2f%%)\n", data_bus_cycles,   100.0 * data_bus_cycles   / c);
+	fprintf(f, "  Branches:              %12" PRIu64 "  (%" PRIu64 " mispredicted)\n", branches, mispredicts);
+}
@@ -0,0 +1,218 @@
+#include "rv_trace.h"
+#include "rv_isa.h"
+#include "encoding/rv_opcodes.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const char trace_magic[8] = {'R', 'V', 'T', 'R', 'A', 'C', 'E', 1};
+
+void rv_trace_print(FILE *f, const RVTraceRecord &r, const char *annotation) {
+	if (!r.irq) {
+		fprintf(f, "%08x: ", r.pc);
+		if ((r.instr & 0x3) == 0x3) {
+			fprintf(f, "%08x : ", r.instr);
+		} else {
+			fprintf(f, "    %04x : ", r.instr & 0xffffu);
+		}
+		if (r.rd) {
+			fprintf(f, "%-3s   <- %08x :", friendly_reg_names[*r.rd], r.rd_wdata);
+		} else if (r.pc_wdata) {
+			fprintf(f, "pc    <- %08x <", *r.pc_wdata);
+		} else {
+			fprintf(f, "                  :");
+		}
+		if (annotation)
+			fprintf(f, "  %s", annotation);
+		fprintf(f, "\n");
+		if (r.pc_wdata && r.rd) {
+			fprintf(f, "                   : pc    <- %08x <\n", *r.pc_wdata);
+		}
+		if (r.csr_addr) {
+			fprintf(f, "                   : #%03x  <- %08x :\n", *r.csr_addr, r.csr_value);
+		}
+	}
+	if (r.trap_cause) {
+		if (r.irq)
+			fprintf(f, "^^^ IRQ            : cause <- IRQ + %-2u :\n", *r.trap_cause);
+		else
+			fprintf(f, "^^^ Trap           : cause <- %-2u       :\n", *r.trap_cause);
+		fprintf(f, "|||                : pc    <- %08x <\n", r.trap_target);
+	}
+	if (r.priv) {
+		fprintf(f, "|||                : priv  <- %c        :\n", "US.M"[*r.priv & 0x3]);
+	}
+}
+
+void RVTracePrinter::print(FILE *f, const RVTraceRecord &r) {
+	if (!symbols.empty() && !r.irq) {
+		const RVSymbolTable::Symbol *sym = symbols.lookup(r.pc);
+		if (first || sym != prev_sym)
+			fprintf(f, "%s:\n", symbols.format_addr(r.pc).c_str());
+		prev_sym = sym;
+		first = false;
+	}
+	if (disasm && !r.irq)
+		rv_trace_print(f, r, rv_disasm(r.instr, r.pc, &symbols).c_str());
+	else
+		rv_trace_print(f, r);
+}
+
+RVTraceWriter::RVTraceWriter(FILE *f_) {
+	f = f_;
+	buf.resize(BUF_SIZE);
+	used = 0;
+	expected_pc = 0;
+	first = true;
+	records = 0;
+	if (f)
+		fwrite(trace_magic, sizeof(trace_magic), 1, f);
+}
+
+RVTraceWriter::~RVTraceWriter() {
+	flush();
+}
+
+void RVTraceWriter::flush() {
+	if (f && used)
+		fwrite(buf.data(), used, 1, f);
+	used = 0;
+}
+
+void RVTraceWriter::write(const RVTraceRecord &r) {
+	// Worst case record size is well under 64 bytes
+	if (used + 64 > BUF_SIZE)
+		flush();
+
+	int32_t pc_delta = r.pc - expected_pc;
+	uint16_t flags = 0;
+	if (first || pc_delta != (int16_t)pc_delta)
+		flags |= TRACE_F_PC_ABS;
+	if (r.rd)
+		flags |= TRACE_F_GPR;
+	int32_t wb_delta = 0;
+	if (r.pc_wdata) {
+		wb_delta = *r.pc_wdata - r.pc;
+		flags |= wb_delta == (int16_t)wb_delta ? TRACE_F_PC_WB16 : TRACE_F_PC_WB32;
+	}
+	if (r.csr_addr)
+		flags |= TRACE_F_CSR;
+	if (r.trap_cause)
+		flags |= r.irq ? TRACE_F_IRQ : TRACE_F_EXCEPT;
+	if (r.priv)
+		flags |= TRACE_F_PRIV;
+
+	put<uint32_t>(r.instr);
+	put<uint16_t>(flags);
+	put<int16_t>(flags & TRACE_F_PC_ABS ? 0 : pc_delta);
+	if (flags & TRACE_F_PC_ABS)
+		put<uint32_t>(r.pc);
+	if (flags & TRACE_F_GPR) {
+		put<uint8_t>(*r.rd);
+		put<uint32_t>(r.rd_wdata);
+	}
+	if (flags & TRACE_F_PC_WB16)
+		put<int16_t>(wb_delta);
+	if (flags & TRACE_F_PC_WB32)
+		put<uint32_t>(*r.pc_wdata);
+	if (flags & TRACE_F_CSR) {
+		put<uint16_t>(*r.csr_addr);
+		put<uint32_t>(r.csr_value);
+	}
+	if (flags & TRACE_F_EXCEPT) {
+		put<uint8_t>(*r.trap_cause);
+		put<uint32_t>(r.trap_target);
+	}
+	if (flags & TRACE_F_IRQ) {
+		put<uint16_t>(*r.trap_cause);
+		put<uint32_t>(r.trap_target);
+	}
+	if (flags & TRACE_F_PRIV)
+		put<uint8_t>(*r.priv);
+
+	expected_pc = r.next_pc();
+	first = false;
+	++records;
+}
+
+bool RVTraceReader::get(void *data, size_t size) {
+	uint8_t *out = (uint8_t*)data;
+	while (size) {
+		if (pos == fill) {
+			fill = fread(buf.data(), 1, buf.size(), f);
+			pos = 0;
+			if (!fill)
+				return false;
+		}
+		size_t n = std::min(size, fill - pos);
+		memcpy(out, &buf[pos], n);
+		pos += n;
+		out += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool RVTraceReader::read_header() {
+	char magic[sizeof(trace_magic)];
+	return get(magic, sizeof(magic)) && memcmp(magic, trace_magic, sizeof(magic)) == 0;
+}
+
+bool RVTraceReader::read(RVTraceRecord &r) {
+	uint16_t flags;
+	int16_t pc_delta;
+	r = {};
+	if (!get(r.instr) || !get(flags) || !get(pc_delta))
+		return false;
+	r.pc = expected_pc + pc_delta;
+	if (flags & TRACE_F_PC_ABS) {
+		if (!get(r.pc))
+			return false;
+	}
+	if (flags & TRACE_F_GPR) {
+		uint8_t rd;
+		if (!get(rd) || !get(r.rd_wdata))
+			return false;
+		r.rd = rd;
+	}
+	if (flags & TRACE_F_PC_WB16) {
+		int16_t delta;
+		if (!get(delta))
+			return false;
+		r.pc_wdata = r.pc + delta;
+	}
+	if (flags & TRACE_F_PC_WB32) {
+		ux_t target;
+		if (!get(target))
+			return false;
+		r.pc_wdata = target;
+	}
+	if (flags & TRACE_F_CSR) {
+		uint16_t addr;
+		if (!get(addr) || !get(r.csr_value))
+			return false;
+		r.csr_addr = addr;
+	}
+	if (flags & TRACE_F_EXCEPT) {
+		uint8_t cause;
+		if (!get(cause) || !get(r.trap_target))
+			return false;
+		r.trap_cause = cause;
+	}
+	if (flags & TRACE_F_IRQ) {
+		uint16_t cause;
+		if (!get(cause) || !get(r.trap_target))
+			return false;
+		r.trap_cause = cause;
+		r.irq = true;
+	}
+	if (flags & TRACE_F_PRIV) {
+		uint8_t priv;
+		if (!get(priv))
+			return false;
+		r.priv = priv;
+	}
+	expected_pc = r.next_pc();
+	first = false;
+	return true;
+}
@@ -0,0 +1,73 @@
+#include "rv_watch.h"
+
+#include <algorithm>
+#include <cstdio>
+
+void RVWatchpoints::add(ux_t addr, uint64_t size, uint type, std::optional<ux_t> value) {
+	list.push_back({addr, addr + size, type, value});
+	index(list.size() - 1);
+}
+
+bool RVWatchpoints::remove(ux_t addr, uint64_t size, uint type, std::optional<ux_t> value) {
+	for (auto it = list.begin(); it != list.end(); ++it) {
+		if (it->lo == addr && it->hi == addr + size && it->type == type && it->value == value) {
+			list.erase(it);
+			// Rare, so just rebuild the page bitmaps and index
+			std::vector<Watchpoint> remaining;
+			remaining.swap(list);
+			clear();
+			for (const Watchpoint &w : remaining) {
+				list.push_back(w);
+				index(list.size() - 1);
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void RVWatchpoints::clear() {
+	list.clear();
+	std::fill(read_pages.begin(), read_pages.end(), 0);
+	std::fill(write_pages.begin(), write_pages.end(), 0);
+	page_index.clear();
+}
+
+void RVWatchpoints::index(uint i) {
+	const Watchpoint &w = list[i];
+	if (w.hi <= w.lo)
+		return;
+	ux_t first = w.lo >> PAGE_SHIFT;
+	ux_t last = (w.hi - 1) >> PAGE_SHIFT;
+	for (uint64_t page = first; page <= last; ++page) {
+		if (w.type & READ)
+			read_pages[page / 64] |= 1ull << (page % 64);
+		if (w.type & WRITE)
+			write_pages[page / 64] |= 1ull << (page % 64);
+		page_index[page].push_back(i);
+	}
+}
+
+void RVWatchpoints::check(ux_t addr, uint size, uint access, ux_t data) {
+	if (hit)
+		return;
+	ux_t mask = size >= 4 ? 0xffffffffu : (1u << 8 * size) - 1;
+	for (uint i : page_index[addr >> PAGE_SHIFT]) {
+		const Watchpoint &w = list[i];
+		if (!(w.type & access) || addr >= w.hi || addr + size <= w.lo)
+			continue;
+		if (w.value && (*w.value & mask) != (data & mask))
+			continue;
+		hit = Hit{std::max(addr, w.lo), size, access, data & mask, w.type};
+		return;
+	}
+}
+
+std::string RVWatchpoints::format_hit() const {
+	if (!hit)
+		return "";
+	char buf[96];
+	snprintf(buf, sizeof(buf), "%u-byte %s %08x at %08x", hit->size,
+		hit->access == WRITE ? "write of" : "read of", hit->data, hit->addr);
+	return buf;
+}
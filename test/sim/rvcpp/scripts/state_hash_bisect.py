@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+
+import argparse
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+
+# Find the first instruction where two simulations diverge, by comparing the
+# --state-hash checkpoints printed by rvcpp and/or tb_cxxrtl. The simulations
+# are rerun with a finer checkpoint interval, restricted to the window between
+# the last matching checkpoint and the first mismatching one, until the
+# interval is one instruction.
+#
+# Each command is a full simulator command line (e.g. "rvcpp --bin x.bin
+# --cycles 1000000"): the --state-hash options are appended by this script.
+# The simulations must be deterministic, since they are run several times.
+
+parser = argparse.ArgumentParser()
+parser.add_argument("a", help="First simulator command line")
+parser.add_argument("b", help="Second simulator command line")
+parser.add_argument("-i", "--interval", type=int, default=100000, help="Initial checkpoint interval in instructions (default 100000)")
+parser.add_argument("-f", "--factor", type=int, default=16, help="Divide the interval by this much on each pass (default 16)")
+args = parser.parse_args()
+
+if args.interval < 1 or args.factor < 2:
+	sys.exit("Interval must be at least 1, and factor at least 2")
+
+def run_both(interval, start, end):
+	# Run both commands in parallel, and return a list of checkpoints from
+	# each, as {instret: (pc, hash)}
+	procs = []
+	outs = []
+	for cmd in (args.a, args.b):
+		fd, path = tempfile.mkstemp(suffix=".txt")
+		os.close(fd)
+		outs.append(path)
+		hash_args = ["--state-hash", str(interval), "--state-hash-out", path]
+		hash_args += ["--state-hash-range", "{}:{}".format(start, "" if end is None else end)]
+		procs.append(subprocess.Popen(shlex.split(cmd) + hash_args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL))
+	results = []
+	for p, path in zip(procs, outs):
+		p.wait()
+		checkpoints = {}
+		for l in open(path).readlines():
+			fields = l.split()
+			if len(fields) == 3:
+				checkpoints[int(fields[0])] = (int(fields[1], 16), fields[2])
+		os.remove(path)
+		results.append(checkpoints)
+	return results
+
+interval = args.interval
+# Last instruction count known to match, and first known to mismatch
+good = 0
+bad = None
+while True:
+	print("Comparing every {} instructions from {} to {}".format(
+		interval, good + 1, "end" if bad is None else bad), file=sys.stderr)
+	a, b = run_both(interval, good + 1, bad)
+	mismatch = None
+	for n in sorted(set(a) | set(b)):
+		if a.get(n) != b.get(n):
+			mismatch = n
+			break
+		good = n
+	if mismatch is None and bad is None:
+		print("No divergence found ({} checkpoints)".format(len(a)))
+		sys.exit(0)
+	if mismatch is not None:
+		bad = mismatch
+	if interval == 1:
+		break
+	interval = max(1, interval // args.factor)
+
+def fmt_pc(checkpoints):
+	return "{:08x}".format(checkpoints[bad][0]) if bad in checkpoints else "(not reached)"
+
+print("First divergence at instruction {}".format(bad))
+print("  a: pc {}".format(fmt_pc(a)))
+print("  b: pc {}".format(fmt_pc(b)))
+if bad in a and bad in b and a[bad][0] == b[bad][0]:
+	print("PCs match, so the register write of instruction {} differs".format(bad - 1))
+sys.exit(1)
@@ -0,0 +1,87 @@
+#include "tb_cxxrtl_io.h"
+#include "hazard3_csr.h"
+
+// Arm an execute trigger with action=0 (break to M-mode), and check that it
+// only fires when tcontrol.mte is set, that it raises a breakpoint exception
+// with mepc at the trigger address, and that tcontrol.mte/mpte are stacked on
+// trap entry and restored by mret.
+//
+// Also runs on rvcpp (./runtests trigger_m_mode --tb ../rvcpp/rvcpp), which
+// models the same triggers.
+
+/*EXPECTED-OUTPUT***************************************************************
+
+Trigger CSRs
+tselect = 3
+tinfo = 00000004
+tdata1 = 20000000
+tdata1 = 20000044
+tdata2 offset = 4
+Trigger with mte clear
+Traps: 0
+Trigger with mte set
+tcontrol = 00000008
+mcause = 3
+mepc offset = 4
+tcontrol = 00000080 // mte cleared, old value in mpte
+tdata1 = 20000000   // disarmed by handler
+Traps: 1
+tcontrol = 00000088 // mte restored by mret, mpte unchanged
+
+*******************************************************************************/
+
+// type=2 (address/data match), m=1, execute=1, action=0
+#define TDATA1_EXECUTE_M 0x20000044u
+
+#define TCONTROL_MTE  0x08u
+#define TCONTROL_MPTE 0x80u
+
+// Naked so that the trigger address is a known offset from the start. The
+// trigger is on the ret.
+void __attribute__((naked)) target() {
+	asm volatile (
+		"c.nop\n"
+		"c.nop\n"
+		"ret\n"
+	);
+}
+
+volatile int trap_count;
+
+int main() {
+	tb_puts("Trigger CSRs\n");
+	// tselect is WARL, and there are 4 triggers
+	write_csr(tselect, 0xffffffffu);
+	tb_printf("tselect = %u\n", read_csr(tselect));
+	write_csr(tselect, 0);
+	tb_printf("tinfo = %08x\n", read_csr(tinfo));
+	tb_printf("tdata1 = %08x\n", read_csr(tdata1));
+	write_csr(tdata2, (uintptr_t)&target + 4);
+	write_csr(tdata1, TDATA1_EXECUTE_M);
+	tb_printf("tdata1 = %08x\n", read_csr(tdata1));
+	tb_printf("tdata2 offset = %u\n", read_csr(tdata2) - (uintptr_t)&target);
+
+	tb_puts("Trigger with mte clear\n");
+	write_csr(tcontrol, 0);
+	target();
+	tb_printf("Traps: %d\n", trap_count);
+
+	tb_puts("Trigger with mte set\n");
+	write_csr(tcontrol, TCONTROL_MTE);
+	tb_printf("tcontrol = %08x\n", read_csr(tcontrol));
+	target();
+	tb_printf("Traps: %d\n", trap_count);
+	tb_printf("tcontrol = %08x\n", read_csr(tcontrol));
+
+	return 0;
+}
+
+void __attribute__((interrupt)) handle_exception() {
+	tb_printf("mcause = %u\n", read_csr(mcause));
+	tb_printf("mepc offset = %u\n", read_csr(mepc) - (uintptr_t)&target);
+	tb_printf("tcontrol = %08x\n", read_csr(tcontrol));
+	// Disarm, else the trigger fires again once mret restores mte
+	write_csr(tdata1, 0);
+	tb_printf("tdata1 = %08x\n", read_csr(tdata1));
+	++trap_count;
+}
@@ -0,0 +1,69 @@
+#include "tb_cxxrtl_io.h"
+
+// Run each Zcmp instruction type with the full register list, in ordinary
+// ABI-conforming functions. The results are checked here, but the main use
+// is comparing the --state-hash output of tb_cxxrtl against rvcpp:
+//
+//   ./runtests zcmp_state_hash --state-hash-ref ../rvcpp/rvcpp
+//
+// Zcmp instructions write several GPRs in one instruction (one per uop), so
+// this checks both simulators hash those writes in the same order.
+
+/*EXPECTED-OUTPUT***************************************************************
+
+mix(5, 3):
+00000012
+mix(0x12345678, 0x0f0f0f0f):
+43a98875
+zero():
+00000000
+
+*******************************************************************************/
+
+uint32_t zcmp_mix(uint32_t a, uint32_t b);
+uint32_t zcmp_zero(void);
+
+asm (
+".global zcmp_mix\n"
+"zcmp_mix:\n"
+	".hword 0xb8f2\n"     // cm.push {ra, s0-s11}, -64
+	".hword 0xac26\n"     // cm.mvsa01 s0, s1
+	"add s2, s0, s1\n"
+	"sub s3, s0, s1\n"
+	"li s4, 0xa5000000 + 20\n"
+	"li s5, 0xa5000000 + 21\n"
+	"li s6, 0xa5000000 + 22\n"
+	"li s7, 0xa5000000 + 23\n"
+	"li s8, 0xa5000000 + 24\n"
+	"li s9, 0xa5000000 + 25\n"
+	"li s10, 0xa5000000 + 26\n"
+	"li s11, 0xa5000000 + 27\n"
+	".hword 0xad6e\n"     // cm.mva01s s2, s3
+	// Push and pop again, with the registers clobbered in between
+	".hword 0xb8f2\n"     // cm.push {ra, s0-s11}, -64
+	"li s0, 0\n"
+	"li s1, 0\n"
+	"li s2, 0\n"
+	"li s3, 0\n"
+	".hword 0xbaf2\n"     // cm.pop {ra, s0-s11}, 64
+	"xor a0, a0, a1\n"
+	"add a0, a0, s2\n"
+	".hword 0xbef2\n"     // cm.popret {ra, s0-s11}, 64
+"\n"
+".global zcmp_zero\n"
+"zcmp_zero:\n"
+	".hword 0xb8f2\n"     // cm.push {ra, s0-s11}, -64
+	"li a0, 123\n"
+	"li s0, 456\n"
+	".hword 0xbcf2\n"     // cm.popretz {ra, s0-s11}, 64
+);
+
+int main() {
+	tb_puts("mix(5, 3):\n");
+	tb_put_u32(zcmp_mix(5, 3));
+	tb_puts("mix(0x12345678, 0x0f0f0f0f):\n");
+	tb_put_u32(zcmp_mix(0x12345678, 0x0f0f0f0f));
+	tb_puts("zero():\n");
+	tb_put_u32(zcmp_zero());
+	return 0;
+}
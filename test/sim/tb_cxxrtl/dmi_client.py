@@ -0,0 +1,288 @@
+#!/usr/bin/env python3
+
+import argparse
+import socket
+import struct
+import sys
+
+# Client for the direct DMI socket of tb_cxxrtl (tb --dmi-port n), which
+# reads and writes Debug Module registers without going through the
+# JTAG-DTM. Use this in place of OpenOCD remote bitbang for scripted debug
+# tests and for loading programs.
+#
+# Accesses are batched: queue up reads, writes and idle cycles, then run()
+# sends them in one go and returns the read data. The testbench runs the
+# whole batch before replying, so a batch costs one round trip however many
+# accesses it holds.
+#
+# As a script, this can halt, resume or reset the hart, read or write DM
+# registers, or load a flat binary through System Bus Access, e.g.:
+#
+#   ./tb --dmi-port 9825 &
+#   ./dmi_client.py load hello.bin --resume
+
+DM_DATA0        = 0x04
+DM_DMCONTROL    = 0x10
+DM_DMSTATUS     = 0x11
+DM_ABSTRACTCS   = 0x16
+DM_COMMAND      = 0x17
+DM_PROGBUF0     = 0x20
+DM_PROGBUF1     = 0x21
+DM_SBCS         = 0x38
+DM_SBADDRESS0   = 0x39
+DM_SBDATA0      = 0x3c
+
+DMCONTROL_DMACTIVE        = 1 << 0
+DMCONTROL_NDMRESET        = 1 << 1
+DMCONTROL_CLRRESETHALTREQ = 1 << 2
+DMCONTROL_SETRESETHALTREQ = 1 << 3
+DMCONTROL_RESUMEREQ       = 1 << 30
+DMCONTROL_HALTREQ         = 1 << 31
+
+DMSTATUS_ALLHALTED    = 1 << 9
+DMSTATUS_ALLRESUMEACK = 1 << 17
+
+SBCS_SBERROR         = 7 << 12
+SBCS_SBREADONDATA    = 1 << 15
+SBCS_SBAUTOINCREMENT = 1 << 16
+SBCS_SBACCESS_32     = 2 << 17
+SBCS_SBREADONADDR    = 1 << 20
+SBCS_SBBUSYERROR     = 1 << 22
+
+INSTR_EBREAK = 0x00100073
+
+# Responses would back up in the socket if a batch were much larger than
+# this, since the client sends the whole batch before reading any of them.
+MAX_BATCH = 4096
+
+class DMIError(Exception):
+	pass
+
+class Batch:
+	def __init__(self, dmi):
+		self.dmi = dmi
+		self.cmds = []
+
+	def read(self, reg):
+		self.cmds.append(struct.pack("<cB", b"r", reg))
+		return self
+
+	def write(self, reg, data):
+		self.cmds.append(struct.pack("<cBI", b"w", reg, data & 0xffffffff))
+		return self
+
+	def idle(self, cycles):
+		self.cmds.append(struct.pack("<cI", b"i", cycles))
+		return self
+
+	def run(self):
+		# Returns a list with one entry per command: the read data for reads,
+		# and 0 for writes and idles.
+		results = []
+		for i in range(0, len(self.cmds), MAX_BATCH):
+			results += self.dmi._transfer(self.cmds[i:i + MAX_BATCH])
+		self.cmds = []
+		return results
+
+class DMI:
+	def __init__(self, host="localhost", port=9825):
+		self.sock = socket.create_connection((host, port))
+		self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+	def close(self):
+		self.sock.close()
+
+	def _transfer(self, cmds):
+		self.sock.sendall(b"".join(cmds))
+		resp = b""
+		while len(resp) < 5 * len(cmds):
+			chunk = self.sock.recv(5 * len(cmds) - len(resp))
+			if not chunk:
+				raise DMIError("Testbench closed the DMI socket")
+			resp += chunk
+		results = []
+		for i, cmd in enumerate(cmds):
+			err, data = struct.unpack_from("<BI", resp, 5 * i)
+			if err:
+				raise DMIError("DMI access to register 0x{:02x} returned an error".format(cmd[1]))
+			results.append(data)
+		return results
+
+	def batch(self):
+		return Batch(self)
+
+	def read(self, reg):
+		return self.batch().read(reg).run()[0]
+
+	def write(self, reg, data):
+		self.batch().write(reg, data).run()
+
+	def idle(self, cycles):
+		self.batch().idle(cycles).run()
+
+	def quit(self):
+		# Ends the simulation. There is no response.
+		self.sock.sendall(b"q")
+		self.close()
+
+	def poll(self, reg, mask, value, limit=1000):
+		for i in range(limit):
+			rdata = self.read(reg)
+			if rdata & mask == value:
+				return rdata
+		raise DMIError("Gave up polling register 0x{:02x} (last read {:08x})".format(reg, rdata))
+
+	# Run control
+
+	def halt(self):
+		self.batch() \
+			.write(DM_DMCONTROL, DMCONTROL_DMACTIVE) \
+			.write(DM_DMCONTROL, DMCONTROL_DMACTIVE | DMCONTROL_HALTREQ) \
+			.run()
+		self.poll(DM_DMSTATUS, DMSTATUS_ALLHALTED, DMSTATUS_ALLHALTED)
+		self.write(DM_DMCONTROL, DMCONTROL_DMACTIVE)
+
+	def resume(self):
+		self.write(DM_DMCONTROL, DMCONTROL_DMACTIVE | DMCONTROL_RESUMEREQ)
+		self.poll(DM_DMSTATUS, DMSTATUS_ALLRESUMEACK, DMSTATUS_ALLRESUMEACK)
+		self.write(DM_DMCONTROL, DMCONTROL_DMACTIVE)
+
+	def reset_halt(self):
+		# Reset everything but the DM, with resethaltreq set so that the hart
+		# halts before running any instructions
+		self.batch() \
+			.write(DM_DMCONTROL, DMCONTROL_DMACTIVE | DMCONTROL_SETRESETHALTREQ) \
+			.write(DM_DMCONTROL, DMCONTROL_DMACTIVE | DMCONTROL_NDMRESET) \
+			.idle(16) \
+			.write(DM_DMCONTROL, DMCONTROL_DMACTIVE) \
+			.run()
+		self.poll(DM_DMSTATUS, DMSTATUS_ALLHALTED, DMSTATUS_ALLHALTED)
+		self.write(DM_DMCONTROL, DMCONTROL_DMACTIVE | DMCONTROL_CLRRESETHALTREQ)
+
+	# Register access, hart must be halted
+
+	def _check_abstract_cmd(self, what):
+		abstractcs = self.poll(DM_ABSTRACTCS, 1 << 12, 0)
+		cmderr = abstractcs >> 8 & 0x7
+		if cmderr:
+			self.write(DM_ABSTRACTCS, 0x700)
+			raise DMIError("Abstract command failed for {} (cmderr {})".format(what, cmderr))
+
+	def read_gpr(self, reg):
+		self.write(DM_COMMAND, 0x00220000 | 0x1000 + reg)
+		self._check_abstract_cmd("x{}".format(reg))
+		return self.read(DM_DATA0)
+
+	def write_gpr(self, reg, data):
+		self.batch().write(DM_DATA0, data).write(DM_COMMAND, 0x00230000 | 0x1000 + reg).run()
+		self._check_abstract_cmd("x{}".format(reg))
+
+	def write_csr(self, csr, data):
+		# Through the program buffer, with s0 as scratch
+		s0 = self.read_gpr(8)
+		self.batch() \
+			.write(DM_PROGBUF0, csr << 20 | 8 << 15 | 0x1 << 12 | 0x73) \
+			.write(DM_PROGBUF1, INSTR_EBREAK) \
+			.write(DM_DATA0, data) \
+			.write(DM_COMMAND, 0x00270000 | 0x1008) \
+			.run()
+		self._check_abstract_cmd("CSR 0x{:03x}".format(csr))
+		self.write_gpr(8, s0)
+
+	def set_pc(self, pc):
+		self.write_csr(0x7b1, pc)
+
+	# Memory access through System Bus Access
+
+	def write_mem(self, addr, data, gap=2):
+		# Word writes, with `gap` idle cycles between them for each bus
+		# transfer to finish. Raises if any write was dropped.
+		data = bytes(data) + bytes(-len(data) % 4)
+		b = self.batch() \
+			.write(DM_SBCS, SBCS_SBACCESS_32 | SBCS_SBAUTOINCREMENT | SBCS_SBBUSYERROR | SBCS_SBERROR) \
+			.write(DM_SBADDRESS0, addr)
+		for i in range(0, len(data), 4):
+			b.write(DM_SBDATA0, struct.unpack_from("<I", data, i)[0])
+			b.idle(gap)
+		b.read(DM_SBCS)
+		sbcs = b.run()[-1]
+		if sbcs & (SBCS_SBBUSYERROR | SBCS_SBERROR):
+			self.write(DM_SBCS, SBCS_SBBUSYERROR | SBCS_SBERROR)
+			raise DMIError("System bus write failed (sbcs = {:08x}); try a larger gap".format(sbcs))
+
+	def read_mem(self, addr, size, gap=2):
+		# Each read of sbdata0 starts the next bus read, apart from the last,
+		# so that nothing is read past the end.
+		nwords = (size + 3) // 4
+		sbcs = SBCS_SBACCESS_32 | SBCS_SBAUTOINCREMENT | SBCS_SBBUSYERROR | SBCS_SBERROR
+		b = self.batch() \
+			.write(DM_SBCS, sbcs | SBCS_SBREADONADDR | SBCS_SBREADONDATA) \
+			.write(DM_SBADDRESS0, addr)
+		data_indices = []
+		for i in range(nwords):
+			b.idle(gap)
+			if i == nwords - 1:
+				b.write(DM_SBCS, SBCS_SBACCESS_32 | SBCS_SBAUTOINCREMENT)
+			data_indices.append(len(b.cmds))
+			b.read(DM_SBDATA0)
+		b.read(DM_SBCS)
+		results = b.run()
+		if results[-1] & (SBCS_SBBUSYERROR | SBCS_SBERROR):
+			self.write(DM_SBCS, SBCS_SBBUSYERROR | SBCS_SBERROR)
+			raise DMIError("System bus read failed (sbcs = {:08x}); try a larger gap".format(results[-1]))
+		return b"".join(struct.pack("<I", results[i]) for i in data_indices)[:size]
+
+def anyint(x):
+	return int(x, 0)
+
+if __name__ == "__main__":
+	parser = argparse.ArgumentParser(description="Access the tb_cxxrtl Debug Module through the direct DMI socket")
+	parser.add_argument("--host", default="localhost")
+	parser.add_argument("--port", type=int, default=9825, help="Port passed to tb --dmi-port (default 9825)")
+	parser.add_argument("--quit", action="store_true", help="End the simulation afterward")
+	sub = parser.add_subparsers(dest="cmd", required=True)
+	sub.add_parser("halt")
+	sub.add_parser("resume")
+	sub.add_parser("reset-halt")
+	p = sub.add_parser("read", help="Read a DM register")
+	p.add_argument("reg", type=anyint)
+	p = sub.add_parser("write", help="Write a DM register")
+	p.add_argument("reg", type=anyint)
+	p.add_argument("data", type=anyint)
+	p = sub.add_parser("load", help="Halt, and load a flat binary through System Bus Access")
+	p.add_argument("bin")
+	p.add_argument("--addr", type=anyint, default=0, help="Load address (default 0)")
+	p.add_argument("--pc", type=anyint, help="Resume address (default: the load address)")
+	p.add_argument("--gap", type=int, default=2, help="Idle cycles between bus writes (default 2)")
+	p.add_argument("--verify", action="store_true", help="Read back and compare")
+	p.add_argument("--resume", action="store_true", help="Resume the hart once loaded")
+	args = parser.parse_args()
+
+	dmi = DMI(args.host, args.port)
+	try:
+		if args.cmd == "halt":
+			dmi.halt()
+		elif args.cmd == "resume":
+			dmi.resume()
+		elif args.cmd == "reset-halt":
+			dmi.reset_halt()
+		elif args.cmd == "read":
+			print("{:08x}".format(dmi.read(args.reg)))
+		elif args.cmd == "write":
+			dmi.write(args.reg, args.data)
+		elif args.cmd == "load":
+			data = open(args.bin, "rb").read()
+			dmi.reset_halt()
+			dmi.write_mem(args.addr, data, args.gap)
+			if args.verify and dmi.read_mem(args.addr, len(data), args.gap) != data:
+				sys.exit("Verify failed")
+			dmi.set_pc(args.addr if args.pc is None else args.pc)
+			print("Loaded {} bytes at {:08x}".format(len(data), args.addr), file=sys.stderr)
+			if args.resume:
+				dmi.resume()
+	except DMIError as e:
+		sys.exit(str(e))
+	if args.quit:
+		dmi.quit()
+	else:
+		dmi.close()
@@ -1,11 +1,18 @@
 #include <iostream>
 #include <fstream>
 #include <cstdint>
+#include <cinttypes>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <stdio.h>
 
 #include <unistd.h>
 #include <sys/socket.h>
+#include <poll.h>
 #include <netinet/in.h>
 
 // Device-under-test model generated by CXXRTL:
@@ -81,6 +88,334 @@ struct mem_io_state {
 	}
 };
 
+// Rolling hash of retired instruction PCs and register writes, computed the
+// same way as rvcpp's --state-hash (see rv_state_hash.h) so that the two can
+// be compared checkpoint-by-checkpoint by scripts/state_hash_bisect.py.
+//
+// Sampled once per cycle from the core's internal signals. The writeback
+// from stage M is folded in before the retirement in stage X, because the
+// instruction in M is older.
+
+struct state_hash {
+	static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+	static const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+	uint64_t hash;
+	uint64_t instret;
+	uint64_t interval;
+	uint64_t print_start;
+	uint64_t print_end;
+	FILE *out;
+
+	cxxrtl::debug_item *x_instr_ret;
+	cxxrtl::debug_item *d_pc;
+	cxxrtl::debug_item *m_reg_wen;
+	cxxrtl::debug_item *xm_rd;
+	cxxrtl::debug_item *m_result;
+
+	state_hash() {
+		hash = FNV_OFFSET;
+		instret = 0;
+		interval = 0;
+		print_start = 0;
+		print_end = UINT64_MAX;
+		out = stderr;
+	}
+
+	void mix(uint32_t x) {
+		hash = (hash ^ x) * FNV_PRIME;
+	}
+
+	static uint32_t get(cxxrtl::debug_item *item) {
+		if (item->type == cxxrtl::debug_item::OUTLINE)
+			item->outline->eval();
+		return item->curr[0];
+	}
+
+	// Returns false if a signal is missing from the design's debug info
+	bool bind(cxxrtl::debug_items &items) {
+		struct {cxxrtl::debug_item **item; const char *name;} signals[] = {
+			{&x_instr_ret, "cpu core x_instr_ret"},
+			{&d_pc,        "cpu core d_pc"},
+			{&m_reg_wen,   "cpu core m_reg_wen"},
+			{&xm_rd,       "cpu core xm_rd"},
+			{&m_result,    "cpu core m_result"},
+		};
+		for (auto &sig : signals) {
+			if (!items.table.count(sig.name)) {
+				std::cerr << "Signal \"" << sig.name << "\" not found, --state-hash is unsupported for this testbench\n";
+				return false;
+			}
+			*sig.item = &items.table.at(sig.name)[0];
+		}
+		return true;
+	}
+
+	// Call after the clock's falling edge, when this cycle's combinational
+	// signals have settled
+	void sample() {
+		if (get(m_reg_wen)) {
+			mix(get(xm_rd));
+			mix(get(m_result));
+		}
+		if (get(x_instr_ret)) {
+			uint32_t pc = get(d_pc);
+			mix(pc);
+			++instret;
+			if (instret % interval == 0 && instret >= print_start && instret <= print_end)
+				fprintf(out, "%" PRIu64 " %08x %016" PRIx64 "\n", instret, pc, hash);
+		}
+	}
+};
+
+// Direct access to the Debug Module through the tb_dmi_* port of tb.v,
+// bypassing the JTAG-DTM. Operations are queued and run in order, each one
+// taking an APB setup and access phase (two cycles). A read can either be
+// checked once against an expected value, or polled until it matches.
+// `err` holds pslverr from the most recently completed operation, so is
+// valid inside its `done` callback.
+
+enum {
+	DM_DATA0      = 0x04,
+	DM_DMCONTROL  = 0x10,
+	DM_DMSTATUS   = 0x11,
+	DM_ABSTRACTCS = 0x16,
+	DM_COMMAND    = 0x17,
+	DM_PROGBUF0   = 0x20,
+	DM_PROGBUF1   = 0x21
+};
+
+struct dmi_op {
+	uint32_t reg;
+	bool write;
+	uint32_t wdata;
+	// Reads: if poll, repeat until (rdata & mask) == value
+	bool poll;
+	uint32_t mask;
+	uint32_t value;
+	// Called with the read data when the operation completes
+	std::function<void(uint32_t)> done;
+};
+
+struct dmi_host {
+	static const int POLL_LIMIT = 10000;
+
+	std::deque<dmi_op> queue;
+	enum {IDLE, SETUP, ACCESS} phase;
+	int polls;
+	bool failed;
+	bool err;
+
+	dmi_host() {
+		phase = IDLE;
+		polls = 0;
+		failed = false;
+		err = false;
+	}
+
+	void write(uint32_t reg, uint32_t wdata, std::function<void(uint32_t)> done = nullptr) {
+		queue.push_back({reg, true, wdata, false, 0, 0, done});
+	}
+
+	void poll(uint32_t reg, uint32_t mask, uint32_t value, std::function<void(uint32_t)> done = nullptr) {
+		queue.push_back({reg, false, 0, true, mask, value, done});
+	}
+
+	void read(uint32_t reg, std::function<void(uint32_t)> done) {
+		queue.push_back({reg, false, 0, false, 0, 0, done});
+	}
+
+	bool busy() {
+		return phase != IDLE || !queue.empty();
+	}
+
+	// Call before the clock's rising edge. Completes the current access
+	// phase, if any.
+	void sample(cxxrtl_design::p_tb &tb) {
+		if (phase != ACCESS || !tb.p_tb__dmi__pready.get<bool>())
+			return;
+		phase = IDLE;
+		dmi_op op = queue.front();
+		queue.pop_front();
+		uint32_t rdata = tb.p_tb__dmi__prdata.get<uint32_t>();
+		err = tb.p_tb__dmi__pslverr.get<bool>();
+		if (op.poll && (rdata & op.mask) != op.value) {
+			if (++polls < POLL_LIMIT) {
+				queue.push_front(op);
+				return;
+			}
+			fprintf(stderr, "DMI: gave up polling DM register 0x%02x (last read %08x)\n", op.reg, rdata);
+			failed = true;
+			queue.clear();
+			return;
+		}
+		polls = 0;
+		if (op.done)
+			op.done(rdata);
+	}
+
+	// Call after the clock's rising edge. Drives the next phase.
+	void drive(cxxrtl_design::p_tb &tb) {
+		if (phase == SETUP) {
+			tb.p_tb__dmi__penable.set<bool>(true);
+			phase = ACCESS;
+		}
+		else if (phase == IDLE && !queue.empty()) {
+			const dmi_op &op = queue.front();
+			tb.p_tb__dmi__psel.set<bool>(true);
+			tb.p_tb__dmi__penable.set<bool>(false);
+			tb.p_tb__dmi__pwrite.set<bool>(op.write);
+			tb.p_tb__dmi__paddr.set<uint32_t>(op.reg << 2);
+			tb.p_tb__dmi__pwdata.set<uint32_t>(op.wdata);
+			phase = SETUP;
+		}
+		else if (phase == IDLE) {
+			tb.p_tb__dmi__psel.set<bool>(false);
+			tb.p_tb__dmi__penable.set<bool>(false);
+		}
+	}
+};
+
+// Architectural state saved by rvcpp --save-handoff (see rv_snapshot.h in
+// rvcpp), applied through the Debug Module: halt the hart, load RAM and IO
+// state, write the CSRs through the program buffer, then dpc, dcsr.prv and
+// the GPRs through abstract commands, then resume.
+
+struct handoff_state {
+	uint32_t pc;
+	uint32_t priv;
+	uint32_t x[32];
+	std::vector<std::pair<uint32_t, uint32_t>> csrs;
+	uint64_t mtime;
+	uint64_t mtimecmp;
+	bool softirq;
+	uint32_t irq[4];
+	std::string bin_path;
+
+	handoff_state() {
+		pc = 0;
+		priv = 3;
+		for (int i = 0; i < 32; ++i)
+			x[i] = 0;
+		mtime = 0;
+		mtimecmp = 0;
+		softirq = false;
+		for (int i = 0; i < 4; ++i)
+			irq[i] = 0;
+	}
+
+	// Returns false, with a message on stderr, on failure
+	bool load(const std::string &prefix) {
+		std::string txt_path = prefix + ".txt";
+		bin_path = prefix + ".bin";
+		std::ifstream fd(txt_path);
+		if (!fd) {
+			std::cerr << "Failed to open \"" << txt_path << "\"\n";
+			return false;
+		}
+		std::string line;
+		int line_num = 0;
+		while (std::getline(fd, line)) {
+			++line_num;
+			if (line.empty() || line[0] == '#')
+				continue;
+			std::istringstream fields(line);
+			std::string key;
+			uint32_t n = 0, data = 0;
+			bool ok = false;
+			fields >> key;
+			if (key == "pc") {
+				ok = bool(fields >> std::hex >> pc);
+			}
+			else if (key == "priv") {
+				ok = bool(fields >> priv);
+			}
+			else if (key == "x") {
+				ok = fields >> n >> std::hex >> data && n < 32;
+				if (ok)
+					x[n] = data;
+			}
+			else if (key == "csr") {
+				ok = bool(fields >> std::hex >> n >> data);
+				if (ok)
+					csrs.push_back({n, data});
+			}
+			else if (key == "mtime") {
+				ok = bool(fields >> std::hex >> mtime);
+			}
+			else if (key == "mtimecmp") {
+				ok = bool(fields >> std::hex >> mtimecmp);
+			}
+			else if (key == "softirq") {
+				ok = bool(fields >> n);
+				softirq = n;
+			}
+			else if (key == "irq") {
+				ok = fields >> n >> std::hex >> data && n < 4;
+				if (ok)
+					irq[n] = data;
+			}
+			if (!ok) {
+				std::cerr << txt_path << ":" << line_num << ": can't parse \"" << line << "\"\n";
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+static const uint32_t INSTR_EBREAK = 0x00100073u;
+
+// Abstract command: transfer aarsize=32 bits, write, to GPR `reg`, then
+// optionally execute the program buffer
+static uint32_t abstract_write_gpr(uint32_t reg, bool postexec) {
+	return 0x00230000u | (postexec ? 0x00040000u : 0u) | (0x1000u + reg);
+}
+
+static void queue_check_abstract_cmd(dmi_host &dmi, const char *what, uint32_t arg) {
+	// Wait for abstractcs.busy to clear, then check and clear cmderr
+	dmi.poll(DM_ABSTRACTCS, 0x1000u, 0, [&dmi, what, arg](uint32_t rdata) {
+		if (rdata & 0x700u) {
+			fprintf(stderr, "Handoff: failed to write %s %03x (cmderr %u)\n", what, arg, (rdata >> 8) & 0x7u);
+			dmi.queue.push_front({DM_ABSTRACTCS, true, 0x700u, false, 0, 0, nullptr});
+		}
+	});
+}
+
+// csrw `csr`, s0
+static void queue_write_csr(dmi_host &dmi, uint32_t csr, uint32_t data) {
+	dmi.write(DM_PROGBUF0, csr << 20 | 8u << 15 | 0x1u << 12 | 0x73u);
+	dmi.write(DM_DATA0, data);
+	dmi.write(DM_COMMAND, abstract_write_gpr(8, true));
+	queue_check_abstract_cmd(dmi, "CSR", csr);
+}
+
+// `halted` is called once the hart has halted, before any of its state is
+// written, to load the memory contents. `resuming` is called as the resume
+// request is written, to load the timer and IRQ state: the timer keeps
+// counting during the ~1000 cycles of DMI accesses before that.
+void queue_handoff(dmi_host &dmi, const handoff_state &h, std::function<void(uint32_t)> halted,
+		std::function<void(uint32_t)> resuming) {
+	dmi.write(DM_DMCONTROL, 0x00000001u);
+	dmi.write(DM_DMCONTROL, 0x80000001u);
+	dmi.poll(DM_DMSTATUS, 1u << 9, 1u << 9, halted);
+	dmi.write(DM_DMCONTROL, 0x00000001u);
+	dmi.write(DM_PROGBUF1, INSTR_EBREAK);
+	// s0 is restored with the other GPRs afterward
+	for (auto &csr : h.csrs)
+		queue_write_csr(dmi, csr.first, csr.second);
+	queue_write_csr(dmi, 0x7b1, h.pc);
+	queue_write_csr(dmi, 0x7b0, h.priv);
+	for (uint32_t i = 1; i < 32; ++i) {
+		dmi.write(DM_DATA0, h.x[i]);
+		dmi.write(DM_COMMAND, abstract_write_gpr(i, false));
+		queue_check_abstract_cmd(dmi, "GPR", i);
+	}
+	dmi.write(DM_DMCONTROL, 0x40000001u, resuming);
+	dmi.poll(DM_DMSTATUS, 1u << 17, 1u << 17);
+	dmi.write(DM_DMCONTROL, 0x00000001u);
+}
+
 typedef enum {
 	SIZE_BYTE = 0,
 	SIZE_HWORD = 1,
@@ -254,7 +589,9 @@ bus_response mem_access(cxxrtl_design::p_tb &tb, mem_io_state &memio, bus_reques
 
 const char *help_str =
 "Usage: tb [--bin x.bin] [--port n] [--vcd x.vcd] [--dump start end] \\\n"
-"          [--cycles n] [--cpuret] [--jtagdump x] [--jtagreplay x]\n"
+"          [--cycles n] [--cpuret] [--jtagdump x] [--jtagreplay x] \\\n"
+"          [--state-hash n] [--state-hash-range a:b] [--state-hash-out x] \\\n"
+"          [--load-handoff prefix] [--dmi-port n] [--freerun n]\n"
 "\n"
 "    --bin x.bin      : Flat binary file loaded to address 0x0 in RAM\n"
 "    --vcd x.vcd      : Path to dump waveforms to\n"
@@ -263,12 +600,35 @@ const char *help_str =
 "    --cycles n       : Maximum number of cycles to run before exiting.\n"
 "                       Default is 0 (no maximum).\n"
 "    --port n         : Port number to listen for openocd remote bitbang. Sim\n"
-"                       runs in lockstep with JTAG bitbang, not free-running.\n"
+"                       runs in lockstep with JTAG bitbang, unless --freerun.\n"
+"    --freerun n      : With --port, let the core clock run at full speed\n"
+"                       instead of in lockstep with JTAG. Bitbang commands are\n"
+"                       serviced without blocking, with at most one TCK edge\n"
+"                       every n core clock cycles. The sim doesn't wait for\n"
+"                       OpenOCD to connect, or stop when it quits.\n"
+"    --dmi-port n     : Port number to listen for direct DMI accesses, which\n"
+"                       bypass the JTAG-DTM. Much faster than --port for\n"
+"                       scripted debug and loading. Sim runs in lockstep with\n"
+"                       the socket. See dmi_client.py.\n"
 "    --cpuret         : Testbench's return code is the return code written to\n"
 "                       IO_EXIT by the CPU, or -1 if timed out.\n"
 "    --jtagdump       : Dump OpenOCD JTAG bitbang commands to a file so they\n"
 "                       can be replayed. (Lower perf impact than VCD dumping)\n"
 "    --jtagreplay     : Play back some dumped OpenOCD JTAG bitbang commands\n"
+"    --state-hash n   : Keep a rolling hash of retired instruction PCs and GPR\n"
+"                       writes, and print it every n retired instructions. Same\n"
+"                       format as rvcpp --state-hash.\n"
+"    --state-hash-range a:b\n"
+"                     : Only print --state-hash checkpoints from instruction a\n"
+"                       to instruction b inclusive. Either may be omitted.\n"
+"    --state-hash-out x\n"
+"                     : Write --state-hash checkpoints to x instead of stderr.\n"
+"    --load-handoff prefix\n"
+"                     : Continue a run from the state saved by rvcpp\n"
+"                       --save-handoff (prefix.txt and prefix.bin). The state\n"
+"                       is applied through the Debug Module, after which the\n"
+"                       core resumes. Can't be combined with --bin, --port,\n"
+"                       --dmi-port or --jtagreplay.\n"
 ;
 
 void exit_help(std::string errtext = "") {
@@ -294,6 +654,181 @@ int wait_for_connection(int server_fd, uint16_t port, struct sockaddr *sock_addr
 
 static const int TCP_BUF_SIZE = 256;
 
+int open_server_socket(uint16_t port, struct sockaddr_in *sock_addr) {
+	int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (server_fd < 0) {
+		fprintf(stderr, "socket creation failed\n");
+		exit(-1);
+	}
+
+	int sock_opt = 1;
+	int setsockopt_rc = setsockopt(
+		server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT,
+		&sock_opt, sizeof(sock_opt)
+	);
+
+	if (setsockopt_rc) {
+		fprintf(stderr, "setsockopt failed\n");
+		exit(-1);
+	}
+
+	sock_addr->sin_family = AF_INET;
+	sock_addr->sin_addr.s_addr = INADDR_ANY;
+	sock_addr->sin_port = htons(port);
+	if (bind(server_fd, (struct sockaddr *)sock_addr, sizeof(*sock_addr)) < 0) {
+		fprintf(stderr, "bind failed\n");
+		exit(-1);
+	}
+	return server_fd;
+}
+
+// Direct DMI socket (--dmi-port). The client issues Debug Module register
+// reads and writes straight onto the tb_dmi_* port, instead of shifting
+// them through the JTAG-DTM one TCK edge at a time with remote bitbang. The
+// simulation runs in lockstep with the socket, like --port.
+//
+// Commands are binary, with little-endian fields:
+//
+//   'r' reg            : Read DM register `reg` (DMI address, 0 to 0x7f)
+//   'w' reg data[4]    : Write `data` to DM register `reg`
+//   'i' n[4]           : Let n cycles pass with no DMI access
+//   'q'                : Quit the simulation
+//
+// Every command apart from 'q' gets a 5-byte response, in order: a status
+// byte (0 for OK, 1 if the access returned pslverr), then the read data
+// (zero for writes and idles). Responses are held back until the simulation
+// has run every command received so far, then sent together, so a client
+// should send a batch of commands before waiting for their responses. See
+// dmi_client.py for the client side.
+
+struct dmi_server {
+	int server_fd;
+	int sock_fd;
+	uint16_t port;
+	struct sockaddr_in sock_addr;
+	socklen_t sock_addr_len;
+	std::string rxbuf;
+	size_t rx_ptr;
+	std::string txbuf;
+	uint32_t idle_cycles;
+
+	dmi_server() {
+		server_fd = -1;
+		sock_fd = -1;
+		port = 0;
+		sock_addr_len = sizeof(sock_addr);
+		rx_ptr = 0;
+		idle_cycles = 0;
+	}
+
+	void open(uint16_t port_) {
+		port = port_;
+		server_fd = open_server_socket(port, &sock_addr);
+		sock_fd = wait_for_connection(server_fd, port, (struct sockaddr *)&sock_addr, &sock_addr_len);
+	}
+
+	static uint32_t get_u32(const uint8_t *b) {
+		return (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+	}
+
+	void respond(bool err, uint32_t data) {
+		txbuf.push_back(err);
+		for (int i = 0; i < 4; ++i)
+			txbuf.push_back((data >> 8 * i) & 0xffu);
+	}
+
+	// Call after the clock's rising edge, before dmi.drive(). Once the
+	// previous command has finished, queue the next one on `dmi`, blocking
+	// on the socket if none has been received yet. Returns false if the
+	// client sent quit.
+	bool service(dmi_host &dmi) {
+		if (idle_cycles > 0)
+			--idle_cycles;
+		while (!dmi.busy() && idle_cycles == 0) {
+			const uint8_t *cmd = (const uint8_t *)rxbuf.data() + rx_ptr;
+			size_t avail = rxbuf.size() - rx_ptr;
+			size_t len = avail == 0 ? 1 : cmd[0] == 'r' ? 2 : cmd[0] == 'w' ? 6 : cmd[0] == 'i' ? 5 : 1;
+			if (avail < len) {
+				// Caught up with the client: send responses, and wait for more.
+				if (!txbuf.empty()) {
+					send(sock_fd, txbuf.data(), txbuf.size(), 0);
+					txbuf.clear();
+				}
+				rxbuf.erase(0, rx_ptr);
+				rx_ptr = 0;
+				char buf[TCP_BUF_SIZE];
+				ssize_t n = read(sock_fd, buf, sizeof(buf));
+				if (n <= 0) {
+					// The socket is closed. Wait for another connection.
+					close(sock_fd);
+					rxbuf.clear();
+					sock_fd = wait_for_connection(server_fd, port, (struct sockaddr *)&sock_addr, &sock_addr_len);
+				}
+				else {
+					rxbuf.append(buf, n);
+				}
+				continue;
+			}
+			rx_ptr += len;
+			if (cmd[0] == 'r') {
+				dmi.read(cmd[1] & 0x7fu, [this, &dmi](uint32_t rdata) {respond(dmi.err, rdata);});
+			}
+			else if (cmd[0] == 'w') {
+				dmi.write(cmd[1] & 0x7fu, get_u32(cmd + 2), [this, &dmi](uint32_t) {respond(dmi.err, 0);});
+			}
+			else if (cmd[0] == 'i') {
+				idle_cycles = get_u32(cmd + 1);
+				respond(false, 0);
+			}
+			else if (cmd[0] == 'q') {
+				printf("DMI client sent quit command\n");
+				return false;
+			}
+			else {
+				fprintf(stderr, "DMI socket: unknown command 0x%02x\n", cmd[0]);
+				exit(-1);
+			}
+		}
+		return true;
+	}
+};
+
+enum bitbang_action {
+	BITBANG_NONE, // Takes no time
+	BITBANG_STEP, // Needs a clock cycle to take effect
+	BITBANG_READ, // Send TDO back to OpenOCD
+	BITBANG_QUIT
+};
+
+// Apply one OpenOCD remote bitbang command to the JTAG inputs
+static bitbang_action apply_bitbang_cmd(cxxrtl_design::p_tb &top, char c) {
+	if (c == 'r' || c == 's') {
+		top.p_trst__n.set<bool>(true);
+		return BITBANG_STEP;
+	}
+	else if (c == 't' || c == 'u') {
+		top.p_trst__n.set<bool>(false);
+	}
+	else if (c >= '0' && c <= '7') {
+		int mask = c - '0';
+		top.p_tck.set<bool>(mask & 0x4);
+		top.p_tms.set<bool>(mask & 0x2);
+		top.p_tdi.set<bool>(mask & 0x1);
+		return BITBANG_STEP;
+	}
+	else if (c == 'R') {
+		return BITBANG_READ;
+	}
+	else if (c == 'Q') {
+		return BITBANG_QUIT;
+	}
+	return BITBANG_NONE;
+}
+
+// With --freerun, an idle socket is polled with exponential backoff, up to
+// this many cycles between polls, to keep syscalls off the critical path.
+static const int64_t FREERUN_POLL_MAX = 1024;
+
 int main(int argc, char **argv) {
 
 	bool load_bin = false;
@@ -304,10 +839,15 @@ int main(int argc, char **argv) {
 	int64_t max_cycles = 0;
 	bool propagate_return_code = false;
 	uint16_t port = 0;
+	uint16_t dmi_port = 0;
+	int64_t freerun_ratio = 0;
 	bool dump_jtag = false;
 	std::string jtag_dump_path;
 	bool replay_jtag = false;
 	std::string jtag_replay_path;
+	state_hash hasher;
+	std::string state_hash_path;
+	std::string handoff_prefix;
 
 	for (int i = 1; i < argc; ++i) {
 		std::string s(argv[i]);
@@ -364,6 +904,53 @@ int main(int argc, char **argv) {
 			port = std::stol(argv[i + 1], 0, 0);
 			i += 1;
 		}
+		else if (s == "--freerun") {
+			if (argc - i < 2)
+				exit_help("Option --freerun requires an argument\n");
+			freerun_ratio = std::stol(argv[i + 1], 0, 0);
+			if (freerun_ratio <= 0)
+				exit_help("Option --freerun must be positive\n");
+			i += 1;
+		}
+		else if (s == "--dmi-port") {
+			if (argc - i < 2)
+				exit_help("Option --dmi-port requires an argument\n");
+			dmi_port = std::stol(argv[i + 1], 0, 0);
+			i += 1;
+		}
+		else if (s == "--state-hash") {
+			if (argc - i < 2)
+				exit_help("Option --state-hash requires an argument\n");
+			hasher.interval = std::stoull(argv[i + 1], 0, 0);
+			if (hasher.interval == 0)
+				exit_help("Option --state-hash must be nonzero\n");
+			i += 1;
+		}
+		else if (s == "--state-hash-range") {
+			if (argc - i < 2)
+				exit_help("Option --state-hash-range requires an argument\n");
+			std::string range(argv[i + 1]);
+			size_t colon = range.find(':');
+			if (colon == std::string::npos)
+				exit_help("Option --state-hash-range must be of the form a:b\n");
+			if (colon > 0)
+				hasher.print_start = std::stoull(range.substr(0, colon), 0, 0);
+			if (colon + 1 < range.size())
+				hasher.print_end = std::stoull(range.substr(colon + 1), 0, 0);
+			i += 1;
+		}
+		else if (s == "--state-hash-out") {
+			if (argc - i < 2)
+				exit_help("Option --state-hash-out requires an argument\n");
+			state_hash_path = argv[i + 1];
+			i += 1;
+		}
+		else if (s == "--load-handoff") {
+			if (argc - i < 2)
+				exit_help("Option --load-handoff requires an argument\n");
+			handoff_prefix = argv[i + 1];
+			i += 1;
+		}
 		else if (s == "--cpuret") {
 			propagate_return_code = true;
 		}
@@ -372,48 +959,45 @@ int main(int argc, char **argv) {
 			exit_help("");
 		}
 	}
-	if (!(load_bin || port != 0 || replay_jtag))
-		exit_help("At least one of --bin, --port or --jtagreplay must be specified.\n");
+	bool load_handoff = !handoff_prefix.empty();
+	if (!(load_bin || port != 0 || dmi_port != 0 || replay_jtag || load_handoff))
+		exit_help("At least one of --bin, --port, --dmi-port, --jtagreplay or --load-handoff must be specified.\n");
+	if (load_handoff && (load_bin || port != 0 || dmi_port != 0 || replay_jtag))
+		exit_help("Can't combine --load-handoff with --bin, --port, --dmi-port or --jtagreplay\n");
+	if (dmi_port != 0 && (port != 0 || replay_jtag))
+		exit_help("Can't combine --dmi-port with --port or --jtagreplay\n");
 	if (dump_jtag && port == 0)
 		exit_help("--jtagdump specified, but there is no JTAG socket to dump from.\n");
 	if (replay_jtag && port != 0)
 		exit_help("Can't specify both --port and --jtagreplay\n");
+	if (freerun_ratio != 0 && port == 0)
+		exit_help("--freerun specified, but there is no JTAG socket (--port) to serve.\n");
 
-	int server_fd, sock_fd;
+	int server_fd = -1, sock_fd = -1;
 	struct sockaddr_in sock_addr;
-	int sock_opt = 1;
 	socklen_t sock_addr_len = sizeof(sock_addr);
 	char txbuf[TCP_BUF_SIZE], rxbuf[TCP_BUF_SIZE];
 	int rx_ptr = 0, rx_remaining = 0, tx_ptr = 0;
 
 	if (port != 0) {
-		server_fd = socket(AF_INET, SOCK_STREAM, 0);
-		if (server_fd == 0) {
-			fprintf(stderr, "socket creation failed\n");
-			exit(-1);
-		}
-
-		int setsockopt_rc = setsockopt(
-			server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT,
-			&sock_opt, sizeof(sock_opt)
-		);
-
-		if (setsockopt_rc) {
-			fprintf(stderr, "setsockopt failed\n");
-			exit(-1);
+		server_fd = open_server_socket(port, &sock_addr);
+		if (freerun_ratio != 0) {
+			// OpenOCD can attach later, so don't hold up the simulation
+			if (listen(server_fd, 3) < 0) {
+				fprintf(stderr, "listen failed\n");
+				exit(-1);
+			}
+			printf("Listening for connection on port %u, free-running\n", port);
 		}
-
-		sock_addr.sin_family = AF_INET;
-		sock_addr.sin_addr.s_addr = INADDR_ANY;
-		sock_addr.sin_port = htons(port);
-		if (bind(server_fd, (struct sockaddr *)&sock_addr, sizeof(sock_addr)) < 0) {
-			fprintf(stderr, "bind failed\n");
-			exit(-1);
+		else {
+			sock_fd = wait_for_connection(server_fd, port, (struct sockaddr *)&sock_addr, &sock_addr_len);
 		}
-
-		sock_fd = wait_for_connection(server_fd, port, (struct sockaddr *)&sock_addr, &sock_addr_len);
 	}
 
+	dmi_server dmi_sock;
+	if (dmi_port != 0)
+		dmi_sock.open(dmi_port);
+
 	mem_io_state memio;
 
 	if (load_bin) {
@@ -451,6 +1035,45 @@ int main(int argc, char **argv) {
 
 	cxxrtl_design::p_tb top;
 
+	// The hart runs from reset with empty memory (so takes illegal
+	// instruction traps in a loop) until it is halted, then memory is loaded
+	dmi_host dmi;
+	handoff_state handoff;
+	std::ifstream bin_fd;
+	std::streamsize bin_size = 0;
+	int64_t handoff_cycle = 0;
+	if (load_handoff) {
+		if (!handoff.load(handoff_prefix))
+			return -1;
+		for (int i = 1; i < 4; ++i) {
+			if (handoff.irq[i])
+				std::cerr << "Warning: handoff sets IRQs above 31, which this testbench doesn't have\n";
+		}
+		bin_fd.open(handoff.bin_path, std::ios::binary | std::ios::ate);
+		if (!bin_fd) {
+			std::cerr << "Failed to open \"" << handoff.bin_path << "\"\n";
+			return -1;
+		}
+		bin_size = bin_fd.tellg();
+		if (bin_size > MEM_SIZE) {
+			std::cerr << "Handoff RAM image (" << bin_size << " bytes) is larger than memory (" << MEM_SIZE << " bytes)\n";
+			return -1;
+		}
+		queue_handoff(dmi, handoff,
+			[&](uint32_t) {
+				bin_fd.seekg(0, std::ios::beg);
+				bin_fd.read((char*)memio.mem, bin_size);
+			},
+			[&](uint32_t) {
+				memio.mtime = handoff.mtime;
+				memio.mtimecmp[0] = handoff.mtimecmp;
+				top.p_soft__irq.set<uint8_t>(handoff.softirq);
+				top.p_irq.set<uint32_t>(handoff.irq[0]);
+				printf("Handoff complete after " I64_FMT " cycles, resuming at %08x\n", handoff_cycle, handoff.pc);
+			}
+		);
+	}
+
 	std::ofstream waves_fd;
 	cxxrtl::vcd_writer vcd;
 	if (dump_waves) {
@@ -461,6 +1084,20 @@ int main(int argc, char **argv) {
 		vcd.add(all_debug_items);
 	}
 
+	cxxrtl::debug_items hash_debug_items;
+	if (hasher.interval) {
+		top.debug_info(&hash_debug_items, /*scopes=*/nullptr, "");
+		if (!hasher.bind(hash_debug_items))
+			return -1;
+		if (!state_hash_path.empty()) {
+			hasher.out = fopen(state_hash_path.c_str(), "w");
+			if (!hasher.out) {
+				std::cerr << "Failed to open \"" << state_hash_path << "\"\n";
+				return -1;
+			}
+		}
+	}
+
 	// Loop-carried address-phase requests
 	bus_request req_i;
 	bus_request req_d;
@@ -486,10 +1123,27 @@ int main(int argc, char **argv) {
 	top.step();
 	top.step(); // workaround for github.com/YosysHQ/yosys/issues/2780
 
+	auto flush_tx = [&]() {
+		if (tx_ptr > 0 && sock_fd >= 0)
+			send(sock_fd, txbuf, tx_ptr, 0);
+		tx_ptr = 0;
+	};
+	auto send_tdo = [&]() {
+		txbuf[tx_ptr++] = top.p_tdo.get<bool>() ? '1' : '0';
+		if (tx_ptr >= TCP_BUF_SIZE || rx_remaining == 0)
+			flush_tx();
+	};
+	int64_t freerun_next = 0;
+	int64_t freerun_backoff = 1;
+
 	bool timed_out = false;
 	for (int64_t cycle = 0; cycle < max_cycles || max_cycles == 0; ++cycle) {
 		top.p_clk.set<bool>(false);
 		top.step();
+		if (dmi.busy())
+			dmi.sample(top);
+		if (hasher.interval)
+			hasher.sample();
 		if (dump_waves)
 			vcd.sample(cycle * 2);
 		top.p_clk.set<bool>(true);
@@ -505,34 +1159,19 @@ int main(int argc, char **argv) {
 		// writes) but reads take 0 cycles, step=false.
 		bool got_exit_cmd = false;
 		bool step = false;
-		if (port != 0 or replay_jtag) {
+		if ((port != 0 && freerun_ratio == 0) || replay_jtag) {
 			while (!step) {
 				if (rx_remaining > 0) {
-					char c = rxbuf[rx_ptr++];
+					bitbang_action action = apply_bitbang_cmd(top, rxbuf[rx_ptr++]);
 					--rx_remaining;
 
-					if (c == 'r' || c == 's') {
-						top.p_trst__n.set<bool>(true);
-						step = true;
-					}
-					else if (c == 't' || c == 'u') {
-						top.p_trst__n.set<bool>(false);
-					}
-					else if (c >= '0' && c <= '7') {
-						int mask = c - '0';
-						top.p_tck.set<bool>(mask & 0x4);
-						top.p_tms.set<bool>(mask & 0x2);
-						top.p_tdi.set<bool>(mask & 0x1);
+					if (action == BITBANG_STEP) {
 						step = true;
 					}
-					else if (c == 'R') {
-						txbuf[tx_ptr++] = top.p_tdo.get<bool>() ? '1' : '0';
-						if (tx_ptr >= TCP_BUF_SIZE || rx_remaining == 0) {
-							send(sock_fd, txbuf, tx_ptr, 0);
-							tx_ptr = 0;
-						}
+					else if (action == BITBANG_READ) {
+						send_tdo();
 					}
-					else if (c == 'Q') {
+					else if (action == BITBANG_QUIT) {
 						printf("OpenOCD sent quit command\n");
 						got_exit_cmd = true;
 						step = true;
@@ -543,10 +1182,7 @@ int main(int argc, char **argv) {
 					// OpenOCD is still waiting for a last response from its
 					// last command packet before it sends us any more, so now is
 					// the time to flush TX.
-					if (tx_ptr > 0) {
-						send(sock_fd, txbuf, tx_ptr, 0);
-						tx_ptr = 0;
-					}	
+					flush_tx();
 					rx_ptr = 0;
 					if (replay_jtag) {
 						rx_remaining = jtag_replay_fd.readsome(rxbuf, TCP_BUF_SIZE);
@@ -571,7 +1207,81 @@ int main(int argc, char **argv) {
 			}
 		}
 
+		// With --freerun, the core clock never waits for the socket. Bitbang
+		// commands are applied at most one TCK/TMS/TDI write per freerun_ratio
+		// cycles, and the socket is only read when poll() says there is data.
+		// OpenOCD connecting, disconnecting or quitting doesn't stop the run.
+		if (freerun_ratio != 0 && cycle >= freerun_next) {
+			freerun_next = cycle + 1;
+			while (true) {
+				if (rx_remaining > 0) {
+					bitbang_action action = apply_bitbang_cmd(top, rxbuf[rx_ptr++]);
+					--rx_remaining;
+					if (action == BITBANG_STEP) {
+						freerun_next = cycle + freerun_ratio;
+						break;
+					}
+					else if (action == BITBANG_READ) {
+						send_tdo();
+					}
+					else if (action == BITBANG_QUIT) {
+						printf("OpenOCD sent quit command, detaching\n");
+						flush_tx();
+						close(sock_fd);
+						sock_fd = -1;
+						rx_remaining = 0;
+						break;
+					}
+					continue;
+				}
+				flush_tx();
+				struct pollfd pfd;
+				pfd.fd = sock_fd >= 0 ? sock_fd : server_fd;
+				pfd.events = POLLIN;
+				if (poll(&pfd, 1, 0) <= 0) {
+					// Nothing yet, so back off
+					freerun_next = cycle + freerun_backoff;
+					freerun_backoff = std::min(freerun_backoff * 2, FREERUN_POLL_MAX);
+					break;
+				}
+				freerun_backoff = 1;
+				if (sock_fd < 0) {
+					sock_fd = accept(server_fd, (struct sockaddr *)&sock_addr, &sock_addr_len);
+					if (sock_fd < 0) {
+						fprintf(stderr, "accept failed\n");
+						exit(-1);
+					}
+					printf("Connected after " I64_FMT " cycles\n", cycle + 1);
+					continue;
+				}
+				rx_ptr = 0;
+				rx_remaining = read(sock_fd, &rxbuf, TCP_BUF_SIZE);
+				if (dump_jtag && rx_remaining > 0) {
+					jtag_dump_fd.write(rxbuf, rx_remaining);
+				}
+				if (rx_remaining <= 0) {
+					printf("Disconnected after " I64_FMT " cycles\n", cycle + 1);
+					close(sock_fd);
+					sock_fd = -1;
+					rx_remaining = 0;
+					break;
+				}
+			}
+		}
+
+		if (dmi_port != 0 && !dmi_sock.service(dmi))
+			got_exit_cmd = true;
+
 		memio.step(top);
+		if (load_handoff || dmi_port != 0)
+			dmi.drive(top);
+		if (load_handoff) {
+			handoff_cycle = cycle + 1;
+			if (dmi.failed) {
+				fprintf(stderr, "Handoff failed\n");
+				return -1;
+			}
+		}
 
 		// The two bus ports are handled identically. This enables swapping out of
 		// various `tb.v` hardware integration files containing:
@@ -665,7 +1375,12 @@ int main(int argc, char **argv) {
 			break;
 	}
 
-	close(sock_fd);
+	if (sock_fd >= 0)
+		close(sock_fd);
+	if (dmi_port != 0)
+		close(dmi_sock.sock_fd);
+	if (hasher.interval && hasher.out != stderr)
+		fclose(hasher.out);
 	if (dump_jtag) {
 		jtag_dump_fd.close();
 	}
@@ -18,6 +18,18 @@ module tb #(
     input  wire               tdi,
     output wire               tdo,
 
+    // Direct DMI access from the testbench, bypassing JTAG. The DM is
+    // connected to this port instead of the JTAG-DTM while tb_dmi_psel is
+    // asserted, so the two must not be used at the same time.
+    input  wire               tb_dmi_psel,
+    input  wire               tb_dmi_penable,
+    input  wire               tb_dmi_pwrite,
+    input  wire [8:0]         tb_dmi_paddr,
+    input  wire [31:0]        tb_dmi_pwdata,
+    output wire [31:0]        tb_dmi_prdata,
+    output wire               tb_dmi_pready,
+    output wire               tb_dmi_pslverr,
+
 	// Instruction fetch port
 	output wire [W_ADDR-1:0]  i_haddr,
 	output wire               i_hwrite,
@@ -69,6 +81,22 @@ reg  [31:0]       dmi_prdata;
 wire              dmi_pready;
 wire              dmi_pslverr;
 
+wire              dtm_dmi_psel;
+wire              dtm_dmi_penable;
+wire              dtm_dmi_pwrite;
+wire [8:0]        dtm_dmi_paddr;
+wire [31:0]       dtm_dmi_pwdata;
+
+assign dmi_psel    = tb_dmi_psel ? 1'b1           : dtm_dmi_psel;
+assign dmi_penable = tb_dmi_psel ? tb_dmi_penable : dtm_dmi_penable;
+assign dmi_pwrite  = tb_dmi_psel ? tb_dmi_pwrite  : dtm_dmi_pwrite;
+assign dmi_paddr   = tb_dmi_psel ? tb_dmi_paddr   : dtm_dmi_paddr;
+assign dmi_pwdata  = tb_dmi_psel ? tb_dmi_pwdata  : dtm_dmi_pwdata;
+
+assign tb_dmi_prdata  = dmi_prdata;
+assign tb_dmi_pready  = dmi_pready;
+assign tb_dmi_pslverr = dmi_pslverr;
+
 wire dmihardreset_req;
 wire assert_dmi_reset = !rst_n || dmihardreset_req;
 wire rst_n_dmi;
@@ -98,13 +126,13 @@ hazard3_jtag_dtm #(
 	.clk_dmi          (clk),
 	.rst_n_dmi        (rst_n_dmi),
 
-	.dmi_psel         (dmi_psel),
-	.dmi_penable      (dmi_penable),
-	.dmi_pwrite       (dmi_pwrite),
-	.dmi_paddr        (dmi_paddr),
-	.dmi_pwdata       (dmi_pwdata),
+	.dmi_psel         (dtm_dmi_psel),
+	.dmi_penable      (dtm_dmi_penable),
+	.dmi_pwrite       (dtm_dmi_pwrite),
+	.dmi_paddr        (dtm_dmi_paddr),
+	.dmi_pwdata       (dtm_dmi_pwdata),
 	.dmi_prdata       (dmi_prdata),
-	.dmi_pready       (dmi_pready),
+	.dmi_pready       (dmi_pready && !tb_dmi_psel),
 	.dmi_pslverr      (dmi_pslverr)
 );
 